@@ -16,16 +16,29 @@
 #include "stdafx.h"
 // ----------------------------------------------------------------------------
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <random>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <type_traits>
 #include <tuple>
 // ----------------------------------------------------------------------------
 #include "cpp_pc/pc.hpp"
+#include "cpp_pc/compile_time.hpp"
+#include "cpp_pc/parallel.hpp"
+#include "cpp_pc/tokens.hpp"
+#include "cpp_pc/incremental.hpp"
+#include "cpp_pc/json.hpp"
+#include "cpp_pc/push.hpp"
+#include "cpp_pc/segmented.hpp"
+#include "cpp_pc/vm.hpp"
 // ----------------------------------------------------------------------------
 #define TEST_EQ(expected, actual) test_eq (__FILE__, __LINE__, __FUNCTION__, #expected, expected, #actual, actual)
 // ----------------------------------------------------------------------------
@@ -179,11 +192,27 @@ namespace test_parser
   template<typename T>
   void test_opt (T const & one, T const & /*two*/)
   {
+    auto const is_trivial = std::is_trivially_copyable<T>::value;
+
+    TEST_EQ (is_trivial, std::is_trivially_copyable<opt<T>>::value);
+    TEST_EQ (is_trivial, std::is_trivially_destructible<opt<T>>::value);
+
     {
       opt<T> empty;
       TEST_EQ (true, empty.is_empty ());
     }
 
+    {
+      opt<T> o (in_place, one);
+      if (TEST_EQ (false, o.is_empty ()))
+      {
+        TEST_EQ (one, o.get ());
+      }
+
+      o.emplace (one);
+      TEST_EQ (one, o.get ());
+    }
+
 
     {
       opt<T> empty = empty_opt;
@@ -257,12 +286,13 @@ namespace test_parser
     {
       opt<T> o { one };
       opt<T> c = std::move (o);
-      TEST_EQ (true, o.is_empty ());
+      // opt of trivial types is trivially copyable, moving doesn't empty it
+      TEST_EQ (!is_trivial, o.is_empty ());
       if (TEST_EQ (false, c.is_empty ()))
       {
         TEST_EQ (one, c.get ());
       }
-      TEST_EQ (true, o != c);
+      TEST_EQ (!is_trivial, o != c);
     }
 
     {
@@ -284,12 +314,189 @@ namespace test_parser
       opt<T> o { one };
       opt<T> c;
       c = std::move (o);
-      TEST_EQ (true, o.is_empty ());
+      // opt of trivial types is trivially copyable, moving doesn't empty it
+      TEST_EQ (!is_trivial, o.is_empty ());
       if (TEST_EQ (false, c.is_empty ()))
       {
         TEST_EQ (one, c.get ());
       }
-      TEST_EQ (true, o != c);
+      TEST_EQ (!is_trivial, o != c);
+    }
+  }
+
+  void test_line_index ()
+  {
+    std::mt19937 random (19740531);
+    std::uniform_int_distribution<int> line_size (0, 10000);
+
+    // Lines both shorter and longer than the blocks of the index
+    std::string input;
+    while (input.size () < 200000)
+    {
+      input.append (static_cast<std::size_t> (line_size (random)), 'x');
+      input += '\n';
+    }
+
+    auto begin  = input.c_str ();
+    auto end    = begin + input.size ();
+
+    line_index index (begin, end);
+
+    auto line   = std::size_t (1);
+    auto column = std::size_t (1);
+    for (auto offset = std::size_t (); offset <= input.size (); ++offset)
+    {
+      auto lc = index.locate (offset);
+      if (!TEST_EQ (line, lc.line) || !TEST_EQ (column, lc.column))
+      {
+        std::cout << "  offset: " << offset << std::endl;
+        break;
+      }
+
+      if (offset < input.size () && input[offset] == '\n')
+      {
+        ++line;
+        column = 1;
+      }
+      else
+      {
+        ++column;
+      }
+    }
+
+    {
+      auto p = pskip_char ('{') > pskip_char ('\n') > pskip_char ('}');
+
+      auto text     = std::string ("{\n]");
+      auto expected = parse (p, text);
+      auto actual   = try_parse (p, text);
+
+      TEST_EQ (expected.consumed, actual.consumed);
+      TEST_EQ (std::string (), actual.message);
+      TEST_EQ (expected.message, actual.error.describe (text.c_str (), text.c_str () + text.size ()));
+
+      line_index text_index (text.c_str (), text.c_str () + text.size ());
+      auto lc = actual.error.locate (text_index);
+      TEST_EQ (2U, lc.line);
+      TEST_EQ (1U, lc.column);
+    }
+  }
+
+  struct sum_folder
+  {
+    CPP_PC__PRELUDE std::int64_t operator () (std::int64_t sum, std::int64_t v) const
+    {
+      return sum + v;
+    }
+  };
+
+  void test_compile_time ()
+  {
+    namespace ct = cpp_pc::compile_time;
+
+    CPP_PC__PRELUDE auto pversion = ct::ptuple (
+        ct::puint64 ()
+      , ct::pskip_char ('.') < ct::puint64 ()
+      , ct::pskip_char ('.') < ct::puint64 ()
+      );
+
+    CPP_PC__PRELUDE auto version = ct::parse (pversion, "1.12.3");
+    static_assert (version && version.position == 6, "Expected version to be parsed");
+    static_assert (std::get<1> (version.get ()) == 12, "Expected minor version 12");
+    static_assert (!ct::is_valid (pversion, "1.12."), "Expected an incomplete version to be rejected");
+
+    CPP_PC__PRELUDE auto psum = ct::pmany_sepby_fold (
+        ct::pskip_ws () < ct::pint64 ()
+      , ct::pskip_ws () < ct::pskip_char (',')
+      , std::int64_t (0)
+      , sum_folder ()
+      ) > ct::pskip_ws () > ct::peos ();
+
+    static_assert (ct::parse (psum, "1, -2 ,30 ").get () == 29, "Expected the sum to be 29");
+    static_assert (ct::parse (psum, "1, 2,x").position == 4, "Expected failure after 2");
+
+    CPP_PC__PRELUDE auto pkey = ct::pchoice (ct::pchar ('a'), ct::pchar ('b'), ct::pchar ('c'));
+    static_assert (ct::parse (pkey, "c").get () == 'c', "Expected c");
+    static_assert (!ct::parse (pkey, "d"), "Expected d to be rejected");
+
+    // The same parsers run on input that isn't known at compile time
+    std::string input = "10, 20, 30";
+    auto v = ct::parse (psum, input.c_str (), input.c_str () + input.size ());
+    if (TEST_EQ (true, static_cast<bool> (v)))
+    {
+      TEST_EQ (60, v.get ());
+    }
+    TEST_EQ (input.size (), v.position);
+  }
+
+  void test_vm ()
+  {
+    {
+      // Recursion, S := ('(' S ')')*
+      vm::grammar g;
+      g.define ("s", vm::pmany (vm::psequence (vm::pchar ('('), vm::pref ("s"), vm::pchar (')'))));
+      g.define ("start", vm::psequence (vm::pref ("s"), vm::peos ()));
+
+      auto program = g.compile ("start");
+      if (TEST_EQ (true, !!program))
+      {
+        auto r = vm::match (program.get (), "(()())");
+        TEST_EQ (true, r.matched);
+        TEST_EQ (6U, r.consumed);
+
+        r = vm::match (program.get (), "(()");
+        TEST_EQ (false, r.matched);
+        TEST_EQ (3U, r.consumed);
+      }
+    }
+
+    {
+      // Captures, in the order they were opened
+      auto pkey   = vm::pcapture (1, vm::pmany1 (vm::prange ('a', 'z')));
+      auto pvalue = vm::pcapture (2, vm::pmany1 (vm::prange ('0', '9')));
+      auto ppair  = vm::pcapture (3, vm::psequence (pkey, vm::pchar ('='), pvalue));
+
+      vm::grammar g;
+      g.define ("pairs", vm::psequence (vm::pmany_sepby (ppair, vm::pchar (',')), vm::peos ()));
+
+      auto r = vm::match (g.compile ("pairs").get (), "a=1,bc=23");
+      if (TEST_EQ (true, r.matched) && TEST_EQ (6U, r.captures.size ()))
+      {
+        TEST_EQ (3U, r.captures[3].id);
+        TEST_EQ (4U, r.captures[3].begin);
+        TEST_EQ (9U, r.captures[3].end);
+        TEST_EQ (1U, r.captures[4].id);
+        TEST_EQ (4U, r.captures[4].begin);
+        TEST_EQ (6U, r.captures[4].end);
+      }
+    }
+
+    {
+      // The captures of an alternative that failed are dropped
+      vm::grammar g;
+      g.define ("start", vm::pchoice (
+          vm::psequence (vm::pcapture (1, vm::pskip_string ("ab")), vm::pchar ('x'))
+        , vm::psequence (vm::pcapture (2, vm::pskip_string ("ab")), vm::pnot (vm::pchar ('x')))
+        ));
+
+      auto r = vm::match (g.compile ("start").get (), "aby");
+      if (TEST_EQ (true, r.matched) && TEST_EQ (1U, r.captures.size ()))
+      {
+        TEST_EQ (2U, r.captures[0].id);
+        TEST_EQ (2U, r.consumed);
+      }
+    }
+
+    {
+      vm::grammar g;
+      g.define ("start", vm::psequence (vm::pref ("missing"), vm::peos ()));
+
+      TEST_EQ (false, !!g.compile ("start"));
+      auto undefined = g.undefined ("start");
+      if (TEST_EQ (1U, undefined.size ()))
+      {
+        TEST_EQ (std::string ("missing"), undefined.front ());
+      }
     }
   }
 
@@ -575,6 +782,123 @@ namespace test_parser
       TEST_EQ (expected, actual);
     }
 
+    {
+      auto p =
+            pint
+        >   pskip_ws
+        >   pskip_char ('+')
+        >   pskip_ws
+        ;
+
+      result<int> expected  = result<int>::success (7, 1234);
+      result<int> actual    = plain_parse (p, input);
+      TEST_EQ (expected, actual);
+    }
+
+    {
+      // Nested pchoice are flattened and adjacent character classes merged
+      auto p =
+            pchoice (pchoice (pskip_char ('1'), pskip_char ('+')), pskip_char ('2'), pskip_ws)
+        ;
+      using function_type = decltype (p.parser_function);
+      TEST_EQ (2U, std::tuple_size<decltype (std::declval<function_type> ().parsers)>::value);
+
+      result<unit_type> expected  = result<unit_type>::success (1, unit);
+      result<unit_type> actual    = plain_parse (p, input);
+      TEST_EQ (expected, actual);
+    }
+
+    {
+      auto p =
+            pchoice (pany_of ("+-"), pany_of ("*/"))
+        ;
+      using expected_type = cpp_pc::detail::any_of_function<char>;
+      TEST_EQ (true, (std::is_same<expected_type, decltype (p.parser_function)>::value));
+
+      result<char> expected  = result<char>::success (1, '/');
+      result<char> actual    = plain_parse (p, "/");
+      TEST_EQ (expected, actual);
+
+      result<char> expected_failure = result<char>::failure (0);
+      result<char> actual_failure   = plain_parse (p, "1");
+      TEST_EQ (expected_failure, actual_failure);
+    }
+
+    {
+      auto table = operator_table<char> ()
+        .infix    ('+', 1)
+        .infix    ('-', 1)
+        .infix    ('*', 2)
+        .infix    ('^', 3, associativity::right)
+        .prefix   ('-', 4)
+        .postfix  ('!', 5)
+        ;
+
+      auto p = pexpression (
+            pmap (pint, [] (int v) { return std::to_string (v); }) > pskip_ws
+          , pany_of ("+-*^!") > pskip_ws
+          , table
+          , [] (std::string l, char op, std::string r) { return "(" + l + op + r + ")"; }
+          , [] (char op, std::string v) { return "(" + std::string (1, op) + v + ")"; }
+          , [] (std::string v, char op) { return "(" + v + op + ")"; }
+          )
+        ;
+
+      result<std::string> expected  = result<std::string>::success (16, "(((1-2)+((-3)*(4!)))-(2^(3^2)))");
+      result<std::string> actual    = plain_parse (p, "1-2+-3*4!-2^3^2 ");
+      TEST_EQ (expected, actual);
+
+      result<std::string> expected_failure  = result<std::string>::failure (4);
+      result<std::string> actual_failure    = plain_parse (p, "1 * * 2");
+      TEST_EQ (expected_failure, actual_failure);
+    }
+
+    {
+      // Once '(' matched the first alternative is committed
+      auto pgroup = pskip_char ('(') < pcut (pint > pskip_char (')'));
+      auto p      = pchoice (pgroup, pskip_char ('(') < preturn (0));
+
+      result<int> expected  = result<int>::success (4, 12);
+      result<int> actual    = plain_parse (p, "(12)");
+      TEST_EQ (expected, actual);
+
+      result<int> expected_failure  = result<int>::failure (3);
+      result<int> actual_failure    = plain_parse (p, "(12");
+      TEST_EQ (expected_failure, actual_failure);
+
+      // pmany fails rather than succeed with the groups before the failure
+      result<std::vector<int>> expected_many  = result<std::vector<int>>::failure (4);
+      result<std::vector<int>> actual_many    = plain_parse (pmany (pgroup), "(1)(x");
+      TEST_EQ (expected_many, actual_many);
+    }
+
+    {
+      // pmany_char consumes runs of psatisfy_char and pany_of in one go,
+      //  wrapping the parser in pmap makes pmany_char invoke it per character
+      auto identity = [] (char ch) { return ch; };
+
+      auto check = [&] (auto && bulk, auto && per_char, std::string const & input)
+        {
+          auto expected = parse (per_char, input);
+          auto actual   = parse (bulk, input);
+
+          TEST_EQ (expected.consumed, actual.consumed);
+          TEST_EQ (expected.message, actual.message);
+          TEST_EQ (expected.value, actual.value);
+        };
+
+      auto pdigits  = psatisfy_char ("digit", satisfy_digit);
+      auto psigns   = pany_of ("+-");
+
+      for (auto && input : { "", "123", "123a", "+-+1", "1234567" })
+      {
+        check (pmany_char (pdigits) > peos, pmany_char (pmap (pdigits, identity)) > peos, input);
+        check (pmany_char (2, 4, pdigits) > peos, pmany_char (2, 4, pmap (pdigits, identity)) > peos, input);
+        check (pmany_char (0, 0, pdigits) > peos, pmany_char (0, 0, pmap (pdigits, identity)) > peos, input);
+        check (pmany_char1 (psigns) > pmany_char (pdigits), pmany_char1 (pmap (psigns, identity)) > pmany_char (pmap (pdigits, identity)), input);
+      }
+    }
+
     // TODO:
     // pbreakpoint
     // pchoice
@@ -768,6 +1092,127 @@ namespace calculator
     return pskip_ws < pexpr > peos;
   } ();
 
+  // Integer expressions with twelve left associative precedence levels,
+  //  the value is a hash of the expression tree. Used to compare pexpression
+  //  with the approach above of one nested psep per precedence level
+  char const        operator_levels[] = "|^&=<>+-*/%@"          ;
+  std::size_t const level_count       = sizeof (operator_levels) - 1;
+
+  std::uint32_t combine (std::uint32_t l, char op, std::uint32_t r)
+  {
+    return l*31U + r*7U + static_cast<std::uint32_t> (op);
+  }
+
+  template<typename TParser>
+  auto pnested_levels (TParser const & p, std::integral_constant<std::size_t, 0>)
+  {
+    return p;
+  }
+
+  template<typename TParser, std::size_t Level>
+  auto pnested_levels (TParser const & p, std::integral_constant<std::size_t, Level>)
+  {
+    auto pop =
+          pany_of (std::string (1, operator_levels[level_count - Level]))
+      >   pskip_ws
+      ;
+
+    return psep (pnested_levels (p, std::integral_constant<std::size_t, Level - 1> ()), pop, combine);
+  }
+
+  template<typename TExpressionBuilder>
+  auto pinteger_expr (TExpressionBuilder && build)
+  {
+    auto pexpr_trampoline = create_trampoline<std::uint32_t> ();
+    auto pexpr            = ptrampoline<std::uint32_t> (pexpr_trampoline);
+    auto psub_expr        = pbetween (pskip_char ('(') > pskip_ws, pexpr, pskip_char (')'));
+    auto pint_expr        = pmap (puint32, [] (std::uint32_t v) { return v; });
+
+    auto pvalue_expr      = pchoice (pint_expr, psub_expr) > pskip_ws;
+    auto ptop_expr        = build (pvalue_expr);
+
+    pexpr_trampoline->trampoline = ptop_expr.parser_function;
+    return pskip_ws < pexpr > peos;
+  }
+
+  auto const pnested_expr = pinteger_expr ([] (auto const & pvalue_expr)
+    {
+      return pnested_levels (pvalue_expr, std::integral_constant<std::size_t, level_count> ());
+    });
+
+  auto const ppratt_expr = pinteger_expr ([] (auto const & pvalue_expr)
+    {
+      operator_table<char> table;
+      for (auto iter = 0U; iter < level_count; ++iter)
+      {
+        table.infix (operator_levels[iter], iter + 1);
+      }
+
+      return pexpression (pvalue_expr, pany_of (operator_levels) > pskip_ws, std::move (table), combine);
+    });
+
+  std::string generate_expression (std::mt19937 & random, int depth)
+  {
+    auto next = [&random] (int min, int max) { return std::uniform_int_distribution<int> (min, max) (random); };
+
+    std::string result;
+
+    auto operands = next (1, 8);
+    for (auto iter = 0; iter < operands; ++iter)
+    {
+      if (iter > 0)
+      {
+        result += operator_levels[next (0, level_count - 1)];
+        result += next (0, 1) ? " " : "";
+      }
+
+      if (depth < 3 && next (0, 4) == 0)
+      {
+        result += "(" + generate_expression (random, depth + 1) + ")";
+      }
+      else
+      {
+        result += std::to_string (next (0, 1000));
+      }
+    }
+
+    return result;
+  }
+
+  void test_expression (std::mt19937 & random)
+  {
+    auto random_testcases = 1000U;
+
+    std::cout << "Running " << random_testcases << " pexpression testcases..." << std::endl;
+
+    for (auto iter = 0U; iter < random_testcases; ++iter)
+    {
+      auto input = generate_expression (random, 0);
+      if (iter % 10 == 0)
+      {
+        input.insert (static_cast<std::size_t> (std::uniform_int_distribution<int> (0, static_cast<int> (input.size ())) (random)), 1, ')');
+      }
+
+      auto expected = parse (pnested_expr, input);
+      auto actual   = parse (ppratt_expr, input);
+
+      auto same =
+            expected.consumed == actual.consumed
+        &&  !expected.value   == !actual.value
+        &&  (!expected.value || expected.value.get () == actual.value.get ())
+        ;
+
+      if (!same)
+      {
+        std::cout
+          << "ERROR: pexpression differs from nested psep: '" << input << "'" << std::endl
+          ;
+      }
+    }
+
+    std::cout << "Done!" << std::endl;
+  }
+
   variables const vars
   {
     {"x"  , 3},
@@ -799,6 +1244,10 @@ namespace calculator
 
   void test_calculator ()
   {
+    std::mt19937 random (19740531);
+
+    test_expression (random);
+
     std::cout << "Variables:" << std::endl;
     for (auto && kv : vars)
     {
@@ -828,418 +1277,276 @@ namespace calculator
 namespace json
 {
   using namespace cpp_pc;
+  using namespace cpp_pc::json;
 
-  struct json_ast
+  // The JSON grammar for the PEG virtual machine, recognizes the same
+  //  documents as pjson
+  vm::program make_vm_json_grammar ()
   {
-    using ptr = std::shared_ptr<json_ast> ;
-    json_ast ()                             = default;
-    json_ast (json_ast const &)             = delete ;
-    json_ast (json_ast &&)                  = delete ;
-    json_ast & operator = (json_ast const &)= delete ;
-    json_ast & operator = (json_ast &&)     = delete ;
-    virtual ~json_ast ()                    = default;
+    auto ws       = vm::pskip_ws ();
+    auto digits   = vm::pmany1 (vm::prange ('0', '9'));
+    auto run      = vm::pmany (vm::pnone_of ("\"\\"));
+    auto escaped  = vm::psequence (vm::pchar ('\\'), vm::pany_of ("\"\\/bfnrt"));
+
+    vm::grammar g;
+
+    g.define ("string", vm::psequence (vm::pchar ('"'), run, vm::pmany (vm::psequence (escaped, run)), vm::pchar ('"')));
+    g.define ("number", vm::psequence (
+        vm::popt (vm::pchar ('-'))
+      , digits
+      , vm::popt (vm::psequence (vm::pchar ('.'), digits))
+      , vm::popt (vm::psequence (vm::pany_of ("eE"), vm::popt (vm::pany_of ("+-")), digits))
+      ));
+    g.define ("value", vm::psequence (
+        vm::pchoice (
+            vm::pref ("string")
+          , vm::pref ("number")
+          , vm::pskip_string ("true")
+          , vm::pskip_string ("false")
+          , vm::pskip_string ("null")
+          , vm::pref ("array")
+          , vm::pref ("object")
+          )
+      , ws
+      ));
+    g.define ("array", vm::psequence (vm::pchar ('['), ws, vm::pmany_sepby (vm::pref ("value"), vm::psequence (vm::pchar (','), ws)), vm::pchar (']')));
+    g.define ("member", vm::psequence (vm::pref ("string"), ws, vm::pchar (':'), ws, vm::pref ("value")));
+    g.define ("object", vm::psequence (vm::pchar ('{'), ws, vm::pmany_sepby (vm::pref ("member"), vm::psequence (vm::pchar (','), ws)), vm::pchar ('}')));
+    g.define ("json", vm::psequence (ws, vm::pchoice (vm::pref ("array"), vm::pref ("object")), ws, vm::peos ()));
+
+    auto program = g.compile ("json");
+    CPP_PC__ASSERT (program);
+
+    return program.get ();
+  }
 
-    virtual void build_string (std::ostream & o) const = 0;
-    virtual bool is_equal_to (json_ast::ptr const & o) const = 0;
+  enum json_token_kind
+  {
+    json_token_string = 0x100 ,
+    json_token_number         ,
+    json_token_true           ,
+    json_token_false          ,
+    json_token_null           ,
   };
 
-  std::string to_string (json_ast::ptr const & json)
+  // Punctuation tokens use the character as kind
+  auto const pjson_lexer = [] ()
   {
-    std::stringstream ss;
-
-    if (json)
-    {
-      json->build_string (ss);
-    }
-    else
-    {
-      ss << "[]";
-    }
+    auto ppunctuation = [] (char ch)
+      {
+        return plexeme (ch, pskip_char (ch));
+      };
 
-    return ss.str ();
-  }
+    auto plexemes = pchoice (
+        plexeme (json_token_string, pjson_chars)
+      , plexeme (json_token_number, pjson_number)
+      , plexeme (json_token_true  , pskip_string ("true"))
+      , plexeme (json_token_false , pskip_string ("false"))
+      , plexeme (json_token_null  , pskip_string ("null"))
+      , ppunctuation ('[')
+      , ppunctuation (']')
+      , ppunctuation ('{')
+      , ppunctuation ('}')
+      , ppunctuation (',')
+      , ppunctuation (':')
+      );
+
+    return plexer (pskip_ws, plexemes);
+  } ();
 
-  struct json_null : json_ast
+  // The JSON grammar over the tokens produced by pjson_lexer
+  auto const pjson_tokens = [] ()
   {
-    json_null () = default;
+    auto parray_trampoline  = create_trampoline<json_ast::ptr, token_state> ();
+    auto parray             = ptrampoline<json_ast::ptr, token_state> (parray_trampoline);
 
-    void build_string (std::ostream & o) const override
-    {
-      o << "null";
-    }
+    auto pobject_trampoline = create_trampoline<json_ast::ptr, token_state> ();
+    auto pobject            = ptrampoline<json_ast::ptr, token_state> (pobject_trampoline);
 
-    bool is_equal_to (json_ast::ptr const & o) const override
-    {
-      auto other = std::dynamic_pointer_cast<json_null> (o);
+    auto pchars   = plexeme (json_token_string, "string", pjson_chars);
+    auto pstring  = pmap (pchars, json_string::create);
 
-      return !!other;
-    }
+    auto pnumber  = plexeme (json_token_number, "number", pjson_number);
 
-    static json_ast::ptr create ()
-    {
-      return std::make_shared<json_null> ();
-    }
-  };
+    auto ptrue    = ptoken (json_token_true , "true")   < preturn (json_true_value);
 
-  struct json_boolean : json_ast
-  {
-    using value_type = bool;
+    auto pfalse   = ptoken (json_token_false, "false")  < preturn (json_false_value);
 
-    json_boolean (value_type v)
-      : value (v)
-    {
-    }
+    auto pnull    = ptoken (json_token_null , "null")   < preturn (json_null_value);
 
-    value_type const value;
+    auto pvalue   = pchoice (pstring, pnumber, ptrue, pfalse, pnull, parray, pobject);
 
-    void build_string (std::ostream & o) const override
-    {
-      o << (value ? "true" : "false");
-    }
+    auto pvalues  = pmany_sepby (pvalue, pskip_char (','));
+    auto parray_  = pmap (pbetween (pskip_char ('['), pvalues, pskip_char (']')), json_array::create);
 
-    bool is_equal_to (json_ast::ptr const & o) const override
-    {
-      auto other = std::dynamic_pointer_cast<json_boolean> (o);
-      if (!other)
-      {
-        return false;
-      }
+    auto pmember  = ptuple (pchars > pskip_char (':'), pvalue);
+    auto pmembers = pmany_sepby (pmember, pskip_char (','));
+    auto pobject_ = pmap (pbetween (pskip_char ('{'), pmembers, pskip_char ('}')), json_object::create);
 
-      return value == other->value;
-    }
+    parray_trampoline->trampoline   = parray_.parser_function;
+    pobject_trampoline->trampoline  = pobject_.parser_function;
 
-    static json_ast::ptr create (value_type v)
-    {
-      return std::make_shared<json_boolean> (v);
-    }
+    return pchoice (parray, pobject) > peos;
+  } ();
+
+  // The JSON grammar with values memoized, for incremental_document
+  auto const pjson_incremental = std::get<1> (make_json_grammar<memo_state> ([] (auto && p) { return pmemo (p); }));
+
+  // The JSON grammar over segmented input
+  auto const pjson_segmented = std::get<1> (make_json_grammar<segmented_state> ([] (auto && p) { return p; }));
+
+  struct array_elements
+  {
+    std::vector<std::size_t>  begins  ;
+    std::vector<std::size_t>  ends    ;
   };
 
-  struct json_number : json_ast
+  // Finds the top-level elements of a JSON array by tracking brackets and
+  //  strings only, the elements themselves are validated by pjson_value
+  //  Returns false if input doesn't look like a non-empty array
+  bool scan_array_elements (std::string const & input, array_elements & elements)
   {
-    using value_type = double;
+    auto sz   = input.size ();
+    auto pos  = std::size_t ();
+
+    auto skip_ws = [&] ()
+      {
+        while (pos < sz && satisfy_whitespace (0, input[pos]))
+        {
+          ++pos;
+        }
+      };
 
-    json_number (value_type v)
-      : value (v)
+    skip_ws ();
+    if (pos >= sz || input[pos] != '[')
     {
+      return false;
     }
 
-    value_type const value;
-
-    void build_string (std::ostream & o) const override
+    ++pos;
+    skip_ws ();
+    if (pos >= sz || input[pos] == ']')
     {
-      o << value;
+      return false;
     }
 
-    bool is_equal_to (json_ast::ptr const & o) const override
-    {
-      auto other = std::dynamic_pointer_cast<json_number> (o);
-      if (!other)
-      {
-        return false;
-      }
-
-      return value == other->value;
-    }
-
-    static json_ast::ptr create (value_type v)
-    {
-      return std::make_shared<json_number> (v);
-    }
-  };
+    elements.begins.push_back (pos);
 
-  struct json_string : json_ast
-  {
-    using value_type = std::string;
-
-    json_string (value_type v)
-      : value (std::move (v))
-    {
-    }
-
-    value_type const value;
-
-    void build_string (std::ostream & o) const override
-    {
-      // TODO: Add escaping
-      o << '"' << value << '"';
-    }
+    // The closers expected for the open brackets, a mismatched closer
+    //  leaves it to the sequential parse to report the error
+    std::string closers;
 
-    bool is_equal_to (json_ast::ptr const & o) const override
+    for (; pos < sz; ++pos)
     {
-      auto other = std::dynamic_pointer_cast<json_string> (o);
-      if (!other)
+      switch (input[pos])
       {
-        return false;
-      }
-
-      return value == other->value;
-    }
-
-    static json_ast::ptr create (value_type v)
-    {
-      return std::make_shared<json_string> (std::move (v));
-    }
-  };
+      case '"':
+        for (++pos; pos < sz && input[pos] != '"'; ++pos)
+        {
+          if (input[pos] == '\\')
+          {
+            ++pos;
+          }
+        }
 
-  struct json_array : json_ast
-  {
-    using value_type = std::vector<json_ast::ptr>;
+        if (pos >= sz)
+        {
+          return false;
+        }
+        break;
+      case '[':
+        closers.push_back (']');
+        break;
+      case '{':
+        closers.push_back ('}');
+        break;
+      case ']':
+      case '}':
+        if (closers.empty ())
+        {
+          if (input[pos] != ']')
+          {
+            return false;
+          }
 
-    json_array (value_type v)
-      : value (std::move (v))
-    {
-    }
+          elements.ends.push_back (pos);
 
-    value_type const value;
+          ++pos;
+          skip_ws ();
 
-    void build_string (std::ostream & o) const override
-    {
-      auto prepend = "";
-      o << '[';
+          return pos == sz;
+        }
 
-      for (auto && v : value)
-      {
-        o << prepend;
-        if (v)
+        if (closers.back () != input[pos])
         {
-          v->build_string (o);
+          return false;
         }
-        else
+        closers.pop_back ();
+        break;
+      case ',':
+        if (closers.empty ())
         {
-          o << "null";
-        }
-        prepend = ", ";
-      }
-
-      o << ']';
-    }
+          elements.ends.push_back (pos);
 
-    bool is_equal_to (json_ast::ptr const & o) const override
-    {
-      auto other = std::dynamic_pointer_cast<json_array> (o);
-      if (!other)
-      {
-        return false;
+          ++pos;
+          skip_ws ();
+          elements.begins.push_back (pos);
+          --pos;
+        }
+        break;
+      default:
+        break;
       }
-
-      return
-        std::equal (
-            value.begin ()
-          , value.end ()
-          , other->value.begin ()
-          , other->value.end ()
-          , [] (auto && l, auto && r) -> bool
-          {
-            if (!l || !r)
-            {
-              return !l && !r;
-            }
-
-            return l->is_equal_to (r);
-          });
     }
 
-    static json_ast::ptr create (value_type v)
-    {
-      return std::make_shared<json_array> (std::move (v));
-    }
-  };
+    return false;
+  }
 
-  struct json_object : json_ast
+  // Parses a top-level JSON array by splitting it into elements that are
+  //  parsed by pjson_value on the pool. If anything looks wrong the
+  //  sequential pjson is used in order to produce identical errors
+  parse_result<json_ast::ptr> parse_parallel (work_stealing_pool & pool, std::string const & input)
   {
-    using value_type = std::vector<std::tuple<std::string, json_ast::ptr>>;
-
-    json_object (value_type v)
-      : value (std::move (v))
+    array_elements elements;
+    if (pool.size () < 2 || !scan_array_elements (input, elements))
     {
+      return parse (pjson, input);
     }
 
-    value_type const value;
-
-    void build_string (std::ostream & o) const override
-    {
-      auto prepend = "";
-      o << '{';
-
-      for (auto && kv : value)
-      {
-        auto & k = std::get<0> (kv);
-        auto & v = std::get<1> (kv);
-
-        o << prepend;
-
-        // TODO: Add escaping
-        o << '"' << k << '"' << ':';
-
-        if (v)
-        {
-          v->build_string (o);
-        }
-        else
-        {
-          o << "null";
-        }
+    CPP_PC__ASSERT (elements.begins.size () == elements.ends.size ());
 
-        prepend = ", ";
-      }
+    auto begin  = input.c_str ();
+    auto end    = begin + input.size ();
+    auto count  = elements.begins.size ();
+    auto tasks  = std::min (pool.size (), count);
 
-      o << '}';
-    }
+    json_array::value_type values (count);
+    std::vector<char> failed (tasks, 0);
 
-    bool is_equal_to (json_ast::ptr const & o) const override
-    {
-      auto other = std::dynamic_pointer_cast<json_object> (o);
-      if (!other)
+    pool.run (tasks, [&] (std::size_t, std::size_t task)
       {
-        return false;
-      }
-
-      return
-        std::equal (
-            value.begin ()
-          , value.end ()
-          , other->value.begin ()
-          , other->value.end ()
-          , [] (auto && l, auto && r) -> bool
+        state s (SIZE_MAX, begin, end);
+        for (auto iter = count*task / tasks; iter < count*(task + 1) / tasks; ++iter)
+        {
+          auto v = pjson_value.parser_function (s, elements.begins[iter]);
+          if (!v.value || v.position != elements.ends[iter])
           {
-            auto lk = std::get<0> (l);
-            auto rk = std::get<0> (r);
-            auto lv = std::get<1> (l);
-            auto rv = std::get<1> (r);
-
-            if (lk != rk)
-            {
-              return false;
-            }
-
-            if (!lv || !rv)
-            {
-              return !lv && !rv;
-            }
+            failed[task] = 1;
+            return;
+          }
 
-            return lv->is_equal_to (rv);
-          });
-    }
+          values[iter] = std::move (v.value.get ());
+        }
+      });
 
-    static json_ast::ptr create (value_type v)
+    if (std::find (failed.begin (), failed.end (), 1) != failed.end ())
     {
-      return std::make_shared<json_object> (std::move (v));
+      return parse (pjson, input);
     }
-  };
 
-  constexpr auto satisfy_char (std::size_t, char ch)
-  {
-    return ch != '"' && ch != '\\';
-  }
-
-  inline auto map_escaped (char ch)
-  {
-    switch (ch)
-    {
-    case '"':
-      return '"';
-    case '\\':
-      return '\\';
-    case '/':
-      return '/';
-    case 'b':
-      return '\b';
-    case 'f':
-      return '\f';
-    case 'n':
-      return '\n';
-    case 'r':
-      return '\r';
-    case 't':
-      return '\t';
-    default:
-      CPP_PC__ASSERT (false);
-      return ch;
-    };
+    return parse_result<json_ast::ptr> (input.size (), make_opt (json_array::create (std::move (values))), std::string ());
   }
 
-  auto const map_number = [] (auto && v)
-    {
-      auto calculate_fraction = [] (auto && frac)
-        {
-          auto i = static_cast<double> (std::get<0> (frac));
-          auto s = std::get<1> (frac);
-          return i / std::pow (10.0, s);
-        };
-
-      auto calculate_exponent = [] (auto && exp)
-        {
-          auto sign   = (std::get<0> (exp).coalesce ('+') == '+') ? 1.0 : -1.0;
-          auto e      = std::get<1> (exp);
-          return std::pow (10.0, sign*e);
-        };
-
-      auto sign = std::get<0> (v) ? -1.0 : 1.0;
-      auto i    = static_cast<double> (std::get<1> (v));
-      auto ofrac= std::get<2> (v);
-      auto frac =
-          ofrac
-        ? calculate_fraction (ofrac.get ())
-        : 0.0
-        ;
-      auto oexp = std::get<3> (v);
-      auto exp =
-          oexp
-        ? calculate_exponent (oexp.get ())
-        : 1.0
-        ;
-
-      auto result = sign * (i + frac) * exp;
-
-      return json_number::create (result);
-    };
-
-  auto const json_null_value  = json_null::create ();
-  auto const json_true_value  = json_boolean::create (true);
-  auto const json_false_value = json_boolean::create (false);
-
-  auto const pjson = [] ()
-  {
-    // JSON specification: http://json.org/
-    auto parray_trampoline  = create_trampoline<json_ast::ptr> ();
-    auto parray             = ptrampoline<json_ast::ptr> (parray_trampoline);
-
-    auto pobject_trampoline = create_trampoline<json_ast::ptr> ();
-    auto pobject            = ptrampoline<json_ast::ptr> (pobject_trampoline);
-
-    auto pnchar   = psatisfy_char ("char", satisfy_char);
-    auto pescaped = pskip_char ('\\') < pmap (pany_of ("\"\\/bfnrt"), map_escaped);
-    // TODO: Handle unicode escaping (\u)
-    auto pchar    = pchoice (pnchar, pescaped);
-    auto pchars   = pbetween (pskip_char ('"'), pmany_char (pchar), pskip_char ('"'));
-    auto pstring  = pmap (pchars, json_string::create);
-
-    auto pfrac    = popt (pskip_char ('.') < praw_uint64);
-    auto psign    = popt (pany_of ("+-"));
-    auto pexp     = popt (pany_of ("eE") < ptuple (psign, pint));
-    // TODO: Handle that 0123 is not allowed
-    auto pnumber  = pmap (ptuple (popt (pskip_char ('-')), puint64, pfrac, pexp), map_number);
-
-    auto ptrue    = pskip_string ("true")   < preturn (json_true_value);
-
-    auto pfalse   = pskip_string ("false")  < preturn (json_false_value);
-
-    auto pnull    = pskip_string ("null")   < preturn (json_null_value);
-
-    auto pvalue   = pchoice (pstring, pnumber, ptrue, pfalse, pnull, parray, pobject) > pskip_ws;
-
-    auto pvalues  = pmany_sepby (pvalue, pskip_char (',') > pskip_ws);
-    auto parray_  = pmap (pbetween (pskip_char ('[') > pskip_ws, pvalues, pskip_char (']') > pskip_ws), json_array::create);
-
-    auto pmember  = ptuple (pchars > pskip_ws > pskip_char (':') > pskip_ws, pvalue);
-    auto pmembers = pmany_sepby (pmember, pskip_char (',') > pskip_ws);
-    auto pobject_ = pmap (pbetween (pskip_char ('{') > pskip_ws, pmembers, pskip_char ('}') > pskip_ws), json_object::create);
-
-    parray_trampoline->trampoline   = parray_.parser_function;
-    pobject_trampoline->trampoline  = pobject_.parser_function;
-    return pskip_ws < pchoice (parray, pobject) > pskip_ws > peos;
-  } ();
-
   void parse_and_print (const std::string & input)
   {
     auto r = parse (pjson, input);
@@ -1352,70 +1659,2390 @@ namespace json
     }
   }
 
-  void test_json ()
+  void test_parallel_json (std::mt19937 & random)
   {
-    std::mt19937 random (19740531);
+    work_stealing_pool pool (4);
 
-    auto random_testcases = 1000;
+    auto compare = [&pool] (std::string const & input)
+      {
+        auto expected = parse (pjson, input);
+        auto actual   = parse_parallel (pool, input);
+
+        auto same =
+              expected.consumed == actual.consumed
+          &&  expected.message  == actual.message
+          &&  !expected.value   == !actual.value
+          &&  (!expected.value || expected.value.get ()->is_equal_to (actual.value.get ()))
+          ;
 
-    std::cout << "Running " << random_testcases << " JSON testcases..." << std::endl;
+        if (!same)
+        {
+          std::cout
+            << "ERROR: Parallel parse differs from sequential parse of '" << input << "'" << std::endl
+            << "Sequential: " << (expected.value ? to_string (expected.value.get ()) : expected.message) << std::endl
+            << "Parallel  : " << (actual.value ? to_string (actual.value.get ()) : actual.message) << std::endl
+            ;
+        }
+      };
+
+    auto random_testcases = 100;
+
+    std::cout << "Running " << random_testcases << " parallel JSON testcases..." << std::endl;
 
     for (auto iter = 0; iter < random_testcases; ++iter)
     {
-      auto gen    = generate_ast (random, 0);
-      auto sgen   = to_string (gen);
+      json_array::value_type values;
+      auto sz = next (random, 0, 20);
+      for (auto i = 0; i < sz; ++i)
+      {
+        values.push_back (generate_ast (random, 1));
+      }
 
-//      std::cout << "-- " << std::endl << sgen << std::endl;
+      compare (to_string (json_array::create (std::move (values))));
+    }
 
-      auto r = parse (pjson, sgen);
-      if (r.value)
-      {
-        auto parsed   = r.value.get ();
-        auto sparsed  = to_string (parsed);
+    compare (" [ ] ");
+    compare (" { } ");
+    compare ("[1, \"a,]\\\"b\", [2, {\"c\":[3]}], 4] ");
+    compare ("[1, 2, ]");
+    compare ("[1 2]");
+    compare ("[1, [2, 3], x]");
+    compare ("[1, \"2]");
+    compare ("[1, 2] 3");
+    compare ("[1, 2");
+    compare ("[1}");
+    compare ("[1, 2} ");
+    compare ("[[1}, 2]");
+    compare ("[{\"a\" : 1], 2]");
 
-        if (!gen->is_equal_to (parsed))
-        {
-          std::cout
+    std::cout << "Done!" << std::endl;
+  }
 
-            << "ERROR: Parsed JSON not parsed correctly" << std::endl
-            << "Original: " << sgen << std::endl
-            << "Parsed  : " << sparsed << std::endl
-            ;
-        }
+  using test_parser::test_eq;
+
+  std::string generate_lines (std::mt19937 & random, std::size_t count, bool with_errors)
+  {
+    std::string buffer;
+
+    for (auto iter = 0U; iter < count; ++iter)
+    {
+      auto line = to_string (generate_ast (random, 0));
+      if (with_errors && next (random, 0, 9) == 0)
+      {
+        line.insert (static_cast<std::size_t> (next (random, 0, static_cast<int> (line.size ()))), 1, '!');
       }
-      else
+
+      buffer += line;
+      buffer += '\n';
+    }
+
+    return buffer;
+  }
+
+  void test_parse_lines (std::mt19937 & random)
+  {
+    auto random_testcases = 1000U;
+
+    std::cout << "Running " << random_testcases << " parse_lines testcases..." << std::endl;
+
+    auto buffer   = generate_lines (random, random_testcases, true);
+    auto results  = parse_lines (pjson, buffer, 4);
+
+    TEST_EQ (random_testcases, results.size ());
+
+    std::stringstream lines (buffer);
+    std::string line;
+    for (auto iter = 0U; iter < results.size () && std::getline (lines, line); ++iter)
+    {
+      auto expected = parse (pjson, line);
+      auto & actual = results[iter];
+
+      auto same =
+            expected.consumed == actual.consumed
+        &&  expected.message  == actual.message
+        &&  !expected.value   == !actual.value
+        &&  (!expected.value || expected.value.get ()->is_equal_to (actual.value.get ()))
+        ;
+
+      if (!same)
       {
         std::cout
-          << "ERROR: Failed to parse '" << sgen  << "' with message: " << std::endl
-          << r.message << std::endl
+          << "ERROR: parse_lines differs from parse of line " << iter << ": '" << line << "'" << std::endl
           ;
       }
     }
 
+    TEST_EQ (0U, parse_lines (pjson, "", 4).size ());
+    TEST_EQ (2U, parse_lines (pjson, "[]\n{}", 4).size ());
+
     std::cout << "Done!" << std::endl;
+  }
 
-    /*
-    parse_and_print ("[1.0g32]");
-    parse_and_print ("[2,1.0g32]");
-    parse_and_print ("2");
-    parse_and_print ("[2.171828]");
-    parse_and_print ("[]");
-    parse_and_print ("[null]");
-    parse_and_print ("{}");
-    parse_and_print ("{,}");
-    parse_and_print (R"({"x":3, "y":null})");
-    */
-  };
-}
-// ----------------------------------------------------------------------------
+  std::vector<std::string> generate_messages (std::mt19937 & random, std::size_t count, bool with_errors)
+  {
+    std::vector<std::string> messages;
+    messages.reserve (count);
+
+    std::stringstream lines (generate_lines (random, count, with_errors));
+    std::string line;
+    while (std::getline (lines, line))
+    {
+      messages.push_back (line);
+    }
+
+    return messages;
+  }
+
+  void test_parse_batch (std::mt19937 & random)
+  {
+    auto random_testcases = 1000U;
+    auto thread_count     = 8U;
+    auto repeat           = 4U;
+
+    std::cout << "Running " << random_testcases << " parse_batch testcases on " << thread_count << " threads..." << std::endl;
+
+    auto inputs = generate_messages (random, random_testcases, true);
+
+    std::vector<std::string> expected;
+    expected.reserve (inputs.size ());
+    for (auto && input : inputs)
+    {
+      auto r = parse (pjson, input);
+      expected.push_back (r.value ? to_string (r.value.get ()) : r.message);
+    }
+
+    auto check = [&] (std::size_t iter, parse_result<json_ast::ptr> const & r)
+      {
+        auto actual = r.value ? to_string (r.value.get ()) : r.message;
+        return actual == expected[iter];
+      };
+
+    {
+      auto results = parse_batch (pjson, inputs, 4);
+      TEST_EQ (inputs.size (), results.size ());
+
+      for (auto iter = 0U; iter < results.size (); ++iter)
+      {
+        if (!check (iter, results[iter]))
+        {
+          std::cout << "ERROR: parse_batch differs from parse of '" << inputs[iter] << "'" << std::endl;
+        }
+      }
+    }
+
+    // Stress: one grammar shared by many threads, each using its own session
+    std::vector<std::size_t> failures (thread_count, 0);
+    std::vector<std::thread> threads;
+    for (auto thread = 0U; thread < thread_count; ++thread)
+    {
+      threads.emplace_back ([&, thread] ()
+        {
+          auto & session = this_thread_session ();
+          for (auto r = 0U; r < repeat; ++r)
+          {
+            for (auto iter = 0U; iter < inputs.size (); ++iter)
+            {
+              auto i = (iter + thread*r) % inputs.size ();
+              if (!check (i, session.parse (pjson, inputs[i])))
+              {
+                ++failures[thread];
+              }
+            }
+          }
+        });
+    }
+
+    for (auto && thread : threads)
+    {
+      thread.join ();
+    }
+
+    for (auto && failure : failures)
+    {
+      TEST_EQ (0U, failure);
+    }
+
+    {
+      // The first exception of a task is rethrown by run, the pool stays
+      //  usable afterwards
+      work_stealing_pool pool (4);
+
+      auto caught = false;
+      try
+      {
+        pool.run (100, [] (std::size_t, std::size_t task)
+          {
+            if (task % 10 == 3)
+            {
+              throw std::runtime_error ("task " + std::to_string (task));
+            }
+          });
+      }
+      catch (std::runtime_error const &)
+      {
+        caught = true;
+      }
+      TEST_EQ (true, caught);
+
+      std::atomic<std::size_t> count (0);
+      pool.run (100, [&count] (std::size_t, std::size_t) { ++count; });
+      TEST_EQ (100U, count.load ());
+    }
+
+    std::cout << "Done!" << std::endl;
+  }
+
+  void test_tokenized_json ()
+  {
+    std::cout << "Running tokenized JSON testcases..." << std::endl;
+
+    {
+      auto r = parse (pjson_lexer, " [1, \"a\" ,{\"b\" : true}] ");
+      if (TEST_EQ (true, !!r.value))
+      {
+        auto & ts = r.value.get ();
+        TEST_EQ (11U, ts.size ());
+        TEST_EQ (static_cast<int> ('['), ts.front ().kind);
+        TEST_EQ (static_cast<int> (json_token_number), ts[1].kind);
+        TEST_EQ (2U, ts[1].begin);
+        TEST_EQ (3U, ts[1].end);
+        TEST_EQ (static_cast<int> (json_token_true), ts[8].kind);
+      }
+    }
+
+    {
+      // Lexer error
+      auto r = parse_tokenized (pjson_lexer, pjson_tokens, "[1, !]");
+      TEST_EQ (false, !!r.value);
+      TEST_EQ (4U, r.consumed);
+    }
+
+    {
+      // Grammar error, reported at the source offset of the token
+      auto r = parse_tokenized (pjson_lexer, pjson_tokens, "[1,  2 3]");
+      TEST_EQ (false, !!r.value);
+      TEST_EQ (7U, r.consumed);
+      TEST_EQ (true, r.message.find ("Expected ',' or ']'") != std::string::npos);
+    }
+
+    {
+      // A token whose lexeme the value parser rejects fails at the token
+      std::string source = "x";
+      auto begin  = source.c_str ();
+      auto end    = begin + source.size ();
+      TEST_EQ (false, !!parse_lexeme (pjson_number, sub_string (begin, end)));
+
+      auto ts = tokens { token { json_token_number, 0, 1 } };
+      auto r  = parse_tokens (plexeme (json_token_number, "number", pjson_number) > peos, ts, begin, end);
+      TEST_EQ (false, !!r.value);
+      TEST_EQ (0U, r.consumed);
+      TEST_EQ (true, r.message.find ("Expected number") != std::string::npos);
+    }
+
+    std::cout << "Done!" << std::endl;
+  }
+
+  // A JSON array of count generated documents
+  std::string generate_document (std::mt19937 & random, std::size_t count)
+  {
+    std::string document = "[";
+
+    for (auto iter = 0U; iter < count; ++iter)
+    {
+      if (iter > 0)
+      {
+        document += ", ";
+      }
+      document += to_string (generate_ast (random, 0));
+    }
+
+    document += "]";
+
+    return document;
+  }
+
+  void test_incremental_json (std::mt19937 & random)
+  {
+    auto random_testcases = 500;
+
+    std::cout << "Running " << random_testcases << " incremental JSON testcases..." << std::endl;
+
+    auto document = make_incremental_document (pjson_incremental, generate_document (random, 20));
+
+    auto compare = [&document] ()
+      {
+        auto expected = parse (pjson, document->str ());
+        auto actual   = document->parse ();
+
+        auto same =
+              expected.consumed == actual.consumed
+          &&  expected.message  == actual.message
+          &&  !expected.value   == !actual.value
+          &&  (!expected.value || expected.value.get ()->is_equal_to (actual.value.get ()))
+          ;
+
+        if (!same)
+        {
+          std::cout
+            << "ERROR: incremental parse differs from parse: '" << document->str () << "'" << std::endl
+            ;
+        }
+
+        return !!actual.value;
+      };
+
+    compare ();
+
+    char const chars[] = " 0123456789abc,:[]{}\"";
+
+    for (auto iter = 0; iter < random_testcases; ++iter)
+    {
+      auto & text     = document->str ();
+      auto position   = static_cast<std::size_t> (next (random, 0, static_cast<int> (text.size ())));
+      auto ch         = std::string (1, chars[next (random, 0, sizeof (chars) - 2)]);
+      auto erase      = position < text.size () ? static_cast<std::size_t> (next (random, 0, 1)) : 0U;
+      auto inserted   = next (random, 0, 2) > 0 || erase == 0 ? ch : std::string ();
+      auto original   = text.substr (position, erase);
+
+      document->edit (position, erase, inserted);
+
+      if (!compare ())
+      {
+        // Undoes edits that break the document so that most edits are
+        //  applied to valid JSON
+        document->edit (position, inserted.size (), original);
+        compare ();
+      }
+    }
+
+    std::cout << "Done!" << std::endl;
+  }
+
+  void test_push_json (std::mt19937 & random)
+  {
+    auto random_testcases = 200U;
+
+    std::cout << "Running " << random_testcases << " push JSON testcases..." << std::endl;
+
+    auto messages = generate_messages (random, random_testcases, true);
+
+    for (auto && message : messages)
+    {
+      auto expected = parse (pjson, message);
+      auto pp       = make_push_parser (pjson_incremental);
+
+      auto status   = push_status::need_more;
+      auto fed      = std::size_t ();
+      while (status == push_status::need_more && fed < message.size ())
+      {
+        auto chunk  = std::min (static_cast<std::size_t> (next (random, 1, 16)), message.size () - fed);
+        auto begin  = message.c_str () + fed;
+
+        status  = pp->feed (begin, begin + chunk);
+        fed     += chunk;
+      }
+
+      // A failure is reported as soon as no continuation can make the
+      //  input valid, possibly before all input is fed
+      if (status == push_status::need_more)
+      {
+        status = pp->finish ();
+      }
+
+      auto & actual = pp->result ();
+
+      auto same =
+            status == (expected.value ? push_status::done : push_status::failed)
+        &&  expected.consumed == actual.consumed
+        &&  (!expected.value || expected.value.get ()->is_equal_to (actual.value.get ()))
+        ;
+
+      if (!same)
+      {
+        std::cout
+          << "ERROR: push parse differs from parse: '" << message << "'" << std::endl
+          ;
+      }
+    }
+
+    {
+      auto pp = make_push_parser (pjson_incremental);
+      TEST_EQ (true, push_status::need_more == pp->feed ("[1, "));
+      TEST_EQ (true, push_status::failed == pp->feed ("!, 2"));
+      TEST_EQ (4U, pp->result ().consumed);
+    }
+
+    std::cout << "Done!" << std::endl;
+  }
+
+  // Splits input into segments of random sizes in [1, max_size]
+  segments split_segments (std::mt19937 & random, std::string const & input, int max_size)
+  {
+    segments ss;
+
+    auto begin  = input.c_str ();
+    auto end    = begin + input.size ();
+    while (begin < end)
+    {
+      auto sz = std::min (static_cast<std::size_t> (next (random, 1, max_size)), static_cast<std::size_t> (end - begin));
+      ss.push_back (segment { begin, begin + sz });
+      begin += sz;
+    }
+
+    return ss;
+  }
+
+  void test_json_sax (std::mt19937 & random)
+  {
+    auto random_testcases = 1000U;
+
+    std::cout << "Running " << random_testcases << " SAX JSON testcases..." << std::endl;
+
+    auto messages = generate_messages (random, random_testcases, true);
+
+    for (auto && message : messages)
+    {
+      auto expected = parse (pjson, message);
+
+      json_sax_builder builder;
+      auto actual   = parse_json_sax (builder, message);
+
+      auto same =
+            expected.consumed == actual.consumed
+        &&  expected.message  == actual.message
+        &&  !expected.value   == !actual.value
+        &&  (!expected.value || expected.value.get ()->is_equal_to (builder.result))
+        ;
+
+      if (!same)
+      {
+        std::cout
+          << "ERROR: SAX parse differs from parse: '" << message << "'" << std::endl
+          ;
+      }
+    }
+
+    {
+      auto document = generate_document (random, 100);
+
+      json_sax_counter counter;
+      auto r = parse_json_sax (counter, document);
+
+      TEST_EQ (true, !!r.value);
+      TEST_EQ (true, counter.events > 0);
+    }
+
+    {
+      json_sax_builder builder;
+      auto r = parse_json_sax (builder, R"({"a\tb" : ["x\"y", 1.5, true, null]})");
+      if (TEST_EQ (true, !!r.value))
+      {
+        TEST_EQ (std::string ("{\"a\tb\":[\"x\"y\", 1.5, true, null]}"), to_string (builder.result));
+      }
+    }
+  }
+
+  void test_json_tape ()
+  {
+    json_tape tape;
+
+    auto r = parse_json_tape (tape, R"({"a" : [1, 2, {"b" : true}], "c" : null, "d" : "x"})");
+    if (!TEST_EQ (true, !!r.value))
+    {
+      return;
+    }
+
+    auto object = root (tape).as_object ();
+    std::string keys;
+    for (auto && m : object)
+    {
+      keys += m.key.as_string ().str ();
+    }
+    TEST_EQ (std::string ("acd"), keys);
+
+    auto members = object.begin ();
+    auto a = (*members).value.as_array ();
+    auto sum = 0.0;
+    auto count = 0;
+    for (auto && v : a)
+    {
+      if (v.is_number ())
+      {
+        sum += v.as_number ();
+      }
+      ++count;
+    }
+    TEST_EQ (3.0, sum);
+    TEST_EQ (3, count);
+
+    ++members;
+    TEST_EQ (true, (*members).value.is_null ());
+    ++members;
+    TEST_EQ (std::string ("x"), (*members).value.as_string ().str ());
+    ++members;
+    TEST_EQ (true, members == object.end ());
+
+    // The tape is reused
+    r = parse_json_tape (tape, "[]");
+    if (TEST_EQ (true, !!r.value))
+    {
+      TEST_EQ (2U, tape.entries.size ());
+      TEST_EQ (true, root (tape).as_array ().empty ());
+    }
+  }
+
+  void test_json_node ()
+  {
+    json_node node;
+    auto r = parse_json_node (node, R"({"a" : [1, "x", true, null], "b" : {}})");
+    if (!TEST_EQ (true, !!r.value))
+    {
+      return;
+    }
+
+    auto expected = json_node (json_node::object_type
+      {
+        json_member { "a", json_node (json_node::array_type { json_node (1.0), json_node ("x"), json_node (true), json_node () }) },
+        json_member { "b", json_node (json_node::object_type ()) },
+      });
+
+    TEST_EQ (true, expected == node);
+    TEST_EQ (false, json_node (json_node::array_type ()) == node);
+    TEST_EQ (false, json_node (1.0) == json_node (2.0));
+    TEST_EQ (false, json_node () == json_node (false));
+
+    auto copy = node;
+    TEST_EQ (true, copy == node);
+
+    auto moved = std::move (copy);
+    TEST_EQ (true, moved == node);
+    TEST_EQ (true, copy.type () == json_node::kind::null);
+
+    struct kind_name
+    {
+      char operator () (std::nullptr_t) const                  { return 'z'; }
+      char operator () (bool) const                            { return 'b'; }
+      char operator () (double) const                          { return 'n'; }
+      char operator () (std::string const &) const             { return 's'; }
+      char operator () (json_node::array_type const &) const   { return 'a'; }
+      char operator () (json_node::object_type const &) const  { return 'o'; }
+    };
+
+    auto kinds = std::string ();
+    for (auto && v : node.as_object ().front ().value.as_array ())
+    {
+      kinds += v.visit (kind_name ());
+    }
+    TEST_EQ (std::string ("nsbz"), kinds);
+  }
+
+  void test_json_writer (std::mt19937 & random)
+  {
+    auto format = [] (double v)
+      {
+        char buffer[32];
+        return std::string (buffer, format_number (v, buffer));
+      };
+
+    TEST_EQ (std::string ("0")                  , format (0.0));
+    TEST_EQ (std::string ("-0")                 , format (-0.0));
+    TEST_EQ (std::string ("-250")               , format (-250.0));
+    TEST_EQ (std::string ("12.25")              , format (12.25));
+    TEST_EQ (std::string ("0.1")                , format (0.1));
+    TEST_EQ (std::string ("0.3333333333333333") , format (1.0 / 3.0));
+    TEST_EQ (std::string ("1e+300")             , format (1e300));
+    TEST_EQ (std::string ("null")               , format (std::numeric_limits<double>::infinity ()));
+
+    auto random_numbers = 10000U;
+    auto failures       = 0U;
+    std::uniform_int_distribution<std::uint64_t> bits;
+    for (auto iter = 0U; iter < random_numbers; ++iter)
+    {
+      auto b = bits (random);
+      double v;
+      std::memcpy (&v, &b, sizeof v);
+      if (std::isfinite (v) && std::strtod (format (v).c_str (), nullptr) != v)
+      {
+        ++failures;
+      }
+    }
+    TEST_EQ (0U, failures);
+
+    auto escaped = to_json (json_node (json_node::array_type { json_node ("a\"b\\c\nd\t/"), json_node (0.5), json_node () }));
+    TEST_EQ (std::string ("[\"a\\\"b\\\\c\\nd\\t/\",0.5,null]"), escaped);
+
+    auto r = parse (pjson, escaped);
+    if (TEST_EQ (true, !!r.value))
+    {
+      TEST_EQ (escaped, to_json (r.value.get ()));
+    }
+
+    auto random_testcases = 200;
+
+    std::cout << "Running " << random_testcases << " JSON writer testcases..." << std::endl;
+
+    for (auto iter = 0; iter < random_testcases; ++iter)
+    {
+      auto gen  = generate_ast (random, 0);
+      auto sgen = to_json (gen);
+
+      auto pr = parse (pjson, sgen);
+      if (!pr.value || !gen->is_equal_to (pr.value.get ()))
+      {
+        std::cout << "ERROR: Failed to read back written JSON '" << sgen << "'" << std::endl;
+      }
+
+      json_tape tape;
+      parse_json_tape (tape, sgen);
+      if (sgen != to_json (tape) || sgen != to_json (to_node (gen)))
+      {
+        std::cout << "ERROR: Written JSON differs for tape or node '" << sgen << "'" << std::endl;
+      }
+
+      // Reformats the indented output of to_string through events
+      json_writer writer;
+      auto sr = parse_json_sax (writer, to_string (gen));
+      if (!sr.value || writer.buffer != sgen)
+      {
+        std::cout << "ERROR: Failed to reformat '" << sgen << "'" << std::endl;
+      }
+    }
+
+    std::cout << "Done!" << std::endl;
+  }
+
+  void test_json_lazy (std::mt19937 & random)
+  {
+    auto document = std::string (R"({ "a" : [1, "x]\"", {"b" : null}] , "c\"d" : true, "e" : -1.5e3, "f" : {"g" : [1,,]} })");
+
+    auto r = parse_json_lazy (document);
+    if (!TEST_EQ (true, !!r.value))
+    {
+      return;
+    }
+
+    auto root = r.value.get ();
+    TEST_EQ ('{', root.tag ());
+
+    auto a = root.find ("a");
+    if (TEST_EQ (true, !!a))
+    {
+      TEST_EQ ('[', a.get ().tag ());
+      TEST_EQ (std::string ("\"x]\\\"\""), a.get ().at (1).get ().text.str ());
+      TEST_EQ (false, !!a.get ().at (3));
+
+      auto b = a.get ().at (2).get ().find ("b");
+      TEST_EQ ('n', b ? b.get ().tag () : 0);
+    }
+
+    auto cd = root.find ("c\"d");
+    TEST_EQ ('t', cd ? cd.get ().tag () : 0);
+
+    auto e = root.find ("e");
+    if (TEST_EQ (true, !!e))
+    {
+      auto er = e.get ().parse ();
+      TEST_EQ (true, er.value && json_number::create (-1500)->is_equal_to (er.value.get ()));
+    }
+
+    TEST_EQ (false, !!root.find ("x"));
+    TEST_EQ (false, !!root.at (0));
+
+    // The malformed member is only found when it's parsed
+    auto f = root.find ("f");
+    TEST_EQ (true, f && !f.get ().parse ().value);
+    TEST_EQ (false, !!parse (pjson, document).value);
+
+    auto keys = std::string ();
+    root.for_each_member ([&keys] (sub_string k, json_lazy) { keys += k.str (); return true; });
+    TEST_EQ (std::string ("ac\\\"def"), keys);
+
+    TEST_EQ (false, !!parse_json_lazy ("[1, [2]").value);
+    TEST_EQ (false, !!parse_json_lazy ("[\"]").value);
+    TEST_EQ (false, !!parse_json_lazy ("1").value);
+    TEST_EQ (false, !!parse_json_lazy ("").value);
+    TEST_EQ (false, !!parse_json_lazy ("[] x").value);
+
+    auto random_testcases = 200;
+
+    std::cout << "Running " << random_testcases << " lazy JSON testcases..." << std::endl;
+
+    for (auto iter = 0; iter < random_testcases; ++iter)
+    {
+      auto gen  = generate_ast (random, 0);
+      auto sgen = to_string (gen);
+
+      auto lr = parse_json_lazy (sgen);
+      if (!lr.value)
+      {
+        std::cout << "ERROR: Failed to parse lazy '" << sgen << "' with message: " << std::endl << lr.message << std::endl;
+        continue;
+      }
+
+      auto lazy = lr.value.get ();
+      auto pr   = lazy.parse ();
+      auto ok   = pr.value && gen->is_equal_to (pr.value.get ());
+
+      if (auto a = std::dynamic_pointer_cast<json_array> (gen))
+      {
+        auto index = 0U;
+        ok = lazy.for_each_element ([&] (json_lazy v) { auto vr = v.parse (); return vr.value && a->value[index++]->is_equal_to (vr.value.get ()); }) && ok;
+        ok = ok && index == a->value.size ();
+      }
+      else if (auto o = std::dynamic_pointer_cast<json_object> (gen))
+      {
+        for (auto && m : o->value)
+        {
+          auto v  = lazy.find (std::get<0> (m));
+          ok      = ok && v && v.get ().parse ().value;
+        }
+      }
+
+      if (!ok)
+      {
+        std::cout << "ERROR: Lazy JSON differs '" << sgen << "'" << std::endl;
+      }
+    }
+
+    std::cout << "Done!" << std::endl;
+  }
+
+  void test_select_json (std::mt19937 & random)
+  {
+    TEST_EQ (false, !!compile_json_paths ({ "a/b" }));
+    TEST_EQ (false, !!compile_json_paths ({ "/a~2" }));
+    TEST_EQ (false, !!compile_json_paths ({ "/a~" }));
+
+    auto paths = compile_json_paths ({ "/items/*/price", "/a~1b", "/list/1", "/0", "/items/0", "/m~0n" });
+    if (!TEST_EQ (true, !!paths))
+    {
+      return;
+    }
+
+    auto document = std::string (R"({"items" : [{"price" : 1, "x" : [1, {"price" : 3}]}, {"price" : 2.5}, {"name" : "p"}], "a/b" : true, "0" : null, "list" : [10, 20, 30], "m~n" : "\"", "a\/b" : false})");
+
+    std::string selected;
+    auto callback = [&selected] (std::size_t path, json_ast::ptr const & v)
+      {
+        selected += std::to_string (path) + "=" + to_string (v) + ";";
+      };
+
+    auto expected = std::string (R"(0=1;4={"price":1, "x":[1, {"price":3}]};0=2.5;1=true;3=null;2=20;5=""";1=false;)");
+
+    for (auto unselected : { json_unselected::skip, json_unselected::validate })
+    {
+      selected.clear ();
+      auto r = select_json (paths.get (), callback, document, unselected);
+      TEST_EQ (true, !!r.value);
+      TEST_EQ (expected, selected);
+    }
+
+    auto all = compile_json_paths ({ "" });
+    selected.clear ();
+    select_json (all.get (), callback, "[1, 2]");
+    TEST_EQ (std::string ("0=[1, 2];"), selected);
+
+    // Values that aren't selected are only validated when asked to
+    auto unselected_error = std::string (R"({"a" : [1,,2], "list" : [1, 2]})");
+    TEST_EQ (true , !!select_json (paths.get (), callback, unselected_error).value);
+    TEST_EQ (false, !!select_json (paths.get (), callback, unselected_error, json_unselected::validate).value);
+
+    json_sax_counter counter;
+    for (auto && malformed : { R"({"items" : [{"price" : 1,}]})", R"({"items" : [{"price" : 1}] x)", R"({"a\q" : 1})", "1", "" })
+    {
+      auto expected_result = parse_json_sax (counter, malformed);
+      for (auto unselected : { json_unselected::skip, json_unselected::validate })
+      {
+        auto r = select_json (paths.get (), callback, malformed, unselected);
+        TEST_EQ (false, !!r.value);
+        TEST_EQ (expected_result.consumed, r.consumed);
+        TEST_EQ (expected_result.message, r.message);
+      }
+    }
+
+    auto random_testcases = 200;
+
+    std::cout << "Running " << random_testcases << " select JSON testcases..." << std::endl;
+
+    auto children = compile_json_paths ({ "/*" });
+
+    for (auto iter = 0; iter < random_testcases; ++iter)
+    {
+      auto gen  = generate_ast (random, 0);
+      auto sgen = to_string (gen);
+
+      std::vector<json_ast::ptr> values;
+      auto r = select_json (children.get (), [&values] (std::size_t, json_ast::ptr const & v) { values.push_back (v); }, sgen);
+
+      auto ok = !!r.value;
+      if (auto a = std::dynamic_pointer_cast<json_array> (gen))
+      {
+        ok = ok && values.size () == a->value.size ();
+        for (auto index = 0U; ok && index < values.size (); ++index)
+        {
+          ok = a->value[index]->is_equal_to (values[index]);
+        }
+      }
+      else if (auto o = std::dynamic_pointer_cast<json_object> (gen))
+      {
+        ok = ok && values.size () == o->value.size ();
+        for (auto index = 0U; ok && index < values.size (); ++index)
+        {
+          ok = std::get<1> (o->value[index])->is_equal_to (values[index]);
+        }
+      }
+
+      if (!ok)
+      {
+        std::cout << "ERROR: Selected JSON differs '" << sgen << "'" << std::endl;
+      }
+    }
+
+    std::cout << "Done!" << std::endl;
+  }
+
+  void test_structural_index (std::mt19937 & random)
+  {
+    auto entries = [] (std::string const & input)
+      {
+        structural_index index;
+        build_structural_index (input.c_str (), input.c_str () + input.size (), index);
+        std::string result;
+        for (auto && position : index.positions)
+        {
+          result += std::to_string (position) + ",";
+        }
+        return result;
+      };
+
+    //  0         1         2
+    //  0123456789012345678901234567
+    // {"a\"b" : [12, tru, "x\\"], "c":null}
+    TEST_EQ (std::string ("0,1,3,6,8,10,11,13,15,18,20,22,24,25,26,28,30,31,32,36,"), entries (R"({"a\"b" : [12, tru, "x\\"], "c":null})"));
+    TEST_EQ (std::string (""), entries (""));
+    TEST_EQ (std::string ("0,"), entries ("\" []"));
+
+    auto same_index = [] (std::string const & input)
+      {
+        structural_index expected;
+        structural_index actual;
+        build_structural_index_scalar (input.c_str (), input.c_str () + input.size (), expected);
+        build_structural_index (input.c_str (), input.c_str () + input.size (), actual);
+        return
+              expected.positions  == actual.positions
+          &&  expected.in_string  == actual.in_string
+          &&  expected.size       == actual.size
+          ;
+      };
+
+    // Chunks of 64 and 128 characters so that quotes, escapes and scalars
+    //  cross chunk borders
+    work_stealing_pool pool (4);
+    auto same_chunked = [&pool] (std::string const & input)
+      {
+        structural_index expected;
+        build_structural_index (input.c_str (), input.c_str () + input.size (), expected);
+        for (auto chunk_size : { 64U, 128U })
+        {
+          structural_index actual;
+          build_structural_index (pool, input.c_str (), input.c_str () + input.size (), actual, chunk_size);
+          if (expected.positions != actual.positions || expected.in_string != actual.in_string || expected.size != actual.size)
+          {
+            return false;
+          }
+        }
+        return true;
+      };
+
+    auto random_testcases = 500U;
+
+    std::cout << "Running " << random_testcases << " structural index testcases..." << std::endl;
+
+    // Runs of backslashes and quotes that cross the 64 character blocks
+    auto alphabet = std::string ("\"\\\\\\{}[]:, \t\nab1\x80\xFF");
+    std::uniform_int_distribution<std::size_t> pick (0, alphabet.size () - 1);
+    std::uniform_int_distribution<std::size_t> length (0, 300);
+
+    for (auto iter = 0U; iter < random_testcases; ++iter)
+    {
+      std::string input;
+      for (auto count = length (random); count > 0; --count)
+      {
+        input += alphabet[pick (random)];
+      }
+
+      if (!same_index (input))
+      {
+        std::cout << "ERROR: structural index differs from scalar index: '" << input << "'" << std::endl;
+      }
+
+      if (!same_chunked (input))
+      {
+        std::cout << "ERROR: chunked structural index differs: '" << input << "'" << std::endl;
+      }
+    }
+
+    structural_index index;
+    auto messages = generate_messages (random, random_testcases, true);
+    for (auto && message : messages)
+    {
+      auto expected = parse (pjson, message);
+      auto actual   = parse_json_indexed (index, message);
+
+      auto same =
+            same_index (message)
+        &&  same_chunked (message)
+        &&  expected.consumed == actual.consumed
+        &&  expected.message  == actual.message
+        &&  !expected.value   == !actual.value
+        &&  (!expected.value || expected.value.get ()->is_equal_to (actual.value.get ()))
+        ;
+
+      if (!same)
+      {
+        std::cout << "ERROR: indexed parse differs from parse: '" << message << "'" << std::endl;
+      }
+    }
+
+    for (auto && malformed : { R"(["a\q"])", R"(["ab)", R"([1, "a"  x])", R"(["\\\"  "  ,  ])", R"( [ "a" ]  "b" )" })
+    {
+      auto expected = parse (pjson, malformed);
+      auto actual   = parse_json_indexed (index, malformed);
+      TEST_EQ (expected.consumed, actual.consumed);
+      TEST_EQ (expected.message, actual.message);
+    }
+
+    std::cout << "Done!" << std::endl;
+  }
+
+  void test_vm_json (std::mt19937 & random)
+  {
+    auto random_testcases = 1000U;
+
+    std::cout << "Running " << random_testcases << " PEG virtual machine JSON testcases..." << std::endl;
+
+    auto program  = make_vm_json_grammar ();
+    auto messages = generate_messages (random, random_testcases, true);
+
+    vm::machine m;
+    vm::match_result actual;
+
+    for (auto && message : messages)
+    {
+      auto expected = parse (pjson, message);
+      m.match (program, message.c_str (), message.c_str () + message.size (), actual);
+
+      if (!expected.value != !actual.matched || (actual.matched && expected.consumed != actual.consumed))
+      {
+        std::cout
+          << "ERROR: PEG virtual machine differs from parse: '" << message << "'" << std::endl
+          ;
+      }
+    }
+  }
+
+  void test_segmented_json (std::mt19937 & random)
+  {
+    auto random_testcases = 500U;
+
+    std::cout << "Running " << random_testcases << " segmented JSON testcases..." << std::endl;
+
+    auto messages = generate_messages (random, random_testcases, true);
+
+    for (auto && message : messages)
+    {
+      auto expected = parse (pjson, message);
+      auto actual   = parse_segments (pjson_segmented, split_segments (random, message, 8));
+
+      auto same =
+            expected.consumed == actual.consumed
+        &&  expected.message  == actual.message
+        &&  !expected.value   == !actual.value
+        &&  (!expected.value || expected.value.get ()->is_equal_to (actual.value.get ()))
+        ;
+
+      if (!same)
+      {
+        std::cout
+          << "ERROR: segmented parse differs from parse: '" << message << "'" << std::endl
+          ;
+      }
+    }
+
+    {
+      // A number spanning three segments
+      std::string input = "[12345]";
+      auto ss = segments
+      {
+        segment { input.c_str ()    , input.c_str () + 2 },
+        segment { input.c_str () + 2, input.c_str () + 2 },
+        segment { input.c_str () + 2, input.c_str () + 4 },
+        segment { input.c_str () + 4, input.c_str () + 7 },
+      };
+
+      auto r = parse_segments (pjson_segmented, ss);
+      if (TEST_EQ (true, !!r.value))
+      {
+        TEST_EQ (std::string ("[12345]"), to_string (r.value.get ()));
+      }
+    }
+
+    {
+      // A sub_string spanning segments stays valid after parse_segments
+      //  returns, its buffer moves along with the result
+      std::string input = "hello, world";
+      auto ss = segments
+      {
+        segment { input.c_str ()    , input.c_str () + 3  },
+        segment { input.c_str () + 3, input.c_str () + 8  },
+        segment { input.c_str () + 8, input.c_str () + 12 },
+      };
+
+      auto pword = psatisfy ("letter", 1U, SIZE_MAX, [] (std::size_t, char ch) { return ch != ','; });
+
+      auto moved = [&] ()
+      {
+        auto r = parse_segments (pword, ss);
+        return r;
+      } ();
+
+      TEST_EQ (5U, moved.consumed);
+      if (TEST_EQ (true, !!moved.value))
+      {
+        TEST_EQ (std::string ("hello"), moved.value.get ().str ());
+      }
+      TEST_EQ (1U, moved.storage.size ());
+
+      // A result within one segment refers to the segment
+      auto within = parse_segments (pword, segments { ss[1] });
+      TEST_EQ (0U, within.storage.size ());
+    }
+
+    std::cout << "Done!" << std::endl;
+  }
+
+  void test_json ()
+  {
+    std::mt19937 random (19740531);
+
+    auto random_testcases = 1000;
+
+    std::cout << "Running " << random_testcases << " JSON testcases..." << std::endl;
+
+    for (auto iter = 0; iter < random_testcases; ++iter)
+    {
+      auto gen    = generate_ast (random, 0);
+      auto sgen   = to_string (gen);
+
+//      std::cout << "-- " << std::endl << sgen << std::endl;
+
+      auto r = parse (pjson, sgen);
+      if (r.value)
+      {
+        auto parsed   = r.value.get ();
+        auto sparsed  = to_string (parsed);
+
+        if (!gen->is_equal_to (parsed))
+        {
+          std::cout
+
+            << "ERROR: Parsed JSON not parsed correctly" << std::endl
+            << "Original: " << sgen << std::endl
+            << "Parsed  : " << sparsed << std::endl
+            ;
+        }
+      }
+      else
+      {
+        std::cout
+          << "ERROR: Failed to parse '" << sgen  << "' with message: " << std::endl
+          << r.message << std::endl
+          ;
+      }
+
+      json_sax_builder builder;
+      auto sr = parse_json_sax (builder, sgen);
+      if (!sr.value || !gen->is_equal_to (builder.result))
+      {
+        std::cout
+          << "ERROR: Failed to parse SAX '" << sgen  << "' with message: " << std::endl
+          << sr.message << std::endl
+          ;
+      }
+
+      json_tape tape;
+      auto tpr = parse_json_tape (tape, sgen);
+      if (!tpr.value || sgen != to_string (tape))
+      {
+        std::cout
+          << "ERROR: Failed to parse tape '" << sgen  << "' with message: " << std::endl
+          << tpr.message << std::endl
+          ;
+      }
+
+      json_node node;
+      auto nr = parse_json_node (node, sgen);
+      if (!nr.value || sgen != to_string (node) || node != to_node (gen))
+      {
+        std::cout
+          << "ERROR: Failed to parse node '" << sgen  << "' with message: " << std::endl
+          << nr.message << std::endl
+          ;
+      }
+
+      auto tr = parse_tokenized (pjson_lexer, pjson_tokens, sgen);
+      if (!tr.value || !gen->is_equal_to (tr.value.get ()))
+      {
+        std::cout
+          << "ERROR: Failed to parse tokenized '" << sgen  << "' with message: " << std::endl
+          << tr.message << std::endl
+          ;
+      }
+    }
+
+    std::cout << "Done!" << std::endl;
+
+    test_parallel_json (random);
+
+    test_parse_lines (random);
+
+    test_parse_batch (random);
+
+    test_tokenized_json ();
+
+    test_incremental_json (random);
+
+    test_push_json (random);
+
+    test_segmented_json (random);
+
+    test_json_sax (random);
+
+    test_json_tape ();
+
+    test_json_node ();
+
+    test_json_writer (random);
+
+    test_json_lazy (random);
+
+    test_select_json (random);
+
+    test_structural_index (random);
+
+    test_vm_json (random);
+
+    /*
+    parse_and_print ("[1.0g32]");
+    parse_and_print ("[2,1.0g32]");
+    parse_and_print ("2");
+    parse_and_print ("[2.171828]");
+    parse_and_print ("[]");
+    parse_and_print ("[null]");
+    parse_and_print ("{}");
+    parse_and_print ("{,}");
+    parse_and_print (R"({"x":3, "y":null})");
+    */
+  };
+}
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+namespace benchmark
+{
+  template<typename TAction>
+  double time_it (TAction && action)
+  {
+    auto before = std::chrono::high_resolution_clock::now ();
+
+    action ();
+
+    auto after  = std::chrono::high_resolution_clock::now ();
+
+    return std::chrono::duration<double, std::milli> (after - before).count ();
+  }
+
+  void benchmark_parse_lines ()
+  {
+    std::mt19937 random (19740531);
+
+    auto lines  = 20000U;
+    auto buffer = json::generate_lines (random, lines, false);
+    auto cores  = std::max (1U, std::thread::hardware_concurrency ());
+
+    std::cout
+      << "parse_lines: " << lines << " JSON lines, " << buffer.size () << " bytes" << std::endl
+      ;
+
+    auto baseline = 0.0;
+    std::cout
+      << "  hardware threads: " << cores << std::endl
+      ;
+
+    // At least 8 threads so that the overhead of the pool shows on machines
+    //  with few cores
+    for (auto threads = 1U; threads <= std::max (cores, 8U); threads *= 2)
+    {
+      cpp_pc::work_stealing_pool pool (threads);
+
+      auto begin  = buffer.c_str ();
+      auto end    = begin + buffer.size ();
+
+      auto ms = time_it ([&] () { cpp_pc::parse_lines (pool, json::pjson, begin, end); });
+      if (threads == 1)
+      {
+        baseline = ms;
+      }
+
+      std::cout
+        << "  threads: " << threads
+        << ", " << ms << " ms"
+        << ", " << (buffer.size () / 1000.0) / ms << " MB/s"
+        << ", speedup: " << baseline / ms
+        << std::endl
+        ;
+    }
+  }
+
+  void benchmark_parse_batch ()
+  {
+    std::mt19937 random (19740531);
+
+    auto messages = 20000U;
+    auto inputs   = json::generate_messages (random, messages, true);
+    auto cores    = std::max (1U, std::thread::hardware_concurrency ());
+
+    std::cout
+      << "parse_batch: " << messages << " JSON messages" << std::endl
+      ;
+
+    auto report = [messages] (char const * name, double ms)
+      {
+        std::cout
+          << "  " << name
+          << ", " << ms << " ms"
+          << ", " << messages / ms << " kmsg/s"
+          << std::endl
+          ;
+      };
+
+    report ("parse (fresh state per call)", time_it ([&] ()
+      {
+        for (auto && input : inputs)
+        {
+          cpp_pc::parse (json::pjson, input);
+        }
+      }));
+
+    report ("parse_session", time_it ([&] ()
+      {
+        cpp_pc::parse_session session;
+        for (auto && input : inputs)
+        {
+          session.parse (json::pjson, input);
+        }
+      }));
+
+    for (auto threads = 1U; threads <= std::max (cores, 8U); threads *= 2)
+    {
+      cpp_pc::work_stealing_pool pool (threads);
+
+      auto name = "parse_batch, threads: " + std::to_string (threads);
+      report (name.c_str (), time_it ([&] () { cpp_pc::parse_batch (pool, json::pjson, inputs); }));
+    }
+  }
+
+  void benchmark_tokenized_json ()
+  {
+    std::mt19937 random (19740531);
+
+    auto documents  = 2000U;
+    auto inputs     = json::generate_messages (random, documents, false);
+
+    auto bytes = std::size_t ();
+    for (auto && input : inputs)
+    {
+      bytes += input.size ();
+    }
+
+    std::cout
+      << "tokenized JSON: " << documents << " documents, " << bytes << " bytes" << std::endl
+      ;
+
+    auto report = [bytes] (char const * name, double ms)
+      {
+        std::cout
+          << "  " << name
+          << ", " << ms << " ms"
+          << ", " << (bytes / 1000.0) / ms << " MB/s"
+          << std::endl
+          ;
+      };
+
+    report ("pjson", time_it ([&] ()
+      {
+        for (auto && input : inputs)
+        {
+          cpp_pc::parse (json::pjson, input);
+        }
+      }));
+
+    report ("pjson_lexer only", time_it ([&] ()
+      {
+        for (auto && input : inputs)
+        {
+          cpp_pc::parse (json::pjson_lexer, input);
+        }
+      }));
+
+    report ("pjson_lexer + pjson_tokens", time_it ([&] ()
+      {
+        for (auto && input : inputs)
+        {
+          cpp_pc::parse_tokenized (json::pjson_lexer, json::pjson_tokens, input);
+        }
+      }));
+  }
+
+  void benchmark_expression ()
+  {
+    std::mt19937 random (19740531);
+
+    auto count  = 20000U;
+    auto inputs = std::vector<std::string> ();
+    auto bytes  = std::size_t ();
+
+    inputs.reserve (count);
+    for (auto iter = 0U; iter < count; ++iter)
+    {
+      inputs.push_back (calculator::generate_expression (random, 0));
+      bytes += inputs.back ().size ();
+    }
+
+    std::cout
+      << "expressions: " << count << " expressions, " << calculator::level_count << " precedence levels, " << bytes << " bytes" << std::endl
+      ;
+
+    auto report = [bytes] (char const * name, double ms)
+      {
+        std::cout
+          << "  " << name
+          << ", " << ms << " ms"
+          << ", " << (bytes / 1000.0) / ms << " MB/s"
+          << std::endl
+          ;
+      };
+
+    auto & session = cpp_pc::this_thread_session ();
+
+    // Best of a few runs as the difference is small compared to the noise
+    auto best_of = [] (auto && action)
+      {
+        auto best = time_it (action);
+        for (auto iter = 0U; iter < 4U; ++iter)
+        {
+          best = std::min (best, time_it (action));
+        }
+        return best;
+      };
+
+    report ("nested psep", best_of ([&] ()
+      {
+        for (auto && input : inputs)
+        {
+          session.parse (calculator::pnested_expr, input);
+        }
+      }));
+
+    report ("pexpression", best_of ([&] ()
+      {
+        for (auto && input : inputs)
+        {
+          session.parse (calculator::ppratt_expr, input);
+        }
+      }));
+  }
+
+  void benchmark_incremental_json ()
+  {
+    std::mt19937 random (19740531);
+
+    auto edits    = 200U;
+    auto document = cpp_pc::make_incremental_document (json::pjson_incremental, json::generate_document (random, 4000));
+    auto bytes    = document->str ().size ();
+
+    std::cout
+      << "incremental JSON: " << bytes << " bytes, " << edits << " single character edits" << std::endl
+      ;
+
+    auto initial = time_it ([&] () { document->parse (); });
+
+    std::cout
+      << "  initial parse, " << initial << " ms, memoized results: " << document->memo_size () << std::endl
+      ;
+
+    // Replaces a random digit by another digit, keeps the document valid
+    auto edit = [&random, &document] ()
+      {
+        auto & text     = document->str ();
+        auto position   = std::uniform_int_distribution<std::size_t> (0, text.size () - 1) (random);
+        while (position < text.size () && !cpp_pc::satisfy_digit (0, text[position]))
+        {
+          ++position;
+        }
+
+        if (position < text.size ())
+        {
+          auto ch = static_cast<char> ('0' + std::uniform_int_distribution<int> (0, 9) (random));
+          document->edit (position, 1, std::string (1, ch));
+        }
+      };
+
+    auto full         = 0.0;
+    auto incremental  = 0.0;
+    auto failures     = 0U;
+
+    // The incremental time includes updating the memo tables for the edit
+    for (auto iter = 0U; iter < edits; ++iter)
+    {
+      incremental += time_it (edit);
+
+      full        += time_it ([&] () { cpp_pc::parse (json::pjson, document->str ()); });
+      incremental += time_it ([&] () { failures += document->parse ().value ? 0U : 1U; });
+    }
+
+    std::cout
+      << "  full parse per edit, " << full / edits << " ms" << std::endl
+      << "  incremental parse per edit, " << incremental / edits << " ms, speedup: " << full / incremental
+      ;
+
+    if (failures > 0)
+    {
+      std::cout << ", failures: " << failures;
+    }
+
+    std::cout << std::endl;
+  }
+
+  void benchmark_push_json ()
+  {
+    std::mt19937 random (19740531);
+
+    auto text   = json::generate_document (random, 4000);
+    auto chunk  = std::size_t (1460);
+
+    std::cout
+      << "push JSON: " << text.size () << " bytes, chunks of " << chunk << " bytes" << std::endl
+      ;
+
+    auto full = time_it ([&] () { cpp_pc::parse (json::pjson, text); });
+
+    auto status = cpp_pc::push_status::need_more;
+    auto push   = time_it ([&] ()
+      {
+        auto pp = cpp_pc::make_push_parser (json::pjson_incremental);
+
+        auto begin  = text.c_str ();
+        auto end    = begin + text.size ();
+        for (auto current = begin; current < end; current += chunk)
+        {
+          pp->feed (current, std::min (current + chunk, end));
+        }
+
+        status = pp->finish ();
+      });
+
+    std::cout
+      << "  parse, " << full << " ms" << std::endl
+      << "  push_parser, " << push << " ms, " << push / full << "x parse"
+      << (status == cpp_pc::push_status::done ? "" : ", failed")
+      << std::endl
+      ;
+  }
+
+  void benchmark_segmented_json ()
+  {
+    std::mt19937 random (19740531);
+
+    auto text = json::generate_document (random, 4000);
+    auto page = std::size_t (4096);
+
+    // Copies the text into pages, as if read from a paged log
+    std::vector<std::string>  pages;
+    cpp_pc::segments          ss;
+    for (auto iter = std::size_t (); iter < text.size (); iter += page)
+    {
+      pages.push_back (text.substr (iter, page));
+    }
+    for (auto && p : pages)
+    {
+      ss.push_back (cpp_pc::segment { p.c_str (), p.c_str () + p.size () });
+    }
+
+    std::cout
+      << "segmented JSON: " << text.size () << " bytes, " << ss.size () << " segments" << std::endl
+      ;
+
+    auto concatenated = time_it ([&] ()
+      {
+        std::string buffer;
+        for (auto && s : ss)
+        {
+          buffer.append (s.begin, s.end);
+        }
+        cpp_pc::parse (json::pjson, buffer);
+      });
+
+    auto segmented = time_it ([&] () { cpp_pc::parse_segments (json::pjson_segmented, ss); });
+
+    std::cout
+      << "  concatenate + parse, " << concatenated << " ms" << std::endl
+      << "  parse_segments, " << segmented << " ms" << std::endl
+      ;
+  }
+
+  // A JSON array of strings of up to 64 characters, with escaped every
+  //  escape_every characters if escape_every isn't 0
+  std::string generate_strings (std::mt19937 & random, std::size_t count, int escape_every)
+  {
+    std::uniform_int_distribution<int> size (0, 64);
+    std::uniform_int_distribution<int> letter ('A', 'Z');
+
+    std::string result = "[";
+    for (auto iter = std::size_t (); iter < count; ++iter)
+    {
+      if (iter > 0)
+      {
+        result += ',';
+      }
+
+      result += '"';
+      auto sz = size (random);
+      for (auto i = 0; i < sz; ++i)
+      {
+        if (escape_every > 0 && i % escape_every == escape_every - 1)
+        {
+          result += "\\n";
+        }
+        else
+        {
+          result += static_cast<char> (letter (random));
+        }
+      }
+      result += '"';
+    }
+    result += ']';
+
+    return result;
+  }
+
+  void benchmark_json_strings ()
+  {
+    using namespace cpp_pc;
+
+    std::mt19937 random (19740531);
+
+    auto plain    = generate_strings (random, 100000, 0);
+    auto escaped  = generate_strings (random, 100000, 16);
+
+    // The string parser before strings were scanned in runs, one pchoice and
+    //  push_back per character
+    auto pescaped         = pskip_char ('\\') < pmap (pany_of ("\"\\/bfnrt"), ::json::map_escaped);
+    auto pchar            = pchoice (psatisfy_char ("char", ::json::satisfy_char), pescaped);
+    auto pchars_per_char  = pbetween (pskip_char ('"'), pmany_char (pchar), pskip_char ('"'));
+
+    // Only valid for strings without escapes, returns views of the input
+    auto pchars_view      = pbetween (pskip_char ('"'), psatisfy ("char", 0, SIZE_MAX, none_of ('"', '\\')), pskip_char ('"'));
+
+    auto array = [] (auto && p)
+      {
+        return pskip_char ('[') < pmany_sepby (p, pskip_char (',')) > pskip_char (']') > peos;
+      };
+
+    auto report = [] (char const * name, std::string const & input, double ms)
+      {
+        std::cout
+          << "  " << name << ", " << ms << " ms, " << (input.size () / (ms * 1000.0)) << " MB/s" << std::endl
+          ;
+      };
+
+    std::cout
+      << "JSON strings: 100000 strings, " << plain.size () << " bytes without escapes, " << escaped.size () << " bytes with escapes" << std::endl
+      ;
+
+    report ("per character, no escapes"   , plain   , time_it ([&] () { parse (array (pchars_per_char), plain); }));
+    report ("runs, no escapes"            , plain   , time_it ([&] () { parse (array (::json::pjson_chars), plain); }));
+    report ("views, no escapes"           , plain   , time_it ([&] () { parse (array (pchars_view), plain); }));
+    report ("per character, with escapes" , escaped , time_it ([&] () { parse (array (pchars_per_char), escaped); }));
+    report ("runs, with escapes"          , escaped , time_it ([&] () { parse (array (::json::pjson_chars), escaped); }));
+  }
+
+  void benchmark_many_char ()
+  {
+    using namespace cpp_pc;
+
+    std::mt19937 random (19740531);
+    std::uniform_int_distribution<int> size (1, 32);
+    std::uniform_int_distribution<int> digit ('0', '9');
+
+    // Runs of digits separated by spaces
+    std::string input;
+    while (input.size () < 4000000)
+    {
+      auto sz = size (random);
+      for (auto iter = 0; iter < sz; ++iter)
+      {
+        input += static_cast<char> (digit (random));
+      }
+      input += ' ';
+    }
+
+    auto pdigit     = psatisfy_char ("digit", satisfy_digit);
+    auto identity   = [] (char ch) { return ch; };
+
+    auto runs = [] (auto && p)
+      {
+        return pmany (p > pskip_ws) > peos;
+      };
+
+    auto report = [&input] (char const * name, double ms)
+      {
+        std::cout
+          << "  " << name << ", " << ms << " ms, " << (input.size () / (ms * 1000.0)) << " MB/s" << std::endl
+          ;
+      };
+
+    std::cout
+      << "many_char: " << input.size () << " bytes of digit runs" << std::endl
+      ;
+
+    report ("pmany_char, per character" , time_it ([&] () { parse (runs (pmany_char1 (pmap (pdigit, identity))), input); }));
+    report ("pmany_char, runs"          , time_it ([&] () { parse (runs (pmany_char1 (pdigit)), input); }));
+    report ("psatisfy"                  , time_it ([&] () { parse (runs (psatisfy ("digit", 1, SIZE_MAX, satisfy_digit)), input); }));
+  }
+
+  void benchmark_line_index ()
+  {
+    using namespace cpp_pc;
+
+    std::mt19937 random (19740531);
+    std::uniform_int_distribution<int> line_size (0, 160);
+
+    std::string input;
+    while (input.size () < 64000000)
+    {
+      input.append (static_cast<std::size_t> (line_size (random)), 'x');
+      input += '\n';
+    }
+
+    auto begin  = input.c_str ();
+    auto end    = begin + input.size ();
+
+    std::uniform_int_distribution<std::size_t> offset (0, input.size ());
+    std::vector<std::size_t> offsets;
+    for (auto iter = 0; iter < 20; ++iter)
+    {
+      offsets.push_back (offset (random));
+    }
+
+    std::cout
+      << "line_index: " << input.size () << " bytes, " << offsets.size () << " lookups" << std::endl
+      ;
+
+    // Scans the input up to each offset
+    auto checksum_scan  = std::size_t ();
+    auto scan           = time_it ([&] ()
+      {
+        for (auto o : offsets)
+        {
+          auto line = std::size_t (1);
+          for (auto current = begin; current < begin + o; ++current)
+          {
+            line += *current == '\n' ? 1 : 0;
+          }
+          checksum_scan += line;
+        }
+      });
+
+    auto checksum_index = std::size_t ();
+    auto indexed        = time_it ([&] ()
+      {
+        line_index index (begin, end);
+        for (auto o : offsets)
+        {
+          checksum_index += index.locate (o).line;
+        }
+      });
+
+    std::cout
+      << "  scan per lookup, " << scan << " ms" << std::endl
+      << "  line_index (including building it), " << indexed << " ms" << (checksum_scan == checksum_index ? "" : " MISMATCH") << std::endl
+      ;
+
+    // Messages that fail to parse, the cost of formatting the error messages
+    std::vector<std::string> messages;
+    for (auto iter = 0; iter < 20000; ++iter)
+    {
+      messages.push_back ("{\"a\":[1,2,{\"b\":tru}]}");
+    }
+
+    auto described  = time_it ([&] () { for (auto && m : messages) parse (::json::pjson, m); });
+    auto structured = time_it ([&] () { for (auto && m : messages) try_parse (::json::pjson, m); });
+
+    std::cout
+      << "  " << messages.size () << " failing messages, parse, " << described << " ms" << std::endl
+      << "  " << messages.size () << " failing messages, try_parse, " << structured << " ms" << std::endl
+      ;
+  }
+
+  // Build with -DCPP_PC__POSITION_TYPE=std::uint32_t to compare
+  void benchmark_results ()
+  {
+    using namespace cpp_pc;
+
+    std::mt19937 random (19740531);
+    std::uniform_int_distribution<int> letter ('a', 'c');
+
+    std::string input;
+    for (auto iter = 0; iter < 4000000; ++iter)
+    {
+      input += static_cast<char> (letter (random));
+    }
+
+    std::cout
+      << "results: position_type of " << sizeof (position_type) << " bytes, " << input.size () << " bytes of input" << std::endl
+      << "  sizeof (result<char>), " << sizeof (result<char>) << std::endl
+      << "  sizeof (result<unit_type>), " << sizeof (result<unit_type>) << std::endl
+      << "  result<char> is trivially copyable, " << std::is_trivially_copyable<result<char>>::value << std::endl
+      ;
+
+    auto report = [&input] (char const * name, double ms)
+      {
+        std::cout
+          << "  " << name << ", " << ms << " ms, " << (input.size () / (ms * 1000.0)) << " MB/s" << std::endl
+          ;
+      };
+
+    // Combinators that invoke their parser once per character
+    auto identity = [] (char ch) { return ch; };
+
+    report ("pmany (pany_of)"             , time_it ([&] () { parse (pmany (pany_of ("abc")) > peos, input); }));
+    report ("pmany_char (pmap (pany_of))" , time_it ([&] () { parse (pmany_char (pmap (pany_of ("abc"), identity)) > peos, input); }));
+    report ("pmany (pchoice (pskip_char))", time_it ([&] () { parse (pmany (pchoice (pskip_char ('a'), pskip_char ('b'), pskip_char ('c'))) > peos, input); }));
+  }
+
+  void benchmark_vm ()
+  {
+    using namespace cpp_pc;
+
+    std::mt19937 random (19740531);
+
+    auto text     = ::json::generate_document (random, 4000);
+    auto repeat   = 10U;
+    auto program  = ::json::make_vm_json_grammar ();
+
+    // The template grammar equivalent to the program, it recognizes JSON
+    //  without building values
+    auto to_unit  = [] (auto &&) { return unit; };
+
+    auto pvalue_trampoline = create_trampoline<unit_type> ();
+    auto pvalue   = ptrampoline<unit_type> (pvalue_trampoline);
+
+    auto pdigits  = pskip_satisfy ("digit", 1, SIZE_MAX, satisfy_digit);
+    auto prun     = pskip_satisfy ("char", 0, SIZE_MAX, none_of ('"', '\\'));
+    auto pstring  = pmap (pskip_char ('"') < prun < pmany (pskip_char ('\\') < pany_of ("\"\\/bfnrt") < prun) < pskip_char ('"'), to_unit);
+    auto pnumber  = pmap (
+        popt (pskip_char ('-'))
+      < pdigits
+      < popt (pskip_char ('.') < pdigits)
+      < popt (pany_of ("eE") < popt (pany_of ("+-")) < pdigits)
+      , to_unit
+      );
+    auto psep     = pskip_char (',') > pskip_ws;
+    auto parray   = pmap (pskip_char ('[') > pskip_ws > pmany_sepby (pvalue, psep) > pskip_char (']'), to_unit);
+    auto pmember  = pstring > pskip_ws > pskip_char (':') > pskip_ws > pvalue;
+    auto pobject  = pmap (pskip_char ('{') > pskip_ws > pmany_sepby (pmember, psep) > pskip_char ('}'), to_unit);
+    auto pvalue_  = pchoice (pstring, pnumber, pskip_string ("true"), pskip_string ("false"), pskip_string ("null"), parray, pobject) > pskip_ws;
+    auto pjson    = pskip_ws < pchoice (parray, pobject) > pskip_ws > peos;
+
+    pvalue_trampoline->trampoline = pvalue_.parser_function;
+
+    std::cout
+      << "PEG virtual machine: " << text.size () << " bytes of JSON, " << program.code.size () << " instructions" << std::endl
+      ;
+
+    auto report = [&text, repeat] (char const * name, double ms)
+      {
+        auto per_parse = ms / repeat;
+        std::cout
+          << "  " << name << ", " << per_parse << " ms, " << (text.size () / (1024.0*1024.0)) / (per_parse / 1000.0) << " MB/s" << std::endl
+          ;
+      };
+
+    auto failures = 0U;
+
+    vm::machine m;
+    vm::match_result r;
+
+    report ("pjson (builds values)"     , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) failures += parse (::json::pjson, text).value ? 0U : 1U; }));
+    report ("template grammar"          , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) failures += parse (pjson, text).value ? 0U : 1U; }));
+    report ("virtual machine"           , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) { m.match (program, text.c_str (), text.c_str () + text.size (), r); failures += r.matched ? 0U : 1U; } }));
+
+    if (failures > 0)
+    {
+      std::cout << "  failures: " << failures << std::endl;
+    }
+  }
+
+  void benchmark_json_sax ()
+  {
+    std::mt19937 random (19740531);
+
+    auto text   = json::generate_document (random, 4000);
+    auto repeat = 10U;
+
+    json::json_sax_counter counter;
+
+    std::cout
+      << "SAX JSON: " << text.size () << " bytes" << std::endl
+      ;
+
+    auto report = [&text, repeat] (char const * name, double ms)
+      {
+        auto per_parse = ms / repeat;
+        std::cout
+          << "  " << name << ", " << per_parse << " ms, " << (text.size () / (1024.0*1024.0)) / (per_parse / 1000.0) << " MB/s" << std::endl
+          ;
+      };
+
+    auto failures = 0U;
+
+    report ("pjson"         , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) failures += cpp_pc::parse (json::pjson, text).value ? 0U : 1U; }));
+    report ("parse_json_sax", time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) failures += json::parse_json_sax (counter, text).value ? 0U : 1U; }));
+
+    std::cout << "  events per parse, " << counter.events / repeat << std::endl;
+
+    if (failures > 0)
+    {
+      std::cout << "  failures: " << failures << std::endl;
+    }
+  }
+
+  // The heap used by a json_ast value, approximately: the node and the
+  //  reference counts of make_shared, and the buffers of vectors and strings
+  std::size_t json_ast_memory (json::json_ast const * v)
+  {
+    using namespace json;
+
+    auto const counts = 2*sizeof (long);
+    auto string_memory = [] (std::string const & str)
+      {
+        return str.capacity () > 15 ? str.capacity () + 1 : 0;
+      };
+
+    if (auto a = dynamic_cast<json_array const *> (v))
+    {
+      auto size = sizeof (json_array) + counts + a->value.capacity () * sizeof (json_ast::ptr);
+      for (auto && e : a->value)
+      {
+        size += json_ast_memory (e.get ());
+      }
+      return size;
+    }
+    else if (auto o = dynamic_cast<json_object const *> (v))
+    {
+      auto size = sizeof (json_object) + counts + o->value.capacity () * sizeof (json_object::value_type::value_type);
+      for (auto && m : o->value)
+      {
+        size += string_memory (std::get<0> (m)) + json_ast_memory (std::get<1> (m).get ());
+      }
+      return size;
+    }
+    else if (auto str = dynamic_cast<json_string const *> (v))
+    {
+      return sizeof (json_string) + counts + string_memory (str->value);
+    }
+    else if (dynamic_cast<json_number const *> (v))
+    {
+      return sizeof (json_number) + counts;
+    }
+    else
+    {
+      // null and booleans are shared
+      return 0;
+    }
+  }
+
+  // Sums the numbers and the sizes of the strings
+  void traverse (json::json_ast const * v, double & sum)
+  {
+    using namespace json;
+
+    if (auto a = dynamic_cast<json_array const *> (v))
+    {
+      for (auto && e : a->value)
+      {
+        traverse (e.get (), sum);
+      }
+    }
+    else if (auto o = dynamic_cast<json_object const *> (v))
+    {
+      for (auto && m : o->value)
+      {
+        sum += static_cast<double> (std::get<0> (m).size ());
+        traverse (std::get<1> (m).get (), sum);
+      }
+    }
+    else if (auto str = dynamic_cast<json_string const *> (v))
+    {
+      sum += static_cast<double> (str->value.size ());
+    }
+    else if (auto n = dynamic_cast<json_number const *> (v))
+    {
+      sum += n->value;
+    }
+  }
+
+  void traverse (json::json_tape_value v, double & sum)
+  {
+    switch (v.tag ())
+    {
+    case 'd':
+      sum += v.as_number ();
+      break;
+    case 's':
+      sum += static_cast<double> (v.as_string ().size ());
+      break;
+    case '[':
+      for (auto && e : v.as_array ())
+      {
+        traverse (e, sum);
+      }
+      break;
+    case '{':
+      for (auto && m : v.as_object ())
+      {
+        sum += static_cast<double> (m.key.as_string ().size ());
+        traverse (m.value, sum);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  void benchmark_json_tape ()
+  {
+    std::mt19937 random (19740531);
+
+    auto text   = json::generate_document (random, 4000);
+    auto repeat = 10U;
+
+    std::cout
+      << "tape JSON: " << text.size () << " bytes" << std::endl
+      ;
+
+    auto report = [repeat] (char const * name, double ms)
+      {
+        std::cout
+          << "  " << name << ", " << ms / repeat << " ms" << std::endl
+          ;
+      };
+
+    auto ast = cpp_pc::parse (json::pjson, text).value.get ();
+
+    json::json_tape tape;
+    json::parse_json_tape (tape, text);
+
+    std::cout
+      << "  json_ast memory (approximate), " << json_ast_memory (ast.get ()) << " bytes" << std::endl
+      << "  json_tape memory, " << tape.entries.capacity () * sizeof (std::uint64_t) + tape.strings.capacity () << " bytes" << std::endl
+      ;
+
+    report ("pjson"                     , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) cpp_pc::parse (json::pjson, text); }));
+    report ("parse_json_tape (reused)"  , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::parse_json_tape (tape, text); }));
+
+    auto ast_sum  = 0.0;
+    auto tape_sum = 0.0;
+
+    report ("traverse json_ast"         , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) traverse (ast.get (), ast_sum); }));
+    report ("traverse json_tape"        , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) traverse (json::root (tape), tape_sum); }));
+
+    if (ast_sum != tape_sum)
+    {
+      std::cout << "  traversals differ: " << ast_sum << ", " << tape_sum << std::endl;
+    }
+  }
+
+  void benchmark_json_node ()
+  {
+    std::mt19937 random (19740531);
+
+    auto text   = json::generate_document (random, 4000);
+    auto repeat = 10U;
+
+    std::cout
+      << "json_node: " << text.size () << " bytes" << std::endl
+      ;
+
+    auto report = [repeat] (char const * name, double ms)
+      {
+        std::cout
+          << "  " << name << ", " << ms / repeat << " ms" << std::endl
+          ;
+      };
+
+    // Separately parsed so that equality compares every node
+    auto left_ast   = cpp_pc::parse (json::pjson, text).value.get ();
+    auto right_ast  = cpp_pc::parse (json::pjson, text).value.get ();
+
+    json::json_node left_node ;
+    json::json_node right_node;
+    json::parse_json_node (left_node, text);
+    json::parse_json_node (right_node, text);
+
+    auto differences = 0U;
+
+    report ("json_ast, is_equal_to"   , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) differences += left_ast->is_equal_to (right_ast) ? 0U : 1U; }));
+    report ("json_node, =="           , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) differences += left_node == right_node ? 0U : 1U; }));
+    report ("json_ast, to_string"     , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::to_string (left_ast); }));
+    report ("json_node, to_string"    , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::to_string (left_node); }));
+    report ("pjson"                   , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) cpp_pc::parse (json::pjson, text); }));
+    report ("parse_json_node"         , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) { json::json_node node; json::parse_json_node (node, text); } }));
+
+    if (differences > 0)
+    {
+      std::cout << "  differences: " << differences << std::endl;
+    }
+  }
+
+  void benchmark_json_writer ()
+  {
+    std::mt19937 random (19740531);
+
+    auto text   = json::generate_document (random, 4000);
+    auto repeat = 10U;
+
+    std::cout
+      << "json_writer: " << text.size () << " bytes" << std::endl
+      ;
+
+    auto ast = cpp_pc::parse (json::pjson, text).value.get ();
+
+    json::json_node node;
+    json::parse_json_node (node, text);
+
+    json::json_tape tape;
+    json::parse_json_tape (tape, text);
+
+    auto size = 0U;
+
+    auto report = [repeat, &size] (char const * name, double ms)
+      {
+        auto mb = static_cast<double> (size) / (1024.0 * 1024.0);
+        std::cout
+          << "  " << name << ", " << ms / repeat << " ms, " << mb * repeat * 1000.0 / ms << " MB/s" << std::endl
+          ;
+      };
+
+    size = static_cast<unsigned> (json::to_string (ast).size ());
+    report ("json_ast, to_string"   , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::to_string (ast); }));
+    report ("json_node, to_string"  , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::to_string (node); }));
+    report ("json_tape, to_string"  , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::to_string (tape); }));
+
+    size = static_cast<unsigned> (json::to_json (ast).size ());
+    report ("json_ast, to_json"     , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::to_json (ast); }));
+    report ("json_node, to_json"    , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::to_json (node); }));
+    report ("json_tape, to_json"    , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::to_json (tape); }));
+
+    json::json_writer writer;
+    report ("reformat events (reused)", time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) { writer.buffer.clear (); json::parse_json_sax (writer, text); } }));
+
+    if (auto file = std::tmpfile ())
+    {
+      report ("json_tape, write_json to file", time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::write_json (file, tape); }));
+      std::fclose (file);
+    }
+  }
+
+  void benchmark_json_lazy ()
+  {
+    std::mt19937 random (19740531);
+
+    json::json_object::value_type members;
+    for (auto iter = 0U; iter < 4000U; ++iter)
+    {
+      members.push_back (std::make_tuple ("k" + std::to_string (iter), json::generate_ast (random, 0)));
+    }
+
+    auto text   = json::to_string (json::json_object::create (std::move (members)));
+    auto repeat = 10U;
+    auto keys   = { "k10", "k2000", "k3990" };
+
+    std::cout
+      << "lazy JSON: " << text.size () << " bytes, 3 of 4000 members" << std::endl
+      ;
+
+    auto report = [repeat] (char const * name, double ms)
+      {
+        std::cout
+          << "  " << name << ", " << ms / repeat << " ms" << std::endl
+          ;
+      };
+
+    auto found = 0U;
+
+    report ("pjson, then find", time_it ([&] ()
+      {
+        for (auto iter = 0U; iter < repeat; ++iter)
+        {
+          auto r = cpp_pc::parse (json::pjson, text);
+          auto o = std::dynamic_pointer_cast<json::json_object> (r.value.get ());
+          for (auto && key : keys)
+          {
+            for (auto && m : o->value)
+            {
+              if (std::get<0> (m) == key)
+              {
+                ++found;
+                break;
+              }
+            }
+          }
+        }
+      }));
+
+    report ("parse_json_lazy, then find and parse", time_it ([&] ()
+      {
+        for (auto iter = 0U; iter < repeat; ++iter)
+        {
+          auto r = json::parse_json_lazy (text);
+          for (auto && key : keys)
+          {
+            auto v = r.value.get ().find (key);
+            if (v && v.get ().parse ().value)
+            {
+              ++found;
+            }
+          }
+        }
+      }));
+
+    auto mb = static_cast<double> (text.size ()) / (1024.0 * 1024.0);
+    auto ms = time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) found += json::parse_json_lazy (text).value ? 1U : 0U; });
+    std::cout
+      << "  parse_json_lazy, " << ms / repeat << " ms, " << mb * repeat * 1000.0 / ms << " MB/s" << std::endl
+      ;
+
+    if (found != repeat * 7)
+    {
+      std::cout << "  found: " << found << std::endl;
+    }
+  }
+
+  void benchmark_select_json ()
+  {
+    std::mt19937 random (19740531);
+
+    json::json_array::value_type items;
+    for (auto iter = 0U; iter < 4000U; ++iter)
+    {
+      json::json_object::value_type item;
+      item.push_back (std::make_tuple ("id"   , json::json_number::create (iter)));
+      item.push_back (std::make_tuple ("name" , json::json_string::create (json::generate_string (random))));
+      item.push_back (std::make_tuple ("price", json::json_number::create (json::next (random, 0, 4000) / 4.0)));
+      item.push_back (std::make_tuple ("extra", json::generate_ast (random, 0)));
+      items.push_back (json::json_object::create (std::move (item)));
+    }
+
+    json::json_object::value_type members;
+    members.push_back (std::make_tuple ("items", json::json_array::create (std::move (items))));
+
+    auto text   = json::to_string (json::json_object::create (std::move (members)));
+    auto repeat = 10U;
+    auto paths  = json::compile_json_paths ({ "/items/*/price" }).get ();
+
+    std::cout
+      << "select JSON: " << text.size () << " bytes, /items/*/price" << std::endl
+      ;
+
+    auto report = [repeat, &text] (char const * name, double ms)
+      {
+        auto mb = static_cast<double> (text.size ()) / (1024.0 * 1024.0);
+        std::cout
+          << "  " << name << ", " << ms / repeat << " ms, " << mb * repeat * 1000.0 / ms << " MB/s" << std::endl
+          ;
+      };
+
+    auto sum    = 0.0;
+    auto count  = [&sum] (std::size_t, json::json_ast::ptr const & v) { sum += std::static_pointer_cast<json::json_number> (v)->value; };
+
+    report ("pjson, then traverse", time_it ([&] ()
+      {
+        for (auto iter = 0U; iter < repeat; ++iter)
+        {
+          auto r = cpp_pc::parse (json::pjson, text);
+          auto o = std::static_pointer_cast<json::json_object> (r.value.get ());
+          for (auto && item : std::static_pointer_cast<json::json_array> (std::get<1> (o->value.front ()))->value)
+          {
+            for (auto && m : std::static_pointer_cast<json::json_object> (item)->value)
+            {
+              if (std::get<0> (m) == "price")
+              {
+                count (0, std::get<1> (m));
+              }
+            }
+          }
+        }
+      }));
+
+    json::json_sax_counter counter;
+    report ("parse_json_sax (no values)"  , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::parse_json_sax (counter, text); }));
+    report ("select_json, validate"       , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::select_json (paths, count, text, json::json_unselected::validate); }));
+    report ("select_json, skip"           , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::select_json (paths, count, text); }));
+
+    if (sum == 0.0)
+    {
+      std::cout << "  nothing selected" << std::endl;
+    }
+  }
+
+  void benchmark_structural_index ()
+  {
+    std::mt19937 random (19740531);
+
+    auto compact  = json::generate_document (random, 4000);
+    auto strings  = generate_strings (random, 20000, 0);
+
+    // Indented as if pretty printed
+    std::string pretty;
+    for (auto ch : compact)
+    {
+      pretty += ch;
+      if (ch == ',' || ch == '[' || ch == '{')
+      {
+        pretty += "\n        ";
+      }
+    }
+
+    auto repeat = 10U;
+
+    std::cout
+      << "structural index: " << compact.size () << " bytes compact, " << pretty.size () << " bytes indented, " << strings.size () << " bytes of strings" << std::endl
+      ;
+
+    cpp_pc::structural_index index;
+
+    for (auto && input : { &compact, &pretty, &strings })
+    {
+      auto & text = *input;
+      auto begin  = text.c_str ();
+      auto end    = begin + text.size ();
+
+      auto report = [repeat, &text] (char const * name, double ms)
+        {
+          auto mb = static_cast<double> (text.size ()) / (1024.0 * 1024.0);
+          std::cout
+            << "  " << name << ", " << ms / repeat << " ms, " << mb * repeat * 1000.0 / ms << " MB/s" << std::endl
+            ;
+        };
+
+      std::cout << (input == &compact ? " compact" : input == &pretty ? " indented" : " strings") << std::endl;
+
+      report ("build_structural_index"        , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) cpp_pc::build_structural_index (begin, end, index); }));
+      report ("build_structural_index_scalar" , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) cpp_pc::build_structural_index_scalar (begin, end, index); }));
+      report ("pjson"                         , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) cpp_pc::parse (json::pjson, text); }));
+      report ("parse_json_indexed"            , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) json::parse_json_indexed (index, text); }));
+      cpp_pc::build_structural_index (begin, end, index);
+      report ("pjson_indexed, index built"    , time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) cpp_pc::parse_indexed (json::pjson_indexed, begin, end, index); }));
+    }
+  }
+
+  void benchmark_structural_index_threads ()
+  {
+    std::mt19937 random (19740531);
+
+    // A document of about 64 MB
+    auto part = json::generate_document (random, 4000);
+    std::string text = "[";
+    for (auto iter = 0U; iter < 72U; ++iter)
+    {
+      text += iter > 0 ? "," : "";
+      text += part;
+    }
+    text += "]";
+
+    auto begin  = text.c_str ();
+    auto end    = begin + text.size ();
+    auto repeat = 3U;
+    auto mb     = static_cast<double> (text.size ()) / (1024.0 * 1024.0);
+
+    std::cout
+      << "structural index on threads: " << text.size () << " bytes, " << cpp_pc::structural_chunk_size << " byte chunks, "
+      << std::thread::hardware_concurrency () << " hardware threads" << std::endl
+      ;
+
+    cpp_pc::structural_index index;
+
+    auto single = time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) cpp_pc::build_structural_index (begin, end, index); });
+    std::cout
+      << "  build_structural_index, " << single / repeat << " ms, " << mb * repeat * 1000.0 / single << " MB/s" << std::endl
+      ;
+
+    for (auto threads : { 1U, 2U, 4U, 8U, 16U })
+    {
+      cpp_pc::work_stealing_pool pool (threads);
+      auto ms = time_it ([&] () { for (auto iter = 0U; iter < repeat; ++iter) cpp_pc::build_structural_index (pool, begin, end, index); });
+      std::cout
+        << "  " << threads << " threads, " << ms / repeat << " ms, " << mb * repeat * 1000.0 / ms << " MB/s, " << single / ms << "x" << std::endl
+        ;
+    }
+  }
+
+  void run_benchmarks ()
+  {
+    std::cout << "Running benchmarks..." << std::endl;
+    benchmark_parse_lines ();
+    benchmark_parse_batch ();
+    benchmark_tokenized_json ();
+    benchmark_expression ();
+    benchmark_incremental_json ();
+    benchmark_push_json ();
+    benchmark_segmented_json ();
+    benchmark_json_strings ();
+    benchmark_many_char ();
+    benchmark_line_index ();
+    benchmark_results ();
+    benchmark_vm ();
+    benchmark_json_sax ();
+    benchmark_json_tape ();
+    benchmark_json_node ();
+    benchmark_json_writer ();
+    benchmark_json_lazy ();
+    benchmark_select_json ();
+    benchmark_structural_index ();
+    benchmark_structural_index_threads ();
+    std::cout << "Done!" << std::endl;
+  }
+}
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+int main (int argc, char const * argv[])
+{
+  if (argc > 1 && std::string (argv[1]) == "bench")
+  {
+    benchmark::run_benchmarks ();
+    return 0;
+  }
 
-// ----------------------------------------------------------------------------
-int main()
-{
   std::cout << "Running unit tests..." << std::endl;
   test_parser::test_opt<std::string> ("1234", "5678");
   test_parser::test_opt<int> (1,3);
   test_parser::test_parser ();
+  test_parser::test_line_index ();
+  test_parser::test_compile_time ();
+  test_parser::test_vm ();
   std::cout << "Unit tests complete" << std::endl;
 
   std::cout << "Running json tests..." << std::endl;
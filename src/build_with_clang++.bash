@@ -1 +1 @@
-clang++ -O0 -ggdb -Wall --std=c++1y ParserCombinator.cpp -o CppParserCombinator.clang++
+clang++ -O0 -ggdb -Wall --std=c++1y -pthread ParserCombinator.cpp -o CppParserCombinator.clang++
@@ -1 +1 @@
-g++ -O0 -ggdb -Wall --std=c++1y ParserCombinator.cpp -o CppParserCombinator.g++
+g++ -O0 -ggdb -Wall --std=c++1y -pthread ParserCombinator.cpp -o CppParserCombinator.g++
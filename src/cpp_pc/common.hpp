@@ -16,8 +16,17 @@
 #pragma once
 // ----------------------------------------------------------------------------
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <type_traits>
 // ----------------------------------------------------------------------------
+// The type used to store positions in results, define as std::uint32_t when
+//  inputs are smaller than 4 GB. Results of small values (ie char) then fit
+//  in 8 bytes and are returned in a register
+#ifndef CPP_PC__POSITION_TYPE
+# define CPP_PC__POSITION_TYPE std::size_t
+#endif
+
 #define CPP_PC__PRELUDE constexpr
 #define CPP_PC__INLINE  inline
 #define CPP_PC__ASSERT(expr) assert (expr)
@@ -49,6 +58,10 @@ namespace cpp_pc
     using strip_type_t = std::decay_t<T>;
   }
 
+  using position_type = CPP_PC__POSITION_TYPE;
+
+  static_assert (std::is_unsigned<position_type>::value, "CPP_PC__POSITION_TYPE must be an unsigned integer type");
+
   struct unit_type
   {
     CPP_PC__PRELUDE unit_type ()
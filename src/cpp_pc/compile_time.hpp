@@ -0,0 +1,644 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#pragma once
+// ----------------------------------------------------------------------------
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+// ----------------------------------------------------------------------------
+#include "common.hpp"
+#include "pc.hpp"
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+// Compile time parsing: a subset of the combinators that can be evaluated in
+//  constant expressions, so that literals like embedded configuration or
+//  format strings are parsed and validated by the compiler
+//
+//  The subset doesn't collect errors, a failure only reports the position.
+//  Parser functions are function objects rather than lambdas and values are
+//  literal types that are default constructible. Mappers and predicates
+//  must be usable in constant expressions as well, ie function objects
+//  with a constexpr operator () or pointers to constexpr functions
+// ----------------------------------------------------------------------------
+namespace cpp_pc
+{
+  namespace compile_time
+  {
+    // A state over a string literal
+    struct literal_state
+    {
+      CPP_PC__PRELUDE literal_state (char const * begin, char const * end)
+        : begin (begin)
+        , end   (end)
+      {
+        CPP_PC__ASSERT (begin <= end);
+      }
+
+      // The terminating zero isn't part of the input
+      template<std::size_t N>
+      CPP_PC__PRELUDE literal_state (char const (&literal)[N])
+        : begin (literal)
+        , end   (literal + N - 1)
+      {
+      }
+
+      CPP_PC__PRELUDE int peek (std::size_t position) const noexcept
+      {
+        CPP_PC__ASSERT (position <= remaining (0));
+        return position < remaining (0) ? begin[position] : EOS;
+      }
+
+      CPP_PC__PRELUDE std::size_t remaining (std::size_t position) const noexcept
+      {
+        return static_cast<std::size_t> (end - begin) - position;
+      }
+
+      template<typename TSatisfyFunction>
+      CPP_PC__PRELUDE sub_string satisfy (
+          std::size_t               position
+        , std::size_t               at_most
+        , TSatisfyFunction const &  satisfy_function
+        ) const
+      {
+        auto start    = begin + position;
+        auto last     = start + std::min (remaining (position), at_most);
+        auto current  = start;
+
+        for (
+          ; current < last && satisfy_function (static_cast<std::size_t> (current - start), *current)
+          ; ++current
+          )
+          ;
+
+        return sub_string (start, current);
+      }
+
+      char const *  begin ;
+      char const *  end   ;
+    };
+
+    template<typename TValue>
+    struct result
+    {
+      using value_type = TValue;
+
+      static_assert (
+          std::is_trivially_destructible<value_type>::value
+        , "value_type must be a literal type"
+        );
+
+      CPP_PC__PRELUDE explicit result (std::size_t position)
+        : position  (position)
+        , has_value (false)
+        , value     ()
+      {
+      }
+
+      CPP_PC__PRELUDE explicit result (std::size_t position, value_type const & v)
+        : position  (position)
+        , has_value (true)
+        , value     (v)
+      {
+      }
+
+      CPP_PC__PRELUDE explicit operator bool () const noexcept
+      {
+        return has_value;
+      }
+
+      CPP_PC__PRELUDE value_type const & get () const noexcept
+      {
+        CPP_PC__ASSERT (has_value);
+        return value;
+      }
+
+      CPP_PC__PRELUDE static auto success (std::size_t pos, value_type const & v)
+      {
+        return result (pos, v);
+      }
+
+      CPP_PC__PRELUDE static auto failure (std::size_t pos)
+      {
+        return result (pos);
+      }
+
+      std::size_t position  ;
+      bool        has_value ;
+      value_type  value     ;
+    };
+
+    template<typename TValue, typename TParserFunction>
+    struct parser;
+
+    template<typename TParser, typename TOtherParser>
+    CPP_PC__PRELUDE auto pleft (TParser const & t, TOtherParser const & u);
+
+    template<typename TParser, typename TOtherParser>
+    CPP_PC__PRELUDE auto pright (TParser const & t, TOtherParser const & u);
+
+    template<typename TValue, typename TParserFunction>
+    struct parser
+    {
+      using parser_function_type  = TParserFunction ;
+      using value_type            = TValue          ;
+
+      parser_function_type parser_function;
+
+      CPP_PC__PRELUDE explicit parser (parser_function_type const & parser_function)
+        : parser_function (parser_function)
+      {
+      }
+
+      template<typename TParser>
+      CPP_PC__PRELUDE auto operator > (TParser const & t) const
+      {
+        return pleft (*this, t);
+      }
+
+      template<typename TParser>
+      CPP_PC__PRELUDE auto operator < (TParser const & t) const
+      {
+        return pright (*this, t);
+      }
+    };
+
+    namespace detail
+    {
+      template<typename TParserFunction>
+      CPP_PC__PRELUDE auto adapt_parser_function (TParserFunction const & parser_function)
+      {
+        using result_type = decltype (parser_function (std::declval<literal_state const &> (), 0));
+        using value_type  = typename result_type::value_type;
+
+        return parser<value_type, TParserFunction> (parser_function);
+      }
+
+      template<typename TParser>
+      using value_type_t = typename TParser::value_type;
+
+      struct char_function
+      {
+        char ch;
+
+        CPP_PC__PRELUDE result<char> operator () (literal_state const & s, std::size_t position) const
+        {
+          return
+              s.peek (position) == ch
+            ? result<char>::success (position + 1, ch)
+            : result<char>::failure (position)
+            ;
+        }
+      };
+
+      struct skip_char_function
+      {
+        char ch;
+
+        CPP_PC__PRELUDE result<unit_type> operator () (literal_state const & s, std::size_t position) const
+        {
+          return
+              s.peek (position) == ch
+            ? result<unit_type>::success (position + 1, unit)
+            : result<unit_type>::failure (position)
+            ;
+        }
+      };
+
+      template<typename TSatisfyFunction>
+      struct satisfy_function
+      {
+        std::size_t       at_least          ;
+        std::size_t       at_most           ;
+        TSatisfyFunction  predicate         ;
+
+        CPP_PC__PRELUDE result<sub_string> operator () (literal_state const & s, std::size_t position) const
+        {
+          auto ss       = s.satisfy (position, at_most, predicate);
+          auto consumed = ss.size ();
+
+          return
+              consumed < at_least
+            ? result<sub_string>::failure (position + consumed)
+            : result<sub_string>::success (position + consumed, ss)
+            ;
+        }
+      };
+
+      template<typename TSatisfyFunction>
+      struct skip_satisfy_function
+      {
+        std::size_t       at_least          ;
+        std::size_t       at_most           ;
+        TSatisfyFunction  predicate         ;
+
+        CPP_PC__PRELUDE result<unit_type> operator () (literal_state const & s, std::size_t position) const
+        {
+          auto consumed = s.satisfy (position, at_most, predicate).size ();
+
+          return
+              consumed < at_least
+            ? result<unit_type>::failure (position + consumed)
+            : result<unit_type>::success (position + consumed, unit)
+            ;
+        }
+      };
+
+      struct eos_function
+      {
+        CPP_PC__PRELUDE result<unit_type> operator () (literal_state const & s, std::size_t position) const
+        {
+          return
+              s.peek (position) == EOS
+            ? result<unit_type>::success (position, unit)
+            : result<unit_type>::failure (position)
+            ;
+        }
+      };
+
+      // Up to 20 digits like praw_uint64, an optional sign when Signed
+      template<bool Signed>
+      struct integer_function
+      {
+        using value_type = std::conditional_t<Signed, std::int64_t, std::uint64_t>;
+
+        CPP_PC__PRELUDE result<value_type> operator () (literal_state const & s, std::size_t position) const
+        {
+          auto negative = false   ;
+          auto pos      = position;
+
+          if (Signed)
+          {
+            auto peek = s.peek (pos);
+            if (peek == '+' || peek == '-')
+            {
+              negative = peek == '-';
+              ++pos;
+            }
+          }
+
+          auto ss       = s.satisfy (pos, 20U, satisfy_digit);
+          auto consumed = ss.size ();
+
+          if (consumed == 0)
+          {
+            return result<value_type>::failure (pos);
+          }
+
+          value_type i = 0;
+          for (auto iter = ss.begin; iter != ss.end; ++iter)
+          {
+            i = 10*i + static_cast<value_type> (*iter - '0');
+          }
+
+          return result<value_type>::success (pos + consumed, negative ? 0 - i : i);
+        }
+      };
+
+      template<typename TParser, typename TMapper>
+      struct map_function
+      {
+        TParser t;
+        TMapper m;
+
+        using mvalue_type = cpp_pc::detail::strip_type_t<decltype (std::declval<TMapper const &> () (std::declval<value_type_t<TParser> const &> ()))>;
+
+        CPP_PC__PRELUDE result<mvalue_type> operator () (literal_state const & s, std::size_t position) const
+        {
+          auto tv = t.parser_function (s, position);
+
+          return
+              tv
+            ? result<mvalue_type>::success (tv.position, m (tv.get ()))
+            : result<mvalue_type>::failure (tv.position)
+            ;
+        }
+      };
+
+      template<typename TParser, typename TOtherParser>
+      struct left_function
+      {
+        TParser       t;
+        TOtherParser  u;
+
+        using result_type = result<value_type_t<TParser>>;
+
+        CPP_PC__PRELUDE result_type operator () (literal_state const & s, std::size_t position) const
+        {
+          auto tv = t.parser_function (s, position);
+          if (!tv)
+          {
+            return tv;
+          }
+
+          auto uv = u.parser_function (s, tv.position);
+
+          return
+              uv
+            ? result_type::success (uv.position, tv.get ())
+            : result_type::failure (uv.position)
+            ;
+        }
+      };
+
+      template<typename TParser, typename TOtherParser>
+      struct right_function
+      {
+        TParser       t;
+        TOtherParser  u;
+
+        using result_type = result<value_type_t<TOtherParser>>;
+
+        CPP_PC__PRELUDE result_type operator () (literal_state const & s, std::size_t position) const
+        {
+          auto tv = t.parser_function (s, position);
+
+          return
+              tv
+            ? u.parser_function (s, tv.position)
+            : result_type::failure (tv.position)
+            ;
+        }
+      };
+
+      // The position of a failure is where the alternative that got furthest
+      //  failed, like pchoice
+      template<typename TParser, typename TOtherParser>
+      struct choice_function
+      {
+        TParser       t;
+        TOtherParser  u;
+
+        using result_type = result<value_type_t<TParser>>;
+
+        static_assert (
+            std::is_same<value_type_t<TParser>, value_type_t<TOtherParser>>::value
+          , "The alternatives must produce the same type"
+          );
+
+        CPP_PC__PRELUDE result_type operator () (literal_state const & s, std::size_t position) const
+        {
+          auto tv = t.parser_function (s, position);
+          if (tv)
+          {
+            return tv;
+          }
+
+          auto uv = u.parser_function (s, position);
+
+          return
+              uv
+            ? uv
+            : result_type::failure (std::max (tv.position, uv.position))
+            ;
+        }
+      };
+
+      // Folds the values of t (separated by sep) into an accumulator as
+      //  there are no containers in constant expressions
+      template<typename TParser, typename TSeparatorParser, typename TAccumulator, typename TFolder>
+      struct many_sepby_fold_function
+      {
+        TParser           t           ;
+        TSeparatorParser  sep         ;
+        bool              has_sep     ;
+        std::size_t       at_least    ;
+        TAccumulator      initial     ;
+        TFolder           folder      ;
+
+        CPP_PC__PRELUDE result<TAccumulator> operator () (literal_state const & s, std::size_t position) const
+        {
+          auto accumulator  = initial       ;
+          auto count        = std::size_t ();
+          auto pos          = position      ;
+
+          while (true)
+          {
+            auto next = pos;
+
+            if (has_sep && count > 0)
+            {
+              auto sv = sep.parser_function (s, next);
+              if (!sv)
+              {
+                break;
+              }
+              next = sv.position;
+            }
+
+            auto tv = t.parser_function (s, next);
+            // A value that consumes nothing would be repeated forever
+            if (!tv || tv.position == pos)
+            {
+              break;
+            }
+
+            accumulator = folder (accumulator, tv.get ());
+            pos         = tv.position;
+            ++count;
+          }
+
+          return
+              count < at_least
+            ? result<TAccumulator>::failure (pos)
+            : result<TAccumulator>::success (pos, accumulator)
+            ;
+        }
+      };
+
+      template<typename ...TParsers>
+      struct tuple_function;
+
+      template<>
+      struct tuple_function<>
+      {
+        CPP_PC__PRELUDE tuple_function ()
+        {
+        }
+
+        CPP_PC__PRELUDE result<std::tuple<>> operator () (literal_state const &, std::size_t position) const
+        {
+          return result<std::tuple<>>::success (position, std::tuple<> ());
+        }
+      };
+
+      template<typename TParser, typename ...TParsers>
+      struct tuple_function<TParser, TParsers...>
+      {
+        using value_type  = std::tuple<value_type_t<TParser>, value_type_t<TParsers>...>;
+        using result_type = result<value_type>;
+
+        TParser                     head;
+        tuple_function<TParsers...> tail;
+
+        CPP_PC__PRELUDE tuple_function (TParser const & head, TParsers const & ...tail)
+          : head  (head)
+          , tail  (tail...)
+        {
+        }
+
+        CPP_PC__PRELUDE result_type operator () (literal_state const & s, std::size_t position) const
+        {
+          auto hv = head.parser_function (s, position);
+          if (!hv)
+          {
+            return result_type::failure (hv.position);
+          }
+
+          auto tv = tail (s, hv.position);
+          if (!tv)
+          {
+            return result_type::failure (tv.position);
+          }
+
+          return result_type::success (tv.position, std::tuple_cat (std::make_tuple (hv.get ()), tv.get ()));
+        }
+      };
+    }
+
+    CPP_PC__PRELUDE auto pchar (char ch)
+    {
+      return detail::adapt_parser_function (detail::char_function { ch });
+    }
+
+    CPP_PC__PRELUDE auto pskip_char (char ch)
+    {
+      return detail::adapt_parser_function (detail::skip_char_function { ch });
+    }
+
+    template<typename TSatisfyFunction>
+    CPP_PC__PRELUDE auto psatisfy (std::size_t at_least, std::size_t at_most, TSatisfyFunction const & satisfy_function)
+    {
+      return detail::adapt_parser_function (detail::satisfy_function<TSatisfyFunction> { at_least, at_most, satisfy_function });
+    }
+
+    template<typename TSatisfyFunction>
+    CPP_PC__PRELUDE auto pskip_satisfy (std::size_t at_least, std::size_t at_most, TSatisfyFunction const & satisfy_function)
+    {
+      return detail::adapt_parser_function (detail::skip_satisfy_function<TSatisfyFunction> { at_least, at_most, satisfy_function });
+    }
+
+    CPP_PC__PRELUDE auto peos ()
+    {
+      return detail::adapt_parser_function (detail::eos_function {});
+    }
+
+    CPP_PC__PRELUDE auto pskip_ws ()
+    {
+      return pskip_satisfy (0, SIZE_MAX, satisfy_whitespace);
+    }
+
+    CPP_PC__PRELUDE auto puint64 ()
+    {
+      return detail::adapt_parser_function (detail::integer_function<false> {});
+    }
+
+    CPP_PC__PRELUDE auto pint64 ()
+    {
+      return detail::adapt_parser_function (detail::integer_function<true> {});
+    }
+
+    template<typename TParser, typename TMapper>
+    CPP_PC__PRELUDE auto pmap (TParser const & t, TMapper const & m)
+    {
+      return detail::adapt_parser_function (detail::map_function<TParser, TMapper> { t, m });
+    }
+
+    template<typename TParser, typename TOtherParser>
+    CPP_PC__PRELUDE auto pleft (TParser const & t, TOtherParser const & u)
+    {
+      return detail::adapt_parser_function (detail::left_function<TParser, TOtherParser> { t, u });
+    }
+
+    template<typename TParser, typename TOtherParser>
+    CPP_PC__PRELUDE auto pright (TParser const & t, TOtherParser const & u)
+    {
+      return detail::adapt_parser_function (detail::right_function<TParser, TOtherParser> { t, u });
+    }
+
+    template<typename TBeginParser, typename TParser, typename TEndParser>
+    CPP_PC__PRELUDE auto pbetween (TBeginParser const & b, TParser const & t, TEndParser const & e)
+    {
+      return pright (b, pleft (t, e));
+    }
+
+    template<typename TParser>
+    CPP_PC__PRELUDE auto pchoice (TParser const & t)
+    {
+      return t;
+    }
+
+    template<typename TParser, typename TOtherParser, typename ...TParsers>
+    CPP_PC__PRELUDE auto pchoice (TParser const & t, TOtherParser const & u, TParsers const & ...parsers)
+    {
+      auto rest = pchoice (u, parsers...);
+
+      return detail::adapt_parser_function (detail::choice_function<TParser, decltype (rest)> { t, rest });
+    }
+
+    template<typename ...TParsers>
+    CPP_PC__PRELUDE auto ptuple (TParsers const & ...parsers)
+    {
+      return detail::adapt_parser_function (detail::tuple_function<TParsers...> (parsers...));
+    }
+
+    // folder (accumulator, value) returns the next accumulator
+    template<typename TParser, typename TAccumulator, typename TFolder>
+    CPP_PC__PRELUDE auto pmany_fold (TParser const & t, TAccumulator const & initial, TFolder const & folder)
+    {
+      using function_type = detail::many_sepby_fold_function<TParser, TParser, TAccumulator, TFolder>;
+
+      return detail::adapt_parser_function (function_type { t, t, false, 0, initial, folder });
+    }
+
+    template<typename TParser, typename TSeparatorParser, typename TAccumulator, typename TFolder>
+    CPP_PC__PRELUDE auto pmany_sepby_fold (
+        TParser const &           t
+      , TSeparatorParser const &  sep
+      , TAccumulator const &      initial
+      , TFolder const &           folder
+      )
+    {
+      using function_type = detail::many_sepby_fold_function<TParser, TSeparatorParser, TAccumulator, TFolder>;
+
+      return detail::adapt_parser_function (function_type { t, sep, true, 0, initial, folder });
+    }
+
+    template<typename TValue, typename TParserFunction>
+    CPP_PC__PRELUDE auto parse (parser<TValue, TParserFunction> const & p, char const * begin, char const * end)
+    {
+      literal_state s (begin, end);
+      return p.parser_function (s, 0);
+    }
+
+    template<typename TValue, typename TParserFunction, std::size_t N>
+    CPP_PC__PRELUDE auto parse (parser<TValue, TParserFunction> const & p, char const (&literal)[N])
+    {
+      return parse (p, literal, literal + N - 1);
+    }
+
+    // True if p accepts all of the literal, for static_assert
+    template<typename TValue, typename TParserFunction, std::size_t N>
+    CPP_PC__PRELUDE bool is_valid (parser<TValue, TParserFunction> const & p, char const (&literal)[N])
+    {
+      auto v = parse (p, literal);
+      return v && v.position == N - 1;
+    }
+  }
+}
+// ----------------------------------------------------------------------------
@@ -0,0 +1,676 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#pragma once
+// ----------------------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+// ----------------------------------------------------------------------------
+#include "common.hpp"
+#include "pc.hpp"
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+// Incremental parsing: rules wrapped in pmemo record their results per
+//  position in a memo table owned by an incremental_document. After an edit
+//  only the entries whose examined range overlaps the edit are dropped, the
+//  entries after it are shifted. Re-parsing then reuses the results of all
+//  unaffected rules, so only the path from the root down to the edit and the
+//  siblings along that path are visited
+// ----------------------------------------------------------------------------
+namespace cpp_pc
+{
+  namespace detail
+  {
+    struct base_memo_table
+    {
+      using ptr = std::unique_ptr<base_memo_table>;
+
+      base_memo_table ()                                      = default;
+      base_memo_table (base_memo_table const &)               = delete ;
+      base_memo_table (base_memo_table &&)                    = delete ;
+      base_memo_table & operator = (base_memo_table const &)  = delete ;
+      base_memo_table & operator = (base_memo_table &&)       = delete ;
+      virtual ~base_memo_table ()                             = default;
+
+      // Characters [begin, end) were replaced by inserted characters
+      virtual void edit (std::size_t begin, std::size_t end, std::size_t inserted) = 0;
+      virtual std::size_t size () const noexcept = 0;
+    };
+
+    // An open addressing hash map from start position to entry, entries are
+    //  stored contiguously and the table only holds indices. Entries are
+    //  never removed one by one, the memo table rebuilds the map instead
+    template<typename TEntry>
+    struct memo_entries
+    {
+      using iterator        = typename std::vector<TEntry>::iterator;
+      using const_iterator  = typename std::vector<TEntry>::const_iterator;
+
+      CPP_PC__INLINE TEntry * find (std::size_t start) noexcept
+      {
+        if (entries.empty ())
+        {
+          return nullptr;
+        }
+
+        auto mask = slots.size () - 1;
+        for (auto slot = hash (start) & mask; slots[slot] != 0; slot = (slot + 1) & mask)
+        {
+          auto & e = entries[slots[slot] - 1];
+          if (e.start == start)
+          {
+            return &e;
+          }
+        }
+
+        return nullptr;
+      }
+
+      // Replaces the entry with the same start if there is one
+      void insert (TEntry e)
+      {
+        auto existing = find (e.start);
+        if (existing)
+        {
+          *existing = std::move (e);
+          return;
+        }
+
+        entries.push_back (std::move (e));
+        if (2*entries.size () > slots.size ())
+        {
+          rehash (4*entries.size ());
+        }
+        else
+        {
+          place (entries.size () - 1);
+        }
+      }
+
+      void reserve (std::size_t sz)
+      {
+        entries.reserve (sz);
+      }
+
+      CPP_PC__INLINE std::size_t size () const noexcept
+      {
+        return entries.size ();
+      }
+
+      CPP_PC__INLINE bool empty () const noexcept
+      {
+        return entries.empty ();
+      }
+
+      void clear () noexcept
+      {
+        entries.clear ();
+        std::fill (slots.begin (), slots.end (), 0U);
+      }
+
+      void swap (memo_entries & o) noexcept
+      {
+        entries.swap (o.entries);
+        slots.swap (o.slots);
+      }
+
+      CPP_PC__INLINE iterator begin () noexcept
+      {
+        return entries.begin ();
+      }
+
+      CPP_PC__INLINE iterator end () noexcept
+      {
+        return entries.end ();
+      }
+
+    private:
+      static CPP_PC__INLINE std::size_t hash (std::size_t start) noexcept
+      {
+        // Fibonacci hashing spreads consecutive positions over the table
+        return static_cast<std::size_t> ((static_cast<std::uint64_t> (start) * 0x9E3779B97F4A7C15ULL) >> 20);
+      }
+
+      void place (std::size_t index) noexcept
+      {
+        auto mask = slots.size () - 1;
+        auto slot = hash (entries[index].start) & mask;
+        for (; slots[slot] != 0; slot = (slot + 1) & mask)
+          ;
+        slots[slot] = index + 1;
+      }
+
+      void rehash (std::size_t capacity)
+      {
+        auto sz = std::size_t (16);
+        for (; sz < capacity; sz *= 2)
+          ;
+
+        slots.assign (sz, 0U);
+        for (auto iter = 0U; iter < entries.size (); ++iter)
+        {
+          place (iter);
+        }
+      }
+
+      std::vector<TEntry>       entries ;
+      std::vector<std::size_t>  slots   ; // Index + 1 into entries, 0 is empty
+    };
+
+    struct memo_edit
+    {
+      std::size_t begin     ;
+      std::size_t end       ;
+      std::size_t inserted  ;
+
+      // Maps a position before the edit to a position after it
+      CPP_PC__INLINE std::size_t shift (std::size_t position) const noexcept
+      {
+        return position - end + begin + inserted;
+      }
+    };
+
+    // The number of edits the stable entries of a memo table lag behind
+    //  before they are brought up to date
+    std::size_t const memo_edits_per_compaction = 64;
+
+    // Entries are kept in two maps. fresh holds the entries recorded since
+    //  the last compaction in current positions and is updated eagerly on
+    //  each edit, it only holds what was re-parsed so it is small. stable
+    //  holds the bulk of the entries in positions as of the last compaction,
+    //  edits since then are kept in a list and applied on lookup. This way
+    //  an edit costs O(fresh entries) and the O(entries) compaction is
+    //  amortized over memo_edits_per_compaction edits.
+    //  Entries that examined the end of the input are kept in open, edits
+    //  after everything else was examined (ie appends) only update open
+    template<typename TValue>
+    struct memo_table : base_memo_table
+    {
+      struct entry
+      {
+        std::size_t start     ; // Start position of the rule, also the key
+        std::size_t position  ; // Position of the result
+        std::size_t examined  ; // The result depends on the characters [start, examined)
+        opt<TValue> value     ;
+
+        // Returns false if the edit invalidates the entry
+        CPP_PC__INLINE bool apply (memo_edit const & e) noexcept
+        {
+          if (examined <= e.begin)
+          {
+            return true;
+          }
+          else if (start >= e.end)
+          {
+            start     = e.shift (start);
+            position  = e.shift (position);
+            examined  = e.shift (examined);
+            return true;
+          }
+          else
+          {
+            return false;
+          }
+        }
+      };
+
+      using entries_type = memo_entries<entry>;
+
+      memo_table ()
+        : closed_examined (0)
+      {
+      }
+
+      CPP_PC__INLINE bool find (std::size_t position, entry & result)
+      {
+        auto ffind = fresh.find (position);
+        if (ffind)
+        {
+          result = *ffind;
+          return true;
+        }
+
+        auto ofind = open.find (position);
+        if (ofind)
+        {
+          result = *ofind;
+          return true;
+        }
+
+        if (stable.empty ())
+        {
+          return false;
+        }
+
+        // Maps position back to where it was before the pending edits
+        auto stored = position;
+        for (auto iter = edits.rbegin (); iter != edits.rend (); ++iter)
+        {
+          if (stored < iter->begin)
+          {
+            continue;
+          }
+          else if (stored < iter->begin + iter->inserted)
+          {
+            // Inside inserted characters
+            return false;
+          }
+          else
+          {
+            stored = stored - iter->inserted + iter->end - iter->begin;
+          }
+        }
+
+        auto sfind = stable.find (stored);
+        if (!sfind)
+        {
+          return false;
+        }
+
+        result = *sfind;
+        for (auto && e : edits)
+        {
+          if (!result.apply (e))
+          {
+            // Dropped by the next compaction
+            return false;
+          }
+        }
+
+        return true;
+      }
+
+      // at_end is true if the entry examined the end of the input
+      CPP_PC__INLINE void insert (entry e, bool at_end)
+      {
+        if (at_end)
+        {
+          open.insert (std::move (e));
+        }
+        else
+        {
+          closed_examined = std::max (closed_examined, e.examined);
+          fresh.insert (std::move (e));
+        }
+      }
+
+      void edit (std::size_t begin, std::size_t end, std::size_t inserted) override
+      {
+        auto e = memo_edit { begin, end, inserted };
+
+        apply (open, &e, &e + 1);
+
+        // No other entry examined the edited characters, this is the case
+        //  when appending
+        if (begin >= closed_examined)
+        {
+          return;
+        }
+
+        closed_examined = std::max (closed_examined, e.shift (closed_examined));
+
+        // After the first parse all entries are fresh, compact only swaps
+        //  them into stable then
+        if (fresh.size () > stable.size ())
+        {
+          compact ();
+        }
+
+        apply (fresh, &e, &e + 1);
+
+        edits.push_back (e);
+        if (edits.size () >= memo_edits_per_compaction)
+        {
+          compact ();
+        }
+      }
+
+      std::size_t size () const noexcept override
+      {
+        return fresh.size () + open.size () + stable.size ();
+      }
+
+    private:
+      static void apply (entries_type & entries, memo_edit const * begin, memo_edit const * end)
+      {
+        entries_type shifted;
+        shifted.reserve (entries.size ());
+
+        for (auto && v : entries)
+        {
+          auto valid  = true;
+          for (auto e = begin; e != end; ++e)
+          {
+            if (!v.apply (*e))
+            {
+              valid = false;
+              break;
+            }
+          }
+
+          if (valid)
+          {
+            shifted.insert (std::move (v));
+          }
+        }
+
+        entries.swap (shifted);
+      }
+
+      void compact ()
+      {
+        if (!edits.empty ())
+        {
+          apply (stable, edits.data (), edits.data () + edits.size ());
+          edits.clear ();
+        }
+
+        if (stable.empty ())
+        {
+          stable.swap (fresh);
+        }
+        else
+        {
+          for (auto && v : fresh)
+          {
+            stable.insert (std::move (v));
+          }
+          fresh.clear ();
+        }
+      }
+
+      entries_type            fresh           ;
+      entries_type            stable          ;
+      std::vector<memo_edit>  edits           ;
+      // Entries that examined the end of the input
+      entries_type            open            ;
+      // An upper bound of examined for the entries in fresh and stable
+      std::size_t             closed_examined ;
+    };
+
+    CPP_PC__INLINE std::size_t next_memo_rule () noexcept
+    {
+      static std::atomic<std::size_t> rule (0);
+      return rule++;
+    }
+
+    // One table per pmemo rule, indexed by rule id
+    using memo_tables = std::vector<base_memo_table::ptr>;
+  }
+
+  // A state that records how far the input was examined, this lets pmemo
+  //  know which characters its results depend on. When tables is nullptr
+  //  pmemo doesn't use memoization, this is used when collecting errors
+  struct memo_state : state
+  {
+    memo_state (std::size_t error_position, char const * begin, char const * end, detail::memo_tables * tables) noexcept
+      : state     (error_position, begin, end)
+      , tables    (tables)
+      , examined  (0)
+    {
+    }
+
+    CPP_PC__INLINE int peek (std::size_t position) const noexcept
+    {
+      examined = std::max (examined, position + 1);
+      return state::peek (position);
+    }
+
+    template<typename TSatisfyFunction>
+    CPP_PC__INLINE sub_string satisfy (
+        std::size_t position
+      , std::size_t at_most
+      , TSatisfyFunction && satisfy_function
+      ) const noexcept
+    {
+      auto result = state::satisfy (position, at_most, std::forward<TSatisfyFunction> (satisfy_function));
+      // The character that stopped satisfy was examined as well
+      examined = std::max (examined, static_cast<std::size_t> (result.end - begin) + 1);
+      return result;
+    }
+
+    template<typename TSatisfyFunction>
+    CPP_PC__INLINE std::size_t skip_satisfy (
+        std::size_t position
+      , std::size_t at_most
+      , TSatisfyFunction && satisfy_function
+      ) const noexcept
+    {
+      return satisfy (position, at_most, std::forward<TSatisfyFunction> (satisfy_function)).size ();
+    }
+
+    detail::memo_tables *       tables    ;
+    std::size_t mutable         examined  ;
+  };
+
+  namespace detail
+  {
+    template<typename TParser>
+    struct pmemo_function
+    {
+      using value_type  = parser_value_type_t<TParser>  ;
+      using table_type  = memo_table<value_type>        ;
+      using result_type = result<value_type>            ;
+
+      TParser     t     ;
+      std::size_t rule  ;
+
+      template<typename TState>
+      CPP_PC__INLINE result_type operator () (TState const & s, std::size_t position) const
+      {
+        return t.parser_function (s, position);
+      }
+
+      result_type operator () (memo_state const & s, std::size_t position) const
+      {
+        if (!s.tables)
+        {
+          return t.parser_function (s, position);
+        }
+
+        auto & memo = table (*s.tables);
+
+        typename table_type::entry e { 0, 0, 0, empty_opt };
+        if (memo.find (position, e))
+        {
+          s.examined  = std::max (s.examined, e.examined);
+
+          result_type result (e.position);
+          result.value = std::move (e.value);
+          return result;
+        }
+
+        auto outer  = s.examined;
+        s.examined  = position;
+
+        auto tv = t.parser_function (s, position);
+
+        auto examined = std::max<std::size_t> (s.examined, tv.position);
+        auto at_end   = examined > static_cast<std::size_t> (s.end - s.begin);
+
+        // A committed failure (see pcut) fails the whole parse, it's not
+        //  memoized as the entry doesn't record that it was committed
+        if (!s.committed)
+        {
+          memo.insert (typename table_type::entry { position, tv.position, examined, tv.value }, at_end);
+        }
+
+        s.examined  = std::max (outer, examined);
+
+        return tv;
+      }
+
+    private:
+      table_type & table (memo_tables & tables) const
+      {
+        if (tables.size () <= rule)
+        {
+          tables.resize (rule + 1);
+        }
+
+        auto & table = tables[rule];
+        if (!table)
+        {
+          table.reset (new table_type ());
+        }
+
+        return static_cast<table_type &> (*table);
+      }
+    };
+  }
+
+  // Memoizes the results of t per position when parsing with a memo_state,
+  //  with any other state pmemo just invokes t
+  template<typename TParser>
+  CPP_PC__INLINE auto pmemo (TParser && t)
+  {
+    CPP_PC__CHECK_PARSER (t);
+
+    using function_type = detail::pmemo_function<detail::strip_type_t<TParser>>;
+
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser>> (
+      function_type { std::forward<TParser> (t), detail::next_memo_rule () });
+  }
+
+  // A document that is edited and re-parsed, see pmemo. The grammar must run
+  //  on memo_state, ie its trampolines are created with memo_state
+  template<typename TValueType, typename TParserFunction, typename TState>
+  struct incremental_document
+  {
+    using parser_type = parser<TValueType, TParserFunction, TState>;
+
+    CPP_PC__NO_COPY_MOVE (incremental_document);
+
+    incremental_document (parser_type p, std::string text)
+      : p             (std::move (p))
+      , text          (std::move (text))
+      , last_examined (0)
+    {
+    }
+
+    CPP_PC__INLINE std::string const & str () const noexcept
+    {
+      return text;
+    }
+
+    // The furthest position examined by the last parse, a value greater
+    //  than the size means that the end of the text was examined
+    CPP_PC__INLINE std::size_t examined () const noexcept
+    {
+      return last_examined;
+    }
+
+    // Replaces erase characters at position with [begin, end)
+    void edit (std::size_t position, std::size_t erase, char const * begin, char const * end)
+    {
+      CPP_PC__ASSERT (position <= text.size ());
+      CPP_PC__ASSERT (begin <= end);
+
+      auto inserted = static_cast<std::size_t> (end - begin);
+
+      erase = std::min (erase, text.size () - position);
+      text.replace (position, erase, begin, inserted);
+
+      for (auto && table : tables)
+      {
+        if (table)
+        {
+          table->edit (position, position + erase, inserted);
+        }
+      }
+    }
+
+    // Replaces erase characters at position with inserted
+    void edit (std::size_t position, std::size_t erase, std::string const & inserted)
+    {
+      auto begin  = inserted.c_str ();
+      auto end    = begin + inserted.size ();
+
+      edit (position, erase, begin, end);
+    }
+
+    // Parses the document using the memo tables but doesn't collect errors
+    result<TValueType> parse_memoized ()
+    {
+      auto begin  = text.c_str ();
+      auto end    = begin + text.size ();
+
+      memo_state s (SIZE_MAX, begin, end, &tables);
+      auto v = p.parser_function (s, 0);
+
+      last_examined = std::max<std::size_t> (s.examined, v.position);
+
+      return v;
+    }
+
+    // Parses the document, results of rules that weren't affected by edits
+    //  since the previous parse are reused
+    //  On failure the error pass re-parses without memoization, so error
+    //  messages are the same as for parse
+    parse_result<TValueType> parse ()
+    {
+      auto v = parse_memoized ();
+      if (v.value)
+      {
+        return parse_result<TValueType> (v.position, std::move (v.value), std::string ());
+      }
+      else
+      {
+        auto begin  = text.c_str ();
+        auto end    = begin + text.size ();
+
+        memo_state es (v.position, begin, end, nullptr);
+        auto ev = p.parser_function (es, 0);
+
+        CPP_PC__ASSERT (v.position == ev.position);
+        CPP_PC__ASSERT (!ev.value);
+
+        return parse_result<TValueType> (ev.position, empty_opt, es.error_description ());
+      }
+    }
+
+    // The number of memoized results, mainly for diagnostics
+    std::size_t memo_size () const noexcept
+    {
+      auto sz = std::size_t ();
+      for (auto && table : tables)
+      {
+        if (table)
+        {
+          sz += table->size ();
+        }
+      }
+      return sz;
+    }
+
+  private:
+    parser_type         p             ;
+    std::string         text          ;
+    detail::memo_tables tables        ;
+    std::size_t         last_examined ;
+  };
+
+  template<typename TValueType, typename TParserFunction, typename TState>
+  CPP_PC__INLINE auto make_incremental_document (parser<TValueType, TParserFunction, TState> const & p, std::string text)
+  {
+    return std::make_unique<incremental_document<TValueType, TParserFunction, TState>> (p, std::move (text));
+  }
+}
+// ----------------------------------------------------------------------------
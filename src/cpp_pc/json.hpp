@@ -0,0 +1,2776 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#pragma once
+// ----------------------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+// ----------------------------------------------------------------------------
+#include "pc.hpp"
+#include "structural.hpp"
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+// JSON (http://json.org/): the grammar parsing documents into json_ast values
+//  and the representations built on it; SAX events, a flat tape, json_node,
+//  a writer, lazily parsed values and path selection
+// ----------------------------------------------------------------------------
+namespace cpp_pc
+{
+  namespace json
+  {
+    struct json_ast
+    {
+      using ptr = std::shared_ptr<json_ast> ;
+      json_ast ()                             = default;
+      json_ast (json_ast const &)             = delete ;
+      json_ast (json_ast &&)                  = delete ;
+      json_ast & operator = (json_ast const &)= delete ;
+      json_ast & operator = (json_ast &&)     = delete ;
+      virtual ~json_ast ()                    = default;
+
+      virtual void build_string (std::ostream & o) const = 0;
+      virtual bool is_equal_to (json_ast::ptr const & o) const = 0;
+    };
+
+    inline std::string to_string (json_ast::ptr const & json)
+    {
+      std::stringstream ss;
+
+      if (json)
+      {
+        json->build_string (ss);
+      }
+      else
+      {
+        ss << "[]";
+      }
+
+      return ss.str ();
+    }
+
+    struct json_null : json_ast
+    {
+      json_null () = default;
+
+      void build_string (std::ostream & o) const override
+      {
+        o << "null";
+      }
+
+      bool is_equal_to (json_ast::ptr const & o) const override
+      {
+        auto other = std::dynamic_pointer_cast<json_null> (o);
+
+        return !!other;
+      }
+
+      static json_ast::ptr create ()
+      {
+        return std::make_shared<json_null> ();
+      }
+    };
+
+    struct json_boolean : json_ast
+    {
+      using value_type = bool;
+
+      json_boolean (value_type v)
+        : value (v)
+      {
+      }
+
+      value_type const value;
+
+      void build_string (std::ostream & o) const override
+      {
+        o << (value ? "true" : "false");
+      }
+
+      bool is_equal_to (json_ast::ptr const & o) const override
+      {
+        auto other = std::dynamic_pointer_cast<json_boolean> (o);
+        if (!other)
+        {
+          return false;
+        }
+
+        return value == other->value;
+      }
+
+      static json_ast::ptr create (value_type v)
+      {
+        return std::make_shared<json_boolean> (v);
+      }
+    };
+
+    struct json_number : json_ast
+    {
+      using value_type = double;
+
+      json_number (value_type v)
+        : value (v)
+      {
+      }
+
+      value_type const value;
+
+      void build_string (std::ostream & o) const override
+      {
+        o << value;
+      }
+
+      bool is_equal_to (json_ast::ptr const & o) const override
+      {
+        auto other = std::dynamic_pointer_cast<json_number> (o);
+        if (!other)
+        {
+          return false;
+        }
+
+        return value == other->value;
+      }
+
+      static json_ast::ptr create (value_type v)
+      {
+        return std::make_shared<json_number> (v);
+      }
+    };
+
+    struct json_string : json_ast
+    {
+      using value_type = std::string;
+
+      json_string (value_type v)
+        : value (std::move (v))
+      {
+      }
+
+      value_type const value;
+
+      void build_string (std::ostream & o) const override
+      {
+        // TODO: Add escaping
+        o << '"' << value << '"';
+      }
+
+      bool is_equal_to (json_ast::ptr const & o) const override
+      {
+        auto other = std::dynamic_pointer_cast<json_string> (o);
+        if (!other)
+        {
+          return false;
+        }
+
+        return value == other->value;
+      }
+
+      static json_ast::ptr create (value_type v)
+      {
+        return std::make_shared<json_string> (std::move (v));
+      }
+    };
+
+    struct json_array : json_ast
+    {
+      using value_type = std::vector<json_ast::ptr>;
+
+      json_array (value_type v)
+        : value (std::move (v))
+      {
+      }
+
+      value_type const value;
+
+      void build_string (std::ostream & o) const override
+      {
+        auto prepend = "";
+        o << '[';
+
+        for (auto && v : value)
+        {
+          o << prepend;
+          if (v)
+          {
+            v->build_string (o);
+          }
+          else
+          {
+            o << "null";
+          }
+          prepend = ", ";
+        }
+
+        o << ']';
+      }
+
+      bool is_equal_to (json_ast::ptr const & o) const override
+      {
+        auto other = std::dynamic_pointer_cast<json_array> (o);
+        if (!other)
+        {
+          return false;
+        }
+
+        return
+          std::equal (
+              value.begin ()
+            , value.end ()
+            , other->value.begin ()
+            , other->value.end ()
+            , [] (auto && l, auto && r) -> bool
+            {
+              if (!l || !r)
+              {
+                return !l && !r;
+              }
+
+              return l->is_equal_to (r);
+            });
+      }
+
+      static json_ast::ptr create (value_type v)
+      {
+        return std::make_shared<json_array> (std::move (v));
+      }
+    };
+
+    struct json_object : json_ast
+    {
+      using value_type = std::vector<std::tuple<std::string, json_ast::ptr>>;
+
+      json_object (value_type v)
+        : value (std::move (v))
+      {
+      }
+
+      value_type const value;
+
+      void build_string (std::ostream & o) const override
+      {
+        auto prepend = "";
+        o << '{';
+
+        for (auto && kv : value)
+        {
+          auto & k = std::get<0> (kv);
+          auto & v = std::get<1> (kv);
+
+          o << prepend;
+
+          // TODO: Add escaping
+          o << '"' << k << '"' << ':';
+
+          if (v)
+          {
+            v->build_string (o);
+          }
+          else
+          {
+            o << "null";
+          }
+
+          prepend = ", ";
+        }
+
+        o << '}';
+      }
+
+      bool is_equal_to (json_ast::ptr const & o) const override
+      {
+        auto other = std::dynamic_pointer_cast<json_object> (o);
+        if (!other)
+        {
+          return false;
+        }
+
+        return
+          std::equal (
+              value.begin ()
+            , value.end ()
+            , other->value.begin ()
+            , other->value.end ()
+            , [] (auto && l, auto && r) -> bool
+            {
+              auto lk = std::get<0> (l);
+              auto rk = std::get<0> (r);
+              auto lv = std::get<1> (l);
+              auto rv = std::get<1> (r);
+
+              if (lk != rk)
+              {
+                return false;
+              }
+
+              if (!lv || !rv)
+              {
+                return !lv && !rv;
+              }
+
+              return lv->is_equal_to (rv);
+            });
+      }
+
+      static json_ast::ptr create (value_type v)
+      {
+        return std::make_shared<json_object> (std::move (v));
+      }
+    };
+
+    constexpr auto satisfy_char (std::size_t, char ch)
+    {
+      return ch != '"' && ch != '\\';
+    }
+
+    inline auto map_escaped (char ch)
+    {
+      switch (ch)
+      {
+      case '"':
+        return '"';
+      case '\\':
+        return '\\';
+      case '/':
+        return '/';
+      case 'b':
+        return '\b';
+      case 'f':
+        return '\f';
+      case 'n':
+        return '\n';
+      case 'r':
+        return '\r';
+      case 't':
+        return '\t';
+      default:
+        CPP_PC__ASSERT (false);
+        return ch;
+      };
+    }
+
+    // A string is a run of unescaped characters followed by escaped
+    //  characters each followed by a run. Without escapes the string is
+    //  copied from the input in one go, otherwise into a buffer sized up front
+    inline std::string map_chars (std::tuple<sub_string, std::vector<std::tuple<char, sub_string>>> const & v)
+    {
+      auto & run      = std::get<0> (v);
+      auto & escaped  = std::get<1> (v);
+
+      if (escaped.empty ())
+      {
+        return run.str ();
+      }
+
+      auto size = run.size ();
+      for (auto && e : escaped)
+      {
+        size += 1 + std::get<1> (e).size ();
+      }
+
+      std::string result;
+      result.reserve (size);
+
+      result.append (run.begin, run.end);
+      for (auto && e : escaped)
+      {
+        auto & r = std::get<1> (e);
+        result.push_back (std::get<0> (e));
+        result.append (r.begin, r.end);
+      }
+
+      return result;
+    }
+
+    auto const number_to_double = [] (auto && v)
+      {
+        auto calculate_fraction = [] (auto && frac)
+          {
+            auto i = static_cast<double> (std::get<0> (frac));
+            auto s = std::get<1> (frac);
+            return i / std::pow (10.0, s);
+          };
+
+        auto calculate_exponent = [] (auto && exp)
+          {
+            auto sign   = (std::get<0> (exp).coalesce ('+') == '+') ? 1.0 : -1.0;
+            auto e      = std::get<1> (exp);
+            return std::pow (10.0, sign*e);
+          };
+
+        auto sign = std::get<0> (v) ? -1.0 : 1.0;
+        auto i    = static_cast<double> (std::get<1> (v));
+        auto ofrac= std::get<2> (v);
+        auto frac =
+            ofrac
+          ? calculate_fraction (ofrac.get ())
+          : 0.0
+          ;
+        auto oexp = std::get<3> (v);
+        auto exp =
+            oexp
+          ? calculate_exponent (oexp.get ())
+          : 1.0
+          ;
+
+        return sign * (i + frac) * exp;
+      };
+
+    auto const map_number = [] (auto && v)
+      {
+        return json_number::create (number_to_double (v));
+      };
+
+    auto const json_null_value  = json_null::create ();
+    auto const json_true_value  = json_boolean::create (true);
+    auto const json_false_value = json_boolean::create (false);
+
+    // memo is applied to values, the incremental grammar uses it to memoize
+    //  them with pmemo
+    template<typename TState, typename TMemo>
+    auto make_json_grammar (TMemo && memo)
+    {
+      // JSON specification: http://json.org/
+      auto parray_trampoline  = create_trampoline<json_ast::ptr, TState> ();
+      auto parray             = ptrampoline<json_ast::ptr, TState> (parray_trampoline);
+
+      auto pobject_trampoline = create_trampoline<json_ast::ptr, TState> ();
+      auto pobject            = ptrampoline<json_ast::ptr, TState> (pobject_trampoline);
+
+      // Runs of unescaped characters are scanned for '"' and '\\' several
+      //  characters at a time
+      auto prun     = psatisfy ("char", 0, SIZE_MAX, none_of ('"', '\\'));
+      auto pescaped = pskip_char ('\\') < pmap (pany_of ("\"\\/bfnrt"), map_escaped);
+      // TODO: Handle unicode escaping (\u)
+      auto pchars   = pbetween (pskip_char ('"'), pmap (ptuple (prun, pmany (ptuple (pescaped, prun))), map_chars), pskip_char ('"'));
+      auto pstring  = pmap (pchars, json_string::create);
+
+      auto pfrac    = popt (pskip_char ('.') < praw_uint64);
+      auto psign    = popt (pany_of ("+-"));
+      auto pexp     = popt (pany_of ("eE") < ptuple (psign, pint));
+      // TODO: Handle that 0123 is not allowed
+      auto pnumber  = pmap (ptuple (popt (pskip_char ('-')), puint64, pfrac, pexp), map_number);
+
+      auto ptrue    = pskip_string ("true")   < preturn (json_true_value);
+
+      auto pfalse   = pskip_string ("false")  < preturn (json_false_value);
+
+      auto pnull    = pskip_string ("null")   < preturn (json_null_value);
+
+      auto pvalue   = memo (pchoice (pstring, pnumber, ptrue, pfalse, pnull, parray, pobject) > pskip_ws);
+
+      auto pvalues  = pmany_sepby (pvalue, pskip_char (',') > pskip_ws);
+      // The opening bracket identifies the value, pcut stops pvalue from
+      //  trying other alternatives once it's matched
+      auto parray_  = pmap (pbetween (pskip_char ('[') > pskip_ws, pcut (pvalues), pcut (pskip_char (']') > pskip_ws)), json_array::create);
+
+      auto pmember  = ptuple (pchars > pskip_ws > pcut (pskip_char (':') > pskip_ws), pcut (pvalue));
+      auto pmembers = pmany_sepby (pmember, pskip_char (',') > pskip_ws);
+      auto pobject_ = pmap (pbetween (pskip_char ('{') > pskip_ws, pcut (pmembers), pcut (pskip_char ('}') > pskip_ws)), json_object::create);
+
+      parray_trampoline->trampoline   = parray_.parser_function;
+      pobject_trampoline->trampoline  = pobject_.parser_function;
+
+      auto pjson    = pskip_ws < pchoice (parray, pobject) > pskip_ws > peos;
+
+      return std::make_tuple (pvalue, pjson, pchars, pnumber);
+    }
+
+    auto const json_grammar = make_json_grammar<state> ([] (auto && p) { return p; });
+
+    auto const pjson_value  = std::get<0> (json_grammar);
+    auto const pjson        = std::get<1> (json_grammar);
+    auto const pjson_chars  = std::get<2> (json_grammar);
+    auto const pjson_number = std::get<3> (json_grammar);
+
+    // The grammar over a structural_state, string runs and whitespace are
+    //  skipped using a structural index of the document
+    auto const pjson_indexed = std::get<1> (make_json_grammar<structural_state> ([] (auto && p) { return p; }));
+
+    // index is rebuilt for the document, reusing it keeps its capacity
+    inline auto parse_json_indexed (structural_index & index, char const * begin, char const * end)
+    {
+      build_structural_index (begin, end, index);
+      return parse_indexed (pjson_indexed, begin, end, index);
+    }
+
+    inline auto parse_json_indexed (structural_index & index, std::string const & i)
+    {
+      auto begin = i.c_str ();
+      return parse_json_indexed (index, begin, begin + i.size ());
+    }
+
+    // SAX: the events of a document are delivered to a handler as it's parsed
+    //  rather than building json_ast values. Strings and keys are views into
+    //  the input, or into a buffer of the state for strings with escapes, so
+    //  documents without escapes are parsed without allocating
+    struct json_sax_handler
+    {
+      CPP_PC__NO_COPY_MOVE (json_sax_handler);
+
+      json_sax_handler ()           = default;
+      virtual ~json_sax_handler ()  = default;
+
+      virtual void start_object ()                  = 0;
+      virtual void key (sub_string k)               = 0;
+      virtual void end_object ()                    = 0;
+      virtual void start_array ()                   = 0;
+      virtual void end_array ()                     = 0;
+      virtual void string (sub_string v)            = 0;
+      // text is the number as it appears in the input
+      virtual void number (double v, sub_string text) = 0;
+      virtual void boolean (bool v)                 = 0;
+      virtual void null ()                          = 0;
+    };
+
+    // handler is null while errors are collected so that the events of a
+    //  document are only delivered once
+    struct json_sax_state : state
+    {
+      json_sax_state (std::size_t error_position, char const * begin, char const * end, json_sax_handler * handler)
+        : state   (error_position, begin, end)
+        , handler (handler)
+      {
+      }
+
+      json_sax_handler *  handler ;
+      std::string mutable buffer  ;
+    };
+
+    // The unescaped string, raw if it has no escapes otherwise buffer
+    inline sub_string unescape (sub_string raw, std::string & buffer)
+    {
+      auto escape = static_cast<char const *> (std::memchr (raw.begin, '\\', raw.size ()));
+      if (!escape)
+      {
+        return raw;
+      }
+
+      buffer.assign (raw.begin, escape);
+      for (auto iter = escape; iter < raw.end; ++iter)
+      {
+        if (*iter == '\\')
+        {
+          ++iter;
+          buffer.push_back (map_escaped (*iter));
+        }
+        else
+        {
+          buffer.push_back (*iter);
+        }
+      }
+
+      auto begin = buffer.c_str ();
+      return sub_string (begin, begin + buffer.size ());
+    }
+
+    // True if each '\\' in raw starts an escape unescape accepts, raw comes
+    //  from a scanner rather than the grammar
+    inline bool valid_escapes (sub_string raw) noexcept
+    {
+      for (auto iter = raw.begin; iter < raw.end; ++iter)
+      {
+        if (*iter == '\\' && (++iter == raw.end || !std::memchr ("\"\\/bfnrt", *iter, 8)))
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    // Invokes event (state, consumed, value) when t succeeds
+    template<typename TParser, typename TEvent>
+    auto psax_event (TParser && t, TEvent && event)
+    {
+      return detail::adapt_parser_function<json_sax_state> (
+        [t = std::forward<TParser> (t), event = std::forward<TEvent> (event)] (auto const & s, std::size_t position)
+        {
+          using result_type = result<unit_type>;
+
+          auto tv = t.parser_function (s, position);
+          if (!tv.value)
+          {
+            return result_type::failure (tv.position);
+          }
+
+          if (s.handler)
+          {
+            event (s, sub_string (s.begin + position, s.begin + tv.position), tv.value.get ());
+          }
+
+          return result_type::success (tv.position, unit);
+        });
+    }
+
+    // The SAX grammar mirrors make_json_grammar, values are skipped with the
+    //  pskip combinators so nothing is collected
+    inline auto make_json_sax_grammar ()
+    {
+      using TState = json_sax_state;
+
+      auto parray_trampoline  = create_trampoline<unit_type, TState> ();
+      auto parray             = ptrampoline<unit_type, TState> (parray_trampoline);
+
+      auto pobject_trampoline = create_trampoline<unit_type, TState> ();
+      auto pobject            = ptrampoline<unit_type, TState> (pobject_trampoline);
+
+      auto prun     = pskip_satisfy ("char", 0, SIZE_MAX, none_of ('"', '\\'));
+      auto pescaped = pskip_char ('\\') < pany_of ("\"\\/bfnrt");
+      auto pchars   = prun < pskip_many (pescaped < prun);
+      auto pstring  = pskip_char ('"') < psax_event (pchars, [] (auto const & s, sub_string raw, unit_type) { s.handler->string (unescape (raw, s.buffer)); }) > pskip_char ('"');
+      auto pkey     = pskip_char ('"') < psax_event (pchars, [] (auto const & s, sub_string raw, unit_type) { s.handler->key (unescape (raw, s.buffer)); }) > pskip_char ('"');
+
+      auto pfrac    = popt (pskip_char ('.') < praw_uint64);
+      auto psign    = popt (pany_of ("+-"));
+      auto pexp     = popt (pany_of ("eE") < ptuple (psign, pint));
+      auto pnumber  = psax_event (
+          pmap (ptuple (popt (pskip_char ('-')), puint64, pfrac, pexp), number_to_double)
+        , [] (auto const & s, sub_string text, double v) { s.handler->number (v, text); }
+        );
+
+      auto ptrue    = psax_event (pskip_string ("true") , [] (auto const & s, sub_string, unit_type) { s.handler->boolean (true); });
+      auto pfalse   = psax_event (pskip_string ("false"), [] (auto const & s, sub_string, unit_type) { s.handler->boolean (false); });
+      auto pnull    = psax_event (pskip_string ("null") , [] (auto const & s, sub_string, unit_type) { s.handler->null (); });
+
+      auto pvalue   = pchoice (pstring, pnumber, ptrue, pfalse, pnull, parray, pobject) > pskip_ws;
+
+      auto pvalues  = pskip_many_sepby (pvalue, pskip_char (',') > pskip_ws);
+      auto pbegin_a = psax_event (pskip_char ('['), [] (auto const & s, sub_string, unit_type) { s.handler->start_array (); });
+      auto pend_a   = psax_event (pskip_char (']'), [] (auto const & s, sub_string, unit_type) { s.handler->end_array (); });
+      auto parray_  = pbetween (pbegin_a > pskip_ws, pcut (pvalues), pcut (pend_a > pskip_ws));
+
+      auto pmember  = pkey > pskip_ws > pcut (pskip_char (':') > pskip_ws) > pcut (pvalue);
+      auto pmembers = pskip_many_sepby (pmember, pskip_char (',') > pskip_ws);
+      auto pbegin_o = psax_event (pskip_char ('{'), [] (auto const & s, sub_string, unit_type) { s.handler->start_object (); });
+      auto pend_o   = psax_event (pskip_char ('}'), [] (auto const & s, sub_string, unit_type) { s.handler->end_object (); });
+      auto pobject_ = pbetween (pbegin_o > pskip_ws, pcut (pmembers), pcut (pend_o > pskip_ws));
+
+      parray_trampoline->trampoline   = parray_.parser_function;
+      pobject_trampoline->trampoline  = pobject_.parser_function;
+
+      auto pjson    = pskip_ws < pchoice (parray, pobject) > pskip_ws > peos;
+
+      return std::make_tuple (pvalue, pjson);
+    }
+
+    auto const json_sax_grammar = make_json_sax_grammar ();
+
+    // Without a handler pjson_sax_value recognizes a value without
+    //  allocating
+    auto const pjson_sax_value  = std::get<0> (json_sax_grammar);
+    auto const pjson_sax        = std::get<1> (json_sax_grammar);
+
+    // Delivers the events of the document to handler, on failure the events
+    //  up to the error have been delivered
+    inline auto parse_json_sax (json_sax_handler & handler, char const * begin, char const * end)
+    {
+      json_sax_state s (SIZE_MAX, begin, end, &handler);
+      auto v = pjson_sax.parser_function (s, 0);
+      if (v.value)
+      {
+        return parse_result<unit_type> (v.position, std::move (v.value), std::string ());
+      }
+
+      json_sax_state es (v.position, begin, end, nullptr);
+      auto ev = pjson_sax.parser_function (es, 0);
+
+      CPP_PC__ASSERT (v.position == ev.position);
+      CPP_PC__ASSERT (!ev.value);
+
+      return parse_result<unit_type> (ev.position, empty_opt, es.error_description ());
+    }
+
+    inline auto parse_json_sax (json_sax_handler & handler, std::string const & i)
+    {
+      auto begin = i.c_str ();
+      return parse_json_sax (handler, begin, begin + i.size ());
+    }
+
+    // Builds json_ast values from the events
+    struct json_sax_builder : json_sax_handler
+    {
+      struct frame
+      {
+        bool                        is_object ;
+        json_array::value_type      values    ;
+        json_object::value_type     members   ;
+        std::string                 key       ;
+      };
+
+      void start_object () override
+      {
+        frames.push_back (frame { true, {}, {}, {} });
+      }
+
+      void key (sub_string k) override
+      {
+        frames.back ().key = k.str ();
+      }
+
+      void end_object () override
+      {
+        auto members = std::move (frames.back ().members);
+        frames.pop_back ();
+        value (json_object::create (std::move (members)));
+      }
+
+      void start_array () override
+      {
+        frames.push_back (frame { false, {}, {}, {} });
+      }
+
+      void end_array () override
+      {
+        auto values = std::move (frames.back ().values);
+        frames.pop_back ();
+        value (json_array::create (std::move (values)));
+      }
+
+      void string (sub_string v) override
+      {
+        value (json_string::create (v.str ()));
+      }
+
+      void number (double v, sub_string) override
+      {
+        value (json_number::create (v));
+      }
+
+      void boolean (bool v) override
+      {
+        value (v ? json_true_value : json_false_value);
+      }
+
+      void null () override
+      {
+        value (json_null_value);
+      }
+
+      void value (json_ast::ptr v)
+      {
+        if (frames.empty ())
+        {
+          result = std::move (v);
+          return;
+        }
+
+        auto & f = frames.back ();
+        if (f.is_object)
+        {
+          f.members.emplace_back (f.key, std::move (v));
+        }
+        else
+        {
+          f.values.push_back (std::move (v));
+        }
+      }
+
+      std::vector<frame>  frames  ;
+      json_ast::ptr       result  ;
+    };
+
+    // Counts the events, for tests and benchmarks that shouldn't allocate
+    struct json_sax_counter : json_sax_handler
+    {
+      void start_object () override                 { ++events; }
+      void key (sub_string) override                { ++events; }
+      void end_object () override                   { ++events; }
+      void start_array () override                  { ++events; }
+      void end_array () override                    { ++events; }
+      void string (sub_string) override             { ++events; }
+      void number (double, sub_string) override     { ++events; }
+      void boolean (bool) override                  { ++events; }
+      void null () override                         { ++events; }
+
+      std::size_t events = 0;
+    };
+
+    // A flat DOM: the values of a document are the entries of one contiguous
+    //  tape in document order. Containers hold the index after their end so
+    //  that they are skipped without visiting their values
+    //
+    //  An entry is a tag in the top 8 bits and a payload in the lower 56 bits
+    //    'n', 't', 'f' null, true and false
+    //    'd'           a number, the next entry holds the bits of the double
+    //    's'           a string, the payload is its offset in strings, the
+    //                  next entry holds its size
+    //    '[', '{'      the start of an array (object), the payload is the
+    //                  index after the matching end
+    //    ']', '}'      the end of an array (object), the payload is the index
+    //                  of the matching start
+    //  The members of an object are a string entry for the key followed by the
+    //  value
+    struct json_tape
+    {
+      static std::uint64_t const payload_mask = (std::uint64_t (1) << 56) - 1;
+
+      static std::uint64_t make_entry (char tag, std::uint64_t payload)
+      {
+        CPP_PC__ASSERT (payload <= payload_mask);
+        return (static_cast<std::uint64_t> (static_cast<unsigned char> (tag)) << 56) | payload;
+      }
+
+      // Keeps the capacity so that a tape can be reused for many documents
+      void clear ()
+      {
+        entries.clear ();
+        strings.clear ();
+      }
+
+      std::vector<std::uint64_t>  entries ;
+      std::string                 strings ;
+    };
+
+    struct json_tape_array  ;
+    struct json_tape_object ;
+
+    struct json_tape_value
+    {
+      char tag () const
+      {
+        return static_cast<char> (tape->entries[index] >> 56);
+      }
+
+      std::uint64_t payload () const
+      {
+        return tape->entries[index] & json_tape::payload_mask;
+      }
+
+      bool is_null () const
+      {
+        return tag () == 'n';
+      }
+
+      bool is_bool () const
+      {
+        return tag () == 't' || tag () == 'f';
+      }
+
+      bool is_number () const
+      {
+        return tag () == 'd';
+      }
+
+      bool is_string () const
+      {
+        return tag () == 's';
+      }
+
+      bool is_array () const
+      {
+        return tag () == '[';
+      }
+
+      bool is_object () const
+      {
+        return tag () == '{';
+      }
+
+      bool as_bool () const
+      {
+        CPP_PC__ASSERT (is_bool ());
+        return tag () == 't';
+      }
+
+      double as_number () const
+      {
+        CPP_PC__ASSERT (is_number ());
+        double v;
+        std::memcpy (&v, &tape->entries[index + 1], sizeof (v));
+        return v;
+      }
+
+      sub_string as_string () const
+      {
+        CPP_PC__ASSERT (is_string ());
+        auto begin = tape->strings.c_str () + payload ();
+        return sub_string (begin, begin + tape->entries[index + 1]);
+      }
+
+      json_tape_array   as_array () const;
+      json_tape_object  as_object () const;
+
+      // The index after the value
+      std::size_t next () const
+      {
+        switch (tag ())
+        {
+        case 'd':
+        case 's':
+          return index + 2;
+        case '[':
+        case '{':
+          return static_cast<std::size_t> (payload ());
+        default:
+          return index + 1;
+        }
+      }
+
+      json_tape const * tape  ;
+      std::size_t       index ;
+    };
+
+    struct json_tape_member
+    {
+      json_tape_value key   ;
+      json_tape_value value ;
+    };
+
+    // The values of a container, the index of an iterator is the value (or
+    //  the key of a member)
+    template<typename TValue, std::size_t Step>
+    struct json_tape_iterator
+    {
+      TValue operator * () const;
+
+      json_tape_iterator & operator ++ ()
+      {
+        for (auto iter = 0U; iter < Step; ++iter)
+        {
+          index = json_tape_value { tape, index }.next ();
+        }
+        return *this;
+      }
+
+      bool operator == (json_tape_iterator const & o) const
+      {
+        return index == o.index;
+      }
+
+      bool operator != (json_tape_iterator const & o) const
+      {
+        return index != o.index;
+      }
+
+      json_tape const * tape  ;
+      std::size_t       index ;
+    };
+
+    template<>
+    inline json_tape_value json_tape_iterator<json_tape_value, 1>::operator * () const
+    {
+      return json_tape_value { tape, index };
+    }
+
+    template<>
+    inline json_tape_member json_tape_iterator<json_tape_member, 2>::operator * () const
+    {
+      json_tape_value key { tape, index };
+      return json_tape_member { key, json_tape_value { tape, key.next () } };
+    }
+
+    template<typename TValue, std::size_t Step>
+    struct json_tape_container
+    {
+      using iterator = json_tape_iterator<TValue, Step>;
+
+      iterator begin () const
+      {
+        return iterator { tape, first };
+      }
+
+      iterator end () const
+      {
+        return iterator { tape, last };
+      }
+
+      bool empty () const
+      {
+        return first == last;
+      }
+
+      json_tape const * tape  ;
+      std::size_t       first ;
+      // The index of the end entry
+      std::size_t       last  ;
+    };
+
+    struct json_tape_array  : json_tape_container<json_tape_value , 1> {};
+    struct json_tape_object : json_tape_container<json_tape_member, 2> {};
+
+    inline json_tape_array json_tape_value::as_array () const
+    {
+      CPP_PC__ASSERT (is_array ());
+      json_tape_array a;
+      a.tape  = tape;
+      a.first = index + 1;
+      a.last  = static_cast<std::size_t> (payload ()) - 1;
+      return a;
+    }
+
+    inline json_tape_object json_tape_value::as_object () const
+    {
+      CPP_PC__ASSERT (is_object ());
+      json_tape_object o;
+      o.tape  = tape;
+      o.first = index + 1;
+      o.last  = static_cast<std::size_t> (payload ()) - 1;
+      return o;
+    }
+
+    inline json_tape_value root (json_tape const & tape)
+    {
+      CPP_PC__ASSERT (!tape.entries.empty ());
+      return json_tape_value { &tape, 0 };
+    }
+
+    // Appends the events to a tape
+    struct json_tape_builder : json_sax_handler
+    {
+      explicit json_tape_builder (json_tape & tape)
+        : tape (tape)
+      {
+      }
+
+      void start_object () override
+      {
+        start ('{');
+      }
+
+      void key (sub_string k) override
+      {
+        string (k);
+      }
+
+      void end_object () override
+      {
+        end ('{', '}');
+      }
+
+      void start_array () override
+      {
+        start ('[');
+      }
+
+      void end_array () override
+      {
+        end ('[', ']');
+      }
+
+      void string (sub_string v) override
+      {
+        tape.entries.push_back (json_tape::make_entry ('s', tape.strings.size ()));
+        tape.entries.push_back (v.size ());
+        tape.strings.append (v.begin, v.end);
+      }
+
+      void number (double v, sub_string) override
+      {
+        std::uint64_t bits;
+        std::memcpy (&bits, &v, sizeof (bits));
+        tape.entries.push_back (json_tape::make_entry ('d', 0));
+        tape.entries.push_back (bits);
+      }
+
+      void boolean (bool v) override
+      {
+        tape.entries.push_back (json_tape::make_entry (v ? 't' : 'f', 0));
+      }
+
+      void null () override
+      {
+        tape.entries.push_back (json_tape::make_entry ('n', 0));
+      }
+
+      void start (char tag)
+      {
+        open.push_back (tape.entries.size ());
+        tape.entries.push_back (json_tape::make_entry (tag, 0));
+      }
+
+      void end (char start_tag, char end_tag)
+      {
+        auto start = open.back ();
+        open.pop_back ();
+
+        // The payload of the start is the index after the end
+        tape.entries[start] = json_tape::make_entry (start_tag, tape.entries.size () + 1);
+        tape.entries.push_back (json_tape::make_entry (end_tag, start));
+      }
+
+      json_tape &               tape  ;
+      // The indices of the containers being built
+      std::vector<std::size_t>  open  ;
+    };
+
+    // Parses a document into tape, the capacity of the tape is reused
+    inline auto parse_json_tape (json_tape & tape, char const * begin, char const * end)
+    {
+      tape.clear ();
+      json_tape_builder builder (tape);
+      return parse_json_sax (builder, begin, end);
+    }
+
+    inline auto parse_json_tape (json_tape & tape, std::string const & i)
+    {
+      auto begin = i.c_str ();
+      return parse_json_tape (tape, begin, begin + i.size ());
+    }
+
+    // Formats the value like json_ast::build_string
+    inline void build_string (std::ostream & o, json_tape_value v)
+    {
+      switch (v.tag ())
+      {
+      case 'n':
+        o << "null";
+        break;
+      case 't':
+      case 'f':
+        o << (v.as_bool () ? "true" : "false");
+        break;
+      case 'd':
+        o << v.as_number ();
+        break;
+      case 's':
+        {
+          auto str = v.as_string ();
+          o << '"';
+          o.write (str.begin, static_cast<std::streamsize> (str.size ()));
+          o << '"';
+        }
+        break;
+      case '[':
+        {
+          auto prepend = "";
+          o << '[';
+          for (auto && e : v.as_array ())
+          {
+            o << prepend;
+            build_string (o, e);
+            prepend = ", ";
+          }
+          o << ']';
+        }
+        break;
+      case '{':
+        {
+          auto prepend = "";
+          o << '{';
+          for (auto && m : v.as_object ())
+          {
+            o << prepend;
+            build_string (o, m.key);
+            o << ':';
+            build_string (o, m.value);
+            prepend = ", ";
+          }
+          o << '}';
+        }
+        break;
+      default:
+        CPP_PC__ASSERT (false);
+        break;
+      }
+    }
+
+    inline std::string to_string (json_tape const & tape)
+    {
+      std::stringstream ss;
+      build_string (ss, root (tape));
+      return ss.str ();
+    }
+
+    struct json_member;
+
+    // A closed representation of JSON values: a tagged union that is visited
+    //  and compared with a switch rather than with virtual calls and dynamic
+    //  casts. Strings use the small string storage of std::string
+    struct json_node
+    {
+      enum class kind : std::uint8_t
+      {
+        null    ,
+        boolean ,
+        number  ,
+        string  ,
+        array   ,
+        object  ,
+      };
+
+      using array_type  = std::vector<json_node>   ;
+      using object_type = std::vector<json_member> ;
+
+      json_node () noexcept
+        : k (kind::null)
+      {
+      }
+
+      explicit json_node (bool v) noexcept
+        : k             (kind::boolean)
+        , boolean_value (v)
+      {
+      }
+
+      explicit json_node (double v) noexcept
+        : k             (kind::number)
+        , number_value  (v)
+      {
+      }
+
+      explicit json_node (std::string v) noexcept
+        : k             (kind::string)
+        , string_value  (std::move (v))
+      {
+      }
+
+      explicit json_node (char const * v)
+        : json_node (std::string (v))
+      {
+      }
+
+      explicit json_node (array_type v) noexcept;
+      explicit json_node (object_type v) noexcept;
+
+      json_node (json_node const & o);
+      json_node (json_node && o) noexcept;
+
+      ~json_node () noexcept;
+
+      json_node & operator = (json_node const & o)
+      {
+        if (this != &o)
+        {
+          json_node copy (o);
+          *this = std::move (copy);
+        }
+        return *this;
+      }
+
+      json_node & operator = (json_node && o) noexcept
+      {
+        if (this != &o)
+        {
+          this->~json_node ();
+          new (this) json_node (std::move (o));
+        }
+        return *this;
+      }
+
+      kind type () const noexcept
+      {
+        return k;
+      }
+
+      bool as_bool () const noexcept
+      {
+        CPP_PC__ASSERT (k == kind::boolean);
+        return boolean_value;
+      }
+
+      double as_number () const noexcept
+      {
+        CPP_PC__ASSERT (k == kind::number);
+        return number_value;
+      }
+
+      std::string const & as_string () const noexcept
+      {
+        CPP_PC__ASSERT (k == kind::string);
+        return string_value;
+      }
+
+      array_type const & as_array () const noexcept
+      {
+        CPP_PC__ASSERT (k == kind::array);
+        return array_value;
+      }
+
+      object_type const & as_object () const noexcept
+      {
+        CPP_PC__ASSERT (k == kind::object);
+        return object_value;
+      }
+
+      // Invokes visitor with nullptr, bool, double, std::string, array_type
+      //  or object_type depending on the kind of the node
+      template<typename TVisitor>
+      auto visit (TVisitor && visitor) const
+      {
+        switch (k)
+        {
+        case kind::boolean:
+          return visitor (boolean_value);
+        case kind::number:
+          return visitor (number_value);
+        case kind::string:
+          return visitor (string_value);
+        case kind::array:
+          return visitor (array_value);
+        case kind::object:
+          return visitor (object_value);
+        case kind::null:
+        default:
+          return visitor (nullptr);
+        }
+      }
+
+    private:
+      kind k;
+
+      union
+      {
+        bool        boolean_value ;
+        double      number_value  ;
+        std::string string_value  ;
+        array_type  array_value   ;
+        object_type object_value  ;
+      };
+    };
+
+    struct json_member
+    {
+      std::string key   ;
+      json_node   value ;
+    };
+
+    inline json_node::json_node (array_type v) noexcept
+      : k           (kind::array)
+      , array_value (std::move (v))
+    {
+    }
+
+    inline json_node::json_node (object_type v) noexcept
+      : k             (kind::object)
+      , object_value  (std::move (v))
+    {
+    }
+
+    inline json_node::json_node (json_node const & o)
+      : k (o.k)
+    {
+      switch (k)
+      {
+      case kind::null:
+        break;
+      case kind::boolean:
+        boolean_value = o.boolean_value;
+        break;
+      case kind::number:
+        number_value = o.number_value;
+        break;
+      case kind::string:
+        new (&string_value) std::string (o.string_value);
+        break;
+      case kind::array:
+        new (&array_value) array_type (o.array_value);
+        break;
+      case kind::object:
+        new (&object_value) object_type (o.object_value);
+        break;
+      }
+    }
+
+    // The moved from node is null
+    inline json_node::json_node (json_node && o) noexcept
+      : k (o.k)
+    {
+      switch (k)
+      {
+      case kind::null:
+        break;
+      case kind::boolean:
+        boolean_value = o.boolean_value;
+        break;
+      case kind::number:
+        number_value = o.number_value;
+        break;
+      case kind::string:
+        new (&string_value) std::string (std::move (o.string_value));
+        break;
+      case kind::array:
+        new (&array_value) array_type (std::move (o.array_value));
+        break;
+      case kind::object:
+        new (&object_value) object_type (std::move (o.object_value));
+        break;
+      }
+
+      o.~json_node ();
+      new (&o) json_node ();
+    }
+
+    inline json_node::~json_node () noexcept
+    {
+      switch (k)
+      {
+      case kind::string:
+        string_value.~basic_string ();
+        break;
+      case kind::array:
+        array_value.~array_type ();
+        break;
+      case kind::object:
+        object_value.~object_type ();
+        break;
+      default:
+        break;
+      }
+    }
+
+    inline bool operator == (json_node const & l, json_node const & r)
+    {
+      if (l.type () != r.type ())
+      {
+        return false;
+      }
+
+      switch (l.type ())
+      {
+      case json_node::kind::null:
+        return true;
+      case json_node::kind::boolean:
+        return l.as_bool () == r.as_bool ();
+      case json_node::kind::number:
+        return l.as_number () == r.as_number ();
+      case json_node::kind::string:
+        return l.as_string () == r.as_string ();
+      case json_node::kind::array:
+        return l.as_array () == r.as_array ();
+      case json_node::kind::object:
+        return
+          std::equal (
+              l.as_object ().begin ()
+            , l.as_object ().end ()
+            , r.as_object ().begin ()
+            , r.as_object ().end ()
+            , [] (json_member const & lm, json_member const & rm)
+            {
+              return lm.key == rm.key && lm.value == rm.value;
+            });
+      default:
+        return false;
+      }
+    }
+
+    inline bool operator != (json_node const & l, json_node const & r)
+    {
+      return !(l == r);
+    }
+
+    // Formats the node like json_ast::build_string
+    inline void build_string (std::ostream & o, json_node const & n)
+    {
+      switch (n.type ())
+      {
+      case json_node::kind::null:
+        o << "null";
+        break;
+      case json_node::kind::boolean:
+        o << (n.as_bool () ? "true" : "false");
+        break;
+      case json_node::kind::number:
+        o << n.as_number ();
+        break;
+      case json_node::kind::string:
+        // TODO: Add escaping
+        o << '"' << n.as_string () << '"';
+        break;
+      case json_node::kind::array:
+        {
+          auto prepend = "";
+          o << '[';
+          for (auto && v : n.as_array ())
+          {
+            o << prepend;
+            build_string (o, v);
+            prepend = ", ";
+          }
+          o << ']';
+        }
+        break;
+      case json_node::kind::object:
+        {
+          auto prepend = "";
+          o << '{';
+          for (auto && m : n.as_object ())
+          {
+            o << prepend << '"' << m.key << '"' << ':';
+            build_string (o, m.value);
+            prepend = ", ";
+          }
+          o << '}';
+        }
+        break;
+      }
+    }
+
+    inline std::string to_string (json_node const & n)
+    {
+      std::stringstream ss;
+      build_string (ss, n);
+      return ss.str ();
+    }
+
+    // Converts json_ast values, null pointers are null
+    inline json_node to_node (json_ast::ptr const & v)
+    {
+      if (auto a = std::dynamic_pointer_cast<json_array> (v))
+      {
+        json_node::array_type values;
+        values.reserve (a->value.size ());
+        for (auto && e : a->value)
+        {
+          values.push_back (to_node (e));
+        }
+        return json_node (std::move (values));
+      }
+      else if (auto o = std::dynamic_pointer_cast<json_object> (v))
+      {
+        json_node::object_type members;
+        members.reserve (o->value.size ());
+        for (auto && m : o->value)
+        {
+          members.push_back (json_member { std::get<0> (m), to_node (std::get<1> (m)) });
+        }
+        return json_node (std::move (members));
+      }
+      else if (auto str = std::dynamic_pointer_cast<json_string> (v))
+      {
+        return json_node (str->value);
+      }
+      else if (auto n = std::dynamic_pointer_cast<json_number> (v))
+      {
+        return json_node (n->value);
+      }
+      else if (auto b = std::dynamic_pointer_cast<json_boolean> (v))
+      {
+        return json_node (b->value);
+      }
+      else
+      {
+        return json_node ();
+      }
+    }
+
+    // Builds a json_node from the events
+    struct json_node_builder : json_sax_handler
+    {
+      struct frame
+      {
+        bool                    is_object ;
+        json_node::array_type   values    ;
+        json_node::object_type  members   ;
+        std::string             key       ;
+      };
+
+      void start_object () override
+      {
+        frames.push_back (frame { true, {}, {}, {} });
+      }
+
+      void key (sub_string k) override
+      {
+        frames.back ().key.assign (k.begin, k.end);
+      }
+
+      void end_object () override
+      {
+        auto members = std::move (frames.back ().members);
+        frames.pop_back ();
+        value (json_node (std::move (members)));
+      }
+
+      void start_array () override
+      {
+        frames.push_back (frame { false, {}, {}, {} });
+      }
+
+      void end_array () override
+      {
+        auto values = std::move (frames.back ().values);
+        frames.pop_back ();
+        value (json_node (std::move (values)));
+      }
+
+      void string (sub_string v) override
+      {
+        value (json_node (v.str ()));
+      }
+
+      void number (double v, sub_string) override
+      {
+        value (json_node (v));
+      }
+
+      void boolean (bool v) override
+      {
+        value (json_node (v));
+      }
+
+      void null () override
+      {
+        value (json_node ());
+      }
+
+      void value (json_node v)
+      {
+        if (frames.empty ())
+        {
+          result = std::move (v);
+          return;
+        }
+
+        auto & f = frames.back ();
+        if (f.is_object)
+        {
+          f.members.push_back (json_member { f.key, std::move (v) });
+        }
+        else
+        {
+          f.values.push_back (std::move (v));
+        }
+      }
+
+      std::vector<frame>  frames  ;
+      json_node           result  ;
+    };
+
+    inline auto parse_json_node (json_node & node, std::string const & i)
+    {
+      json_node_builder builder;
+      auto r = parse_json_sax (builder, i);
+      node = std::move (builder.result);
+      return r;
+    }
+
+    // Maps characters to the character after '\\' they are escaped with, 0
+    //  if they are written as is. Other control characters are written as is
+    //  too since the grammars above take any character but '"' and '\\' in
+    //  strings and don't decode \u
+    struct json_escapes
+    {
+      json_escapes () noexcept
+      {
+        std::memset (escape, 0, sizeof escape);
+        escape[static_cast<unsigned char> ('"')]  = '"';
+        escape[static_cast<unsigned char> ('\\')] = '\\';
+        escape[static_cast<unsigned char> ('\b')] = 'b';
+        escape[static_cast<unsigned char> ('\f')] = 'f';
+        escape[static_cast<unsigned char> ('\n')] = 'n';
+        escape[static_cast<unsigned char> ('\r')] = 'r';
+        escape[static_cast<unsigned char> ('\t')] = 't';
+      }
+
+      char escape[256];
+    };
+
+    inline char const * json_escape_table () noexcept
+    {
+      static json_escapes const escapes;
+      return escapes.escape;
+    }
+
+    // Writes the digits of i, padded with zeros to at least width digits
+    inline char * format_digits (std::uint64_t i, int width, char * iter) noexcept
+    {
+      char digits[20];
+      auto d = digits;
+      do
+      {
+        *d++ = static_cast<char> ('0' + i % 10);
+        i /= 10;
+      } while (i > 0 || d - digits < width);
+
+      while (d != digits)
+      {
+        *iter++ = *--d;
+      }
+
+      return iter;
+    }
+
+    // Formats v into buffer (at least 32 characters) and returns the end.
+    //  Numbers n / 10^d with n below 2^53 and a few decimals are formatted
+    //  from n for the smallest such d, the division is correctly rounded just
+    //  like reading the number back. Otherwise the shortest of 15, 16 and 17
+    //  significant digits that reads back as v is used, 15 digits gives the
+    //  shortest representation whenever one that short exists. JSON has no
+    //  infinities or NaNs so these are written as null
+    inline char * format_number (double v, char * buffer) noexcept
+    {
+      static double const         powers[]  = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8 };
+      static std::uint64_t const  ipowers[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+      static double const         limit     = 9007199254740992.0;
+
+      if (!std::isfinite (v))
+      {
+        std::memcpy (buffer, "null", 4);
+        return buffer + 4;
+      }
+
+      auto iter = buffer;
+      if (std::signbit (v))
+      {
+        *iter++ = '-';
+        v = -v;
+      }
+
+      if (v < limit && v >= 1e-4)
+      {
+        for (auto d = 0; d < 9; ++d)
+        {
+          auto scaled = v * powers[d];
+          if (scaled >= limit)
+          {
+            break;
+          }
+
+          auto n = static_cast<std::uint64_t> (scaled + 0.5);
+          if (static_cast<double> (n) / powers[d] == v)
+          {
+            iter = format_digits (n / ipowers[d], 1, iter);
+            if (d > 0)
+            {
+              *iter++ = '.';
+              iter = format_digits (n % ipowers[d], d, iter);
+            }
+            return iter;
+          }
+        }
+      }
+
+      for (auto precision = 15; ; ++precision)
+      {
+        auto size = std::snprintf (iter, 28, "%.*g", precision, v);
+        CPP_PC__ASSERT (size > 0 && size < 28);
+        if (precision == 17 || std::strtod (iter, nullptr) == v)
+        {
+          return iter + size;
+        }
+      }
+    }
+
+    // Writes compact JSON into a growable buffer. The writer is also a SAX
+    //  handler so that documents can be reformatted without building values,
+    //  numbers from the parser are then copied as they appear in the input.
+    //  When a file is given the buffer is written to it whenever it grows past
+    //  flush_size, flush writes what remains
+    struct json_writer final : json_sax_handler
+    {
+      explicit json_writer (std::FILE * file = nullptr, std::size_t flush_size = 64*1024)
+        : file        (file)
+        , flush_size  (flush_size)
+      {
+      }
+
+      ~json_writer () override
+      {
+        flush ();
+      }
+
+      bool flush () noexcept
+      {
+        if (!file || buffer.empty ())
+        {
+          return true;
+        }
+
+        auto size     = buffer.size ();
+        auto written  = std::fwrite (buffer.data (), 1, size, file);
+        buffer.clear ();
+        return written == size;
+      }
+
+      void start_object () override
+      {
+        separate ();
+        buffer.push_back ('{');
+        comma = false;
+      }
+
+      void key (sub_string k) override
+      {
+        separate ();
+        write_string (k.begin, k.end);
+        buffer.push_back (':');
+        comma = false;
+      }
+
+      void end_object () override
+      {
+        buffer.push_back ('}');
+        written ();
+      }
+
+      void start_array () override
+      {
+        separate ();
+        buffer.push_back ('[');
+        comma = false;
+      }
+
+      void end_array () override
+      {
+        buffer.push_back (']');
+        written ();
+      }
+
+      void string (sub_string v) override
+      {
+        separate ();
+        write_string (v.begin, v.end);
+        written ();
+      }
+
+      void number (double, sub_string text) override
+      {
+        separate ();
+        buffer.append (text.begin, text.end);
+        written ();
+      }
+
+      void boolean (bool v) override
+      {
+        separate ();
+        if (v)
+        {
+          buffer.append ("true", 4);
+        }
+        else
+        {
+          buffer.append ("false", 5);
+        }
+        written ();
+      }
+
+      void null () override
+      {
+        separate ();
+        buffer.append ("null", 4);
+        written ();
+      }
+
+      void number (double v)
+      {
+        separate ();
+        char formatted[32];
+        buffer.append (formatted, format_number (v, formatted));
+        written ();
+      }
+
+      void string (std::string const & v)
+      {
+        separate ();
+        write_string (v.data (), v.data () + v.size ());
+        written ();
+      }
+
+      void write (json_ast const * v);
+      void write (json_node const & v);
+      void write (json_tape_value v);
+
+      void write (json_ast::ptr const & v)
+      {
+        write (v.get ());
+      }
+
+      void write (json_tape const & tape)
+      {
+        write (root (tape));
+      }
+
+      std::string buffer;
+
+    private:
+      void separate ()
+      {
+        if (comma)
+        {
+          buffer.push_back (',');
+        }
+      }
+
+      void written ()
+      {
+        comma = true;
+        if (file && buffer.size () >= flush_size)
+        {
+          flush ();
+        }
+      }
+
+      // Runs of characters that need no escaping are appended in one go
+      void write_string (char const * begin, char const * end)
+      {
+        auto table = json_escape_table ();
+        buffer.push_back ('"');
+        auto run = begin;
+        for (auto iter = begin; iter != end; ++iter)
+        {
+          auto e = table[static_cast<unsigned char> (*iter)];
+          if (e)
+          {
+            buffer.append (run, iter);
+            buffer.push_back ('\\');
+            buffer.push_back (e);
+            run = iter + 1;
+          }
+        }
+        buffer.append (run, end);
+        buffer.push_back ('"');
+      }
+
+      std::FILE *       file        ;
+      std::size_t const flush_size  ;
+      bool              comma       = false;
+    };
+
+    // Null pointers are written as null
+    inline void json_writer::write (json_ast const * v)
+    {
+      if (auto a = dynamic_cast<json_array const *> (v))
+      {
+        start_array ();
+        for (auto && e : a->value)
+        {
+          write (e.get ());
+        }
+        end_array ();
+      }
+      else if (auto o = dynamic_cast<json_object const *> (v))
+      {
+        start_object ();
+        for (auto && m : o->value)
+        {
+          auto & k = std::get<0> (m);
+          key (sub_string (k.data (), k.data () + k.size ()));
+          write (std::get<1> (m).get ());
+        }
+        end_object ();
+      }
+      else if (auto str = dynamic_cast<json_string const *> (v))
+      {
+        string (str->value);
+      }
+      else if (auto n = dynamic_cast<json_number const *> (v))
+      {
+        number (n->value);
+      }
+      else if (auto b = dynamic_cast<json_boolean const *> (v))
+      {
+        boolean (b->value);
+      }
+      else
+      {
+        null ();
+      }
+    }
+
+    inline void json_writer::write (json_node const & v)
+    {
+      switch (v.type ())
+      {
+      case json_node::kind::null:
+        null ();
+        break;
+      case json_node::kind::boolean:
+        boolean (v.as_bool ());
+        break;
+      case json_node::kind::number:
+        number (v.as_number ());
+        break;
+      case json_node::kind::string:
+        string (v.as_string ());
+        break;
+      case json_node::kind::array:
+        start_array ();
+        for (auto && e : v.as_array ())
+        {
+          write (e);
+        }
+        end_array ();
+        break;
+      case json_node::kind::object:
+        start_object ();
+        for (auto && m : v.as_object ())
+        {
+          key (sub_string (m.key.data (), m.key.data () + m.key.size ()));
+          write (m.value);
+        }
+        end_object ();
+        break;
+      }
+    }
+
+    inline void json_writer::write (json_tape_value v)
+    {
+      switch (v.tag ())
+      {
+      case 'n':
+        null ();
+        break;
+      case 't':
+      case 'f':
+        boolean (v.as_bool ());
+        break;
+      case 'd':
+        number (v.as_number ());
+        break;
+      case 's':
+        string (v.as_string ());
+        break;
+      case '[':
+        start_array ();
+        for (auto && e : v.as_array ())
+        {
+          write (e);
+        }
+        end_array ();
+        break;
+      case '{':
+        start_object ();
+        for (auto && m : v.as_object ())
+        {
+          key (m.key.as_string ());
+          write (m.value);
+        }
+        end_object ();
+        break;
+      default:
+        CPP_PC__ASSERT (false);
+        break;
+      }
+    }
+
+    // Unlike to_string the output is compact, escaped and round trips numbers
+    template<typename TValue>
+    std::string to_json (TValue const & v)
+    {
+      json_writer writer;
+      writer.write (v);
+      return std::move (writer.buffer);
+    }
+
+    // Writes v to file through a buffer, false if writing failed
+    template<typename TValue>
+    bool write_json (std::FILE * file, TValue const & v)
+    {
+      json_writer writer (file);
+      writer.write (v);
+      return writer.flush ();
+    }
+
+    // The end of the string starting after the opening quote at begin, null
+    //  if it's not terminated. Strings are mostly short so they are scanned
+    //  character by character rather than with memchr
+    inline char const * skip_json_string (char const * begin, char const * end) noexcept
+    {
+      for (auto iter = begin; iter != end; ++iter)
+      {
+        if (*iter == '"')
+        {
+          return iter + 1;
+        }
+        else if (*iter == '\\' && ++iter == end)
+        {
+          break;
+        }
+      }
+
+      return nullptr;
+    }
+
+    // The characters skip_json_value stops at inside arrays and objects
+    struct json_brackets
+    {
+      json_brackets () noexcept
+      {
+        std::memset (stop, 0, sizeof stop);
+        for (auto ch : { '"', '[', ']', '{', '}' })
+        {
+          stop[static_cast<unsigned char> (ch)] = true;
+        }
+      }
+
+      bool stop[256];
+    };
+
+    inline bool const * json_bracket_table () noexcept
+    {
+      static json_brackets const brackets;
+      return brackets.stop;
+    }
+
+    // The end of the value starting at begin, null if the value is truncated.
+    //  Arrays and objects are skipped by counting brackets outside of strings,
+    //  scalars end at the next delimiter. Nothing else is validated, that is
+    //  left to parsing the value when it's accessed
+    inline char const * skip_json_value (char const * begin, char const * end) noexcept
+    {
+      if (begin == end)
+      {
+        return nullptr;
+      }
+
+      switch (*begin)
+      {
+      case '"':
+        return skip_json_string (begin + 1, end);
+      case '[':
+      case '{':
+        {
+          auto stop   = json_bracket_table ();
+          auto depth  = 0U;
+          auto iter   = begin;
+          while (iter != end)
+          {
+            switch (*iter)
+            {
+            case '"':
+              iter = skip_json_string (iter + 1, end);
+              if (!iter)
+              {
+                return nullptr;
+              }
+              break;
+            case '[':
+            case '{':
+              ++depth;
+              ++iter;
+              break;
+            case ']':
+            case '}':
+              ++iter;
+              if (--depth == 0)
+              {
+                return iter;
+              }
+              break;
+            default:
+              ++iter;
+              break;
+            }
+
+            while (iter != end && !stop[static_cast<unsigned char> (*iter)])
+            {
+              ++iter;
+            }
+          }
+
+          return nullptr;
+        }
+      default:
+        {
+          auto iter = begin;
+          while (iter != end && *iter != ',' && *iter != ']' && *iter != '}' && *iter != ':' && !satisfy_whitespace (0, *iter))
+          {
+            ++iter;
+          }
+
+          return iter;
+        }
+      }
+    }
+
+    inline char const * skip_json_ws (char const * begin, char const * end) noexcept
+    {
+      while (begin != end && satisfy_whitespace (0, *begin))
+      {
+        ++begin;
+      }
+
+      return begin;
+    }
+
+    // A value that is parsed when it's accessed, text is the span of the
+    //  value. Finding a member or an element skips the values before it
+    //  without parsing them, so the cost depends on what is read rather than
+    //  on the size of the document. A malformed value is found when it's
+    //  parsed, until then lookups into it are empty
+    struct json_lazy
+    {
+      sub_string text;
+
+      // 'n', 't', 'f', 'd' (number), 's', '[' or '{', 0 if the value is
+      //  neither
+      char tag () const noexcept
+      {
+        if (text.size () == 0)
+        {
+          return 0;
+        }
+
+        switch (*text.begin)
+        {
+        case 'n':
+        case 't':
+        case 'f':
+        case '[':
+        case '{':
+          return *text.begin;
+        case '"':
+          return 's';
+        case '-':
+          return 'd';
+        default:
+          return satisfy_digit (0, *text.begin) ? 'd' : 0;
+        }
+      }
+
+      // Invokes f (value) for each element until f returns false, false if
+      //  the array is malformed
+      template<typename TFunction>
+      bool for_each_element (TFunction && f) const
+      {
+        return for_each ('[', ']', [&f] (sub_string, json_lazy v) { return f (v); });
+      }
+
+      // Invokes f (raw key, value) for each member until f returns false,
+      //  the key is as it appears in the input. false if the object is
+      //  malformed
+      template<typename TFunction>
+      bool for_each_member (TFunction && f) const
+      {
+        return for_each ('{', '}', std::forward<TFunction> (f));
+      }
+
+      opt<json_lazy> at (std::size_t index) const
+      {
+        opt<json_lazy> result;
+        for_each_element ([&result, &index] (json_lazy v)
+          {
+            if (index-- == 0)
+            {
+              result.emplace (v);
+              return false;
+            }
+            return true;
+          });
+        return result;
+      }
+
+      // The first member named key
+      opt<json_lazy> find (std::string const & key) const
+      {
+        opt<json_lazy> result;
+        std::string buffer;
+        for_each_member ([&] (sub_string raw, json_lazy v)
+          {
+            if (!valid_escapes (raw))
+            {
+              return true;
+            }
+
+            auto k = unescape (raw, buffer);
+            if (k.size () == key.size () && std::equal (k.begin, k.end, key.begin ()))
+            {
+              result.emplace (v);
+              return false;
+            }
+            return true;
+          });
+        return result;
+      }
+
+      // Parses the value and everything in it
+      parse_result<json_ast::ptr> parse () const;
+
+    private:
+      template<typename TFunction>
+      bool for_each (char open, char close, TFunction && f) const
+      {
+        if (tag () != open)
+        {
+          return false;
+        }
+
+        auto end  = text.end;
+        auto iter = skip_json_ws (text.begin + 1, end);
+        if (iter != end && *iter == close)
+        {
+          return true;
+        }
+
+        while (iter != end)
+        {
+          auto key_begin  = iter;
+          auto key_end    = iter;
+          if (open == '{')
+          {
+            if (*iter != '"')
+            {
+              return false;
+            }
+
+            auto string_end = skip_json_string (iter + 1, end);
+            if (!string_end)
+            {
+              return false;
+            }
+
+            key_begin = iter + 1;
+            key_end   = string_end - 1;
+            iter      = skip_json_ws (string_end, end);
+            if (iter == end || *iter != ':')
+            {
+              return false;
+            }
+            iter  = skip_json_ws (iter + 1, end);
+          }
+
+          auto value_end = skip_json_value (iter, end);
+          if (!value_end || value_end == iter)
+          {
+            return false;
+          }
+
+          if (!f (sub_string (key_begin, key_end), json_lazy { sub_string (iter, value_end) }))
+          {
+            return true;
+          }
+
+          iter = skip_json_ws (value_end, end);
+          if (iter == end)
+          {
+            return false;
+          }
+          else if (*iter == close)
+          {
+            return true;
+          }
+          else if (*iter != ',')
+          {
+            return false;
+          }
+
+          iter = skip_json_ws (iter + 1, end);
+        }
+
+        return false;
+      }
+    };
+
+    // Only the span of the document is recorded, it must be an array or an
+    //  object like for pjson
+    auto const pjson_lazy =
+        pskip_ws
+      < detail::adapt_parser_function (
+          [error = detail::make_expected ("array or object")] (auto const & s, std::size_t position)
+          {
+            using result_type = result<json_lazy>;
+
+            auto begin  = s.begin + position;
+            auto end    = (begin != s.end && (*begin == '[' || *begin == '{')) ? skip_json_value (begin, s.end) : nullptr;
+            if (!end)
+            {
+              s.append_error (position, error);
+              return result_type::failure (position);
+            }
+
+            return result_type::success (static_cast<std::size_t> (end - s.begin), json_lazy { sub_string (begin, end) });
+          })
+      > pskip_ws
+      > peos
+      ;
+
+    auto const pjson_lazy_value = pjson_value > peos;
+
+    inline parse_result<json_ast::ptr> json_lazy::parse () const
+    {
+      return cpp_pc::parse (pjson_lazy_value, text.begin, text.end);
+    }
+
+    inline auto parse_json_lazy (char const * begin, char const * end)
+    {
+      return parse (pjson_lazy, begin, end);
+    }
+
+    inline auto parse_json_lazy (std::string const & i)
+    {
+      return parse (pjson_lazy, i);
+    }
+
+    // JSON Pointers (RFC 6901) compiled into a trie, pointers that share a
+    //  prefix share its nodes. A segment of * matches any member or element
+    struct json_paths
+    {
+      static std::uint32_t const none = std::numeric_limits<std::uint32_t>::max ();
+
+      struct edge
+      {
+        std::string   name    ;
+        // The element the segment selects, SIZE_MAX unless the segment is
+        //  an array index
+        std::size_t   index   ;
+        std::uint32_t target  ;
+      };
+
+      struct node
+      {
+        std::vector<edge>         edges     ;
+        std::uint32_t             wildcard  ;
+        // The indices of the pointers ending at the node
+        std::vector<std::size_t>  paths     ;
+      };
+
+      // Appends the nodes reached from the nodes [first, last) of sets by
+      //  the edges matches accepts
+      template<typename TMatches>
+      void step (std::vector<std::uint32_t> & sets, std::size_t first, std::size_t last, TMatches && matches) const
+      {
+        for (auto iter = first; iter < last; ++iter)
+        {
+          auto & n = nodes[sets[iter]];
+          if (n.wildcard != none)
+          {
+            sets.push_back (n.wildcard);
+          }
+
+          for (auto && e : n.edges)
+          {
+            if (matches (e))
+            {
+              sets.push_back (e.target);
+            }
+          }
+        }
+      }
+
+      std::vector<node> nodes ;
+    };
+
+    // Empty if a path isn't a JSON Pointer, the empty path selects the
+    //  document
+    inline opt<json_paths> compile_json_paths (std::vector<std::string> const & paths)
+    {
+      auto const none = json_paths::none;
+
+      json_paths result;
+      result.nodes.push_back (json_paths::node { {}, none, {} });
+
+      auto add_node = [&result] ()
+        {
+          result.nodes.push_back (json_paths::node { {}, none, {} });
+          return static_cast<std::uint32_t> (result.nodes.size () - 1);
+        };
+
+      auto to_index = [] (std::string const & segment)
+        {
+          auto digits = std::all_of (segment.begin (), segment.end (), [] (char ch) { return satisfy_digit (0, ch); });
+          if (!digits || segment.empty () || segment.size () > 18 || (segment.size () > 1 && segment.front () == '0'))
+          {
+            return SIZE_MAX;
+          }
+
+          return static_cast<std::size_t> (std::strtoull (segment.c_str (), nullptr, 10));
+        };
+
+      for (auto path = 0U; path < paths.size (); ++path)
+      {
+        auto & p    = paths[path];
+        auto iter   = p.begin ();
+        auto end    = p.end ();
+
+        if (iter != end && *iter != '/')
+        {
+          return empty_opt;
+        }
+
+        auto current = 0U;
+        std::string segment;
+        while (iter != end)
+        {
+          segment.clear ();
+          for (++iter; iter != end && *iter != '/'; ++iter)
+          {
+            if (*iter != '~')
+            {
+              segment.push_back (*iter);
+            }
+            else if (++iter != end && (*iter == '0' || *iter == '1'))
+            {
+              segment.push_back (*iter == '0' ? '~' : '/');
+            }
+            else
+            {
+              return empty_opt;
+            }
+          }
+
+          if (segment == "*")
+          {
+            if (result.nodes[current].wildcard == none)
+            {
+              auto target = add_node ();
+              result.nodes[current].wildcard = target;
+            }
+            current = result.nodes[current].wildcard;
+            continue;
+          }
+
+          auto & edges  = result.nodes[current].edges;
+          auto found    = std::find_if (edges.begin (), edges.end (), [&segment] (json_paths::edge const & e) { return e.name == segment; });
+          if (found != edges.end ())
+          {
+            current = found->target;
+            continue;
+          }
+
+          auto target = add_node ();
+          result.nodes[current].edges.push_back (json_paths::edge { segment, to_index (segment), target });
+          current = target;
+        }
+
+        result.nodes[current].paths.push_back (path);
+      }
+
+      return make_opt (std::move (result));
+    }
+
+    using json_path_callback = std::function<void (std::size_t path, json_ast::ptr const & value)>;
+
+    // callback is null while errors are collected. sets is a stack of the
+    //  trie nodes the values being parsed are reached by
+    struct json_path_state : json_sax_state
+    {
+      json_path_state (std::size_t error_position, char const * begin, char const * end, json_paths const & paths, json_path_callback const * callback, bool validate)
+        : json_sax_state  (error_position, begin, end, nullptr)
+        , paths           (paths)
+        , callback        (callback)
+        , validate        (validate)
+      {
+      }
+
+      json_paths const &                  paths   ;
+      json_path_callback const *          callback;
+      bool                                validate;
+      std::vector<std::uint32_t> mutable  sets    ;
+    };
+
+    // How values no path leads to are handled, skip finds their end like
+    //  json_lazy does while validate parses them with pjson_sax_value
+    enum class json_unselected
+    {
+      skip      ,
+      validate  ,
+    };
+
+    inline result<unit_type> select_json_value (json_path_state const & s, std::size_t position, std::size_t first, std::size_t last);
+
+    inline result<unit_type> select_json_members (json_path_state const & s, std::size_t position, std::size_t first, std::size_t last)
+    {
+      using result_type = result<unit_type>;
+
+      auto begin  = s.begin;
+      auto end    = s.end;
+      auto offset = [begin] (char const * iter) { return static_cast<std::size_t> (iter - begin); };
+
+      auto is_object  = begin[position] == '{';
+      auto close      = is_object ? '}' : ']';
+
+      auto iter = skip_json_ws (begin + position + 1, end);
+      if (iter != end && *iter == close)
+      {
+        return result_type::success (offset (skip_json_ws (iter + 1, end)), unit);
+      }
+
+      for (auto index = 0U; ; ++index)
+      {
+        auto next = s.sets.size ();
+
+        if (is_object)
+        {
+          auto key_end = iter != end && *iter == '"' ? skip_json_string (iter + 1, end) : nullptr;
+          auto raw_key = key_end ? sub_string (iter + 1, key_end - 1) : sub_string ();
+          if (!key_end || !valid_escapes (raw_key))
+          {
+            return result_type::failure (offset (iter));
+          }
+
+          auto key = unescape (raw_key, s.buffer);
+          s.paths.step (s.sets, first, last, [&key] (json_paths::edge const & e)
+            {
+              return e.name.size () == key.size () && std::equal (key.begin, key.end, e.name.begin ());
+            });
+
+          iter = skip_json_ws (key_end, end);
+          if (iter == end || *iter != ':')
+          {
+            s.sets.resize (next);
+            return result_type::failure (offset (iter));
+          }
+
+          iter = skip_json_ws (iter + 1, end);
+        }
+        else
+        {
+          s.paths.step (s.sets, first, last, [index] (json_paths::edge const & e) { return e.index == index; });
+        }
+
+        auto v = select_json_value (s, offset (iter), next, s.sets.size ());
+        s.sets.resize (next);
+        if (!v.value)
+        {
+          return v;
+        }
+
+        iter = begin + v.position;
+        if (iter != end && *iter == close)
+        {
+          return result_type::success (offset (skip_json_ws (iter + 1, end)), unit);
+        }
+        else if (iter == end || *iter != ',')
+        {
+          return result_type::failure (offset (iter));
+        }
+
+        iter = skip_json_ws (iter + 1, end);
+      }
+    }
+
+    // Selects within the value at position, reached by the trie nodes
+    //  [first, last) of s.sets. Values no path leads to are skipped or
+    //  validated without being built. A value a path ends at is parsed with
+    //  pjson_value and passed to the callback after the values selected
+    //  within it
+    inline result<unit_type> select_json_value (json_path_state const & s, std::size_t position, std::size_t first, std::size_t last)
+    {
+      using result_type = result<unit_type>;
+
+      auto ends       = false;
+      auto continues  = false;
+      for (auto iter = first; iter < last; ++iter)
+      {
+        auto & n  = s.paths.nodes[s.sets[iter]];
+        ends      = ends || !n.paths.empty ();
+        continues = continues || n.wildcard != json_paths::none || !n.edges.empty ();
+      }
+
+      auto begin      = s.begin + position;
+      auto container  = begin != s.end && (*begin == '[' || *begin == '{');
+
+      if (continues && container)
+      {
+        auto v = select_json_members (s, position, first, last);
+        if (!v.value || !ends)
+        {
+          return v;
+        }
+      }
+      else if (!ends)
+      {
+        if (s.validate)
+        {
+          return pjson_sax_value.parser_function (s, position);
+        }
+
+        auto end = skip_json_value (begin, s.end);
+        if (!end || end == begin)
+        {
+          return result_type::failure (position);
+        }
+
+        return result_type::success (static_cast<std::size_t> (skip_json_ws (end, s.end) - s.begin), unit);
+      }
+
+      auto v = pjson_value.parser_function (s, position);
+      if (!v.value)
+      {
+        return result_type::failure (v.position);
+      }
+
+      if (s.callback)
+      {
+        for (auto iter = first; iter < last; ++iter)
+        {
+          for (auto && path : s.paths.nodes[s.sets[iter]].paths)
+          {
+            (*s.callback) (path, v.value.get ());
+          }
+        }
+      }
+
+      return result_type::success (v.position, unit);
+    }
+
+    // The document must be an array or an object like for pjson. Errors are
+    //  reported by parsing the document with pjson_sax so that the messages
+    //  are the same
+    auto const pjson_select = detail::adapt_parser_function<json_path_state> (
+      [] (auto const & s, std::size_t position)
+      {
+        using result_type = result<unit_type>;
+
+        auto begin = skip_json_ws (s.begin + position, s.end);
+        if (begin != s.end && (*begin == '[' || *begin == '{'))
+        {
+          s.sets.assign (1, 0U);
+          auto v = select_json_value (s, static_cast<std::size_t> (begin - s.begin), 0, 1);
+          if (v.value && s.begin + v.position == s.end)
+          {
+            return v;
+          }
+        }
+
+        s.errors.clear ();
+        s.committed = false;
+
+        auto v = pjson_sax.parser_function (s, position);
+        return result_type::failure (v.position);
+      });
+
+    // Parses the document passing the values the paths lead to to callback,
+    //  on failure the values up to the error have been passed
+    inline auto select_json (
+        json_paths const &          paths
+      , json_path_callback const &  callback
+      , char const *                begin
+      , char const *                end
+      , json_unselected             unselected = json_unselected::skip
+      )
+    {
+      auto validate = unselected == json_unselected::validate;
+
+      json_path_state s (SIZE_MAX, begin, end, paths, &callback, validate);
+      auto v = pjson_select.parser_function (s, 0);
+      if (v.value)
+      {
+        return parse_result<unit_type> (v.position, std::move (v.value), std::string ());
+      }
+
+      json_path_state es (v.position, begin, end, paths, nullptr, validate);
+      auto ev = pjson_select.parser_function (es, 0);
+
+      CPP_PC__ASSERT (v.position == ev.position);
+      CPP_PC__ASSERT (!ev.value);
+
+      return parse_result<unit_type> (ev.position, empty_opt, es.error_description ());
+    }
+
+    inline auto select_json (
+        json_paths const &          paths
+      , json_path_callback const &  callback
+      , std::string const &         i
+      , json_unselected             unselected = json_unselected::skip
+      )
+    {
+      auto begin = i.c_str ();
+      return select_json (paths, callback, begin, begin + i.size (), unselected);
+    }
+  }
+}
+// ----------------------------------------------------------------------------
@@ -15,7 +15,9 @@
 // ----------------------------------------------------------------------------
 #pragma once
 // ----------------------------------------------------------------------------
+#include <new>
 #include <type_traits>
+#include <utility>
 // ----------------------------------------------------------------------------
 #include "common.hpp"
 // ----------------------------------------------------------------------------
@@ -32,97 +34,198 @@ namespace cpp_pc
 
   CPP_PC__PRELUDE empty_opt_type const empty_opt;
 
-  template<typename TValue>
-  struct opt
+  struct in_place_type
   {
-    using value_type = detail::strip_type_t<TValue>;
-
-    CPP_PC__INLINE opt () noexcept
-      : has_value (false)
+    CPP_PC__PRELUDE in_place_type ()
     {
     }
+  };
 
-    CPP_PC__INLINE opt (empty_opt_type) noexcept
-      : has_value (false)
-    {
-    }
+  // Selects the constructors that construct the value in place from the
+  //  arguments that follow
+  CPP_PC__PRELUDE in_place_type const in_place;
 
-    CPP_PC__INLINE ~opt () noexcept
+  namespace detail
+  {
+    template<typename TValue>
+    struct is_trivial_opt
     {
-      clear ();
-    }
-
-    CPP_PC__INLINE explicit opt (value_type const & v)
-      : has_value (true)
+      enum
+      {
+        value = std::is_trivially_copyable<TValue>::value && std::is_trivially_destructible<TValue>::value,
+      };
+    };
+
+    // The storage of opt, for trivial values the storage is trivially
+    //  copyable and destructible as well so that opt (and result) of
+    //  values like char and unit_type can be passed in registers
+    template<typename TValue, bool IsTrivial = is_trivial_opt<TValue>::value>
+    struct opt_storage
     {
-      new (&storage) value_type (v);
-    }
+      CPP_PC__INLINE opt_storage () noexcept
+        : has_value (false)
+      {
+      }
 
-    CPP_PC__INLINE explicit opt (value_type && v) noexcept
-      : has_value (true)
-    {
-      new (&storage) value_type (std::move (v));
-    }
+      CPP_PC__INLINE opt_storage (opt_storage const & o)
+        : has_value (o.has_value)
+      {
+        if (has_value)
+        {
+          new (&storage) TValue (*o.get_ptr ());
+        }
+      }
 
-    CPP_PC__INLINE opt (opt const & o)
-      : has_value (o.has_value)
-    {
-      if (has_value)
+      // The moved from opt is empty
+      CPP_PC__INLINE opt_storage (opt_storage && o) noexcept
+        : has_value (o.has_value)
       {
-        new (&storage) value_type (o.get ());
+        if (has_value)
+        {
+          new (&storage) TValue (std::move (*o.get_ptr ()));
+          o.has_value = false;
+        }
       }
-    }
 
-    CPP_PC__INLINE opt (opt && o) noexcept
-      : has_value (o.has_value)
-    {
-      if (has_value)
+      CPP_PC__INLINE ~opt_storage () noexcept
       {
-        new (&storage) value_type (std::move (o.get ()));
-        o.has_value = false;
+        clear ();
       }
-    }
 
-    opt & operator = (opt const & o)
-    {
-      if (this == &o)
+      opt_storage & operator = (opt_storage const & o)
       {
+        if (this == &o)
+        {
+          return *this;
+        }
+
+        opt_storage copy (o);
+
+        *this = std::move (copy);
+
         return *this;
       }
 
-      opt copy (o);
+      opt_storage & operator = (opt_storage && o) noexcept
+      {
+        if (this == &o)
+        {
+          return *this;
+        }
 
-      *this = std::move (copy);
+        clear ();
 
-      return *this;
-    }
+        has_value = o.has_value;
+
+        if (has_value)
+        {
+          new (&storage) TValue (std::move (*o.get_ptr ()));
+          o.has_value = false;
+        }
+
+        return *this;
+      }
+
+      CPP_PC__INLINE void clear () noexcept
+      {
+        if (has_value)
+        {
+          get_ptr ()->~TValue ();
+          has_value = false;
+        }
+      }
+
+      CPP_PC__PRELUDE TValue const * get_ptr () const noexcept
+      {
+        return reinterpret_cast<TValue const *> (&storage);
+      }
+
+      CPP_PC__INLINE TValue * get_ptr () noexcept
+      {
+        return reinterpret_cast<TValue *> (&storage);
+      }
+
+      alignas (TValue) unsigned char storage[sizeof (TValue)];
+      bool has_value;
+    };
 
-    opt & operator = (opt && o) noexcept
+    // Copies, moves and destruction are the implicit (trivial) ones, a
+    //  moved from opt keeps its value
+    template<typename TValue>
+    struct opt_storage<TValue, true>
     {
-      if (this == &o)
+      CPP_PC__INLINE opt_storage () noexcept
+        : has_value (false)
       {
-        return *this;
       }
 
-      clear ();
+      CPP_PC__INLINE void clear () noexcept
+      {
+        has_value = false;
+      }
 
-      has_value = o.has_value;
+      CPP_PC__PRELUDE TValue const * get_ptr () const noexcept
+      {
+        return reinterpret_cast<TValue const *> (&storage);
+      }
 
-      if (has_value)
+      CPP_PC__INLINE TValue * get_ptr () noexcept
       {
-        new (&storage) value_type (std::move (o.get ()));
-        o.has_value = false;
+        return reinterpret_cast<TValue *> (&storage);
       }
 
-      return *this;
+      alignas (TValue) unsigned char storage[sizeof (TValue)];
+      bool has_value;
+    };
+  }
+
+  template<typename TValue>
+  struct opt : private detail::opt_storage<detail::strip_type_t<TValue>>
+  {
+    using value_type    = detail::strip_type_t<TValue>        ;
+    using storage_type  = detail::opt_storage<value_type>     ;
+
+    CPP_PC__INLINE opt () noexcept
+    {
+    }
+
+    CPP_PC__INLINE opt (empty_opt_type) noexcept
+    {
+    }
+
+    CPP_PC__INLINE explicit opt (value_type const & v)
+    {
+      emplace (v);
+    }
+
+    CPP_PC__INLINE explicit opt (value_type && v) noexcept
+    {
+      emplace (std::move (v));
+    }
+
+    template<typename ...TArgs>
+    CPP_PC__INLINE explicit opt (in_place_type, TArgs && ...args)
+    {
+      emplace (std::forward<TArgs> (args)...);
+    }
+
+    // Constructs the value in place from args, destroys the current value
+    //  first
+    template<typename ...TArgs>
+    CPP_PC__INLINE value_type & emplace (TArgs && ...args)
+    {
+      clear ();
+      new (&this->storage) value_type (std::forward<TArgs> (args)...);
+      this->has_value = true;
+      return get ();
     }
 
     CPP_PC__PRELUDE bool operator == (opt const & o) const
     {
       return
-          has_value && o.has_value
+          this->has_value && o.has_value
         ? get () == o.get ()
-        : has_value == o.has_value
+        : this->has_value == o.has_value
         ;
     }
 
@@ -133,38 +236,34 @@ namespace cpp_pc
 
     CPP_PC__PRELUDE explicit operator bool () const noexcept
     {
-      return has_value;
+      return this->has_value;
     }
 
     CPP_PC__PRELUDE bool is_empty () const noexcept
     {
-      return !has_value;
+      return !this->has_value;
     }
 
     CPP_PC__PRELUDE value_type const & get () const noexcept
     {
-      CPP_PC__ASSERT (has_value);
-      return *get_ptr ();
+      CPP_PC__ASSERT (this->has_value);
+      return *this->get_ptr ();
     }
 
-    CPP_PC__INLINE value_type const & get () noexcept
+    CPP_PC__INLINE value_type & get () noexcept
     {
-      CPP_PC__ASSERT (has_value);
-      return *get_ptr ();
+      CPP_PC__ASSERT (this->has_value);
+      return *this->get_ptr ();
     }
 
-    void clear () noexcept
+    CPP_PC__INLINE void clear () noexcept
     {
-      if (has_value)
-      {
-        get ().~value_type ();
-        has_value = false;
-      }
+      storage_type::clear ();
     }
 
     value_type const & coalesce (value_type const & v) const noexcept
     {
-      if (has_value)
+      if (this->has_value)
       {
         return get ();
       }
@@ -173,21 +272,6 @@ namespace cpp_pc
         return v;
       }
     }
-
-  private:
-
-    CPP_PC__PRELUDE value_type const * get_ptr () const noexcept
-    {
-      return reinterpret_cast<value_type const *> (&storage);
-    }
-
-    CPP_PC__INLINE value_type * get_ptr () noexcept
-    {
-      return reinterpret_cast<value_type *> (&storage);
-    }
-
-    alignas (value_type) unsigned char storage[sizeof (value_type)];
-    bool has_value;
   };
 
   template<typename T>
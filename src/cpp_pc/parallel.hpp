@@ -0,0 +1,366 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#pragma once
+// ----------------------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+// ----------------------------------------------------------------------------
+#include "common.hpp"
+#include "pc.hpp"
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+namespace cpp_pc
+{
+  // A fixed set of worker threads that executes numbered tasks. Each worker
+  //  owns a queue of task indices, when it runs dry it steals from the back
+  //  of the other workers' queues
+  struct work_stealing_pool
+  {
+    using task_function = std::function<void (std::size_t worker, std::size_t task)>;
+
+    CPP_PC__NO_COPY_MOVE (work_stealing_pool);
+
+    work_stealing_pool ()         = delete ;
+
+    explicit work_stealing_pool (std::size_t threads)
+      : queues      (std::max<std::size_t> (threads, 1U))
+      , generation  (0)
+      , idle        (0)
+      , stopping    (false)
+      , failed      (false)
+    {
+      auto sz = queues.size ();
+
+      workers.reserve (sz);
+      for (auto iter = 0U; iter < sz; ++iter)
+      {
+        workers.emplace_back ([this, iter] () { work (iter); });
+      }
+    }
+
+    ~work_stealing_pool () noexcept
+    {
+      {
+        std::unique_lock<std::mutex> lock (mutex);
+        stopping = true;
+      }
+
+      start_condition.notify_all ();
+
+      for (auto && worker : workers)
+      {
+        worker.join ();
+      }
+    }
+
+    CPP_PC__INLINE std::size_t size () const noexcept
+    {
+      return workers.size ();
+    }
+
+    // Runs f (worker, task) for task in [0, tasks) and waits for completion
+    //  worker is in [0, size ()) and can be used to index per-worker data
+    //  Calls from several threads are serialized, a call from a task would
+    //  wait for itself and isn't allowed. If a task throws the tasks not
+    //  yet started are dropped and the first exception is rethrown by run
+    void run (std::size_t tasks, task_function f)
+    {
+      CPP_PC__ASSERT (!is_worker ());
+
+      if (tasks == 0)
+      {
+        return;
+      }
+
+      std::unique_lock<std::mutex> run_lock (run_mutex);
+      std::unique_lock<std::mutex> lock (mutex);
+
+      auto sz = queues.size ();
+      for (auto iter = 0U; iter < tasks; ++iter)
+      {
+        auto & q = queues[iter % sz];
+        std::unique_lock<std::mutex> queue_lock (q.mutex);
+        q.tasks.push_back (iter);
+      }
+
+      function = std::move (f);
+      idle     = 0;
+      failed   = false;
+      ++generation;
+
+      start_condition.notify_all ();
+      done_condition.wait (lock, [this] () { return idle == workers.size (); });
+
+      function = task_function ();
+
+      if (error)
+      {
+        auto e = error;
+        error  = nullptr;
+        std::rethrow_exception (e);
+      }
+    }
+
+  private:
+
+    CPP_PC__INLINE bool is_worker () const noexcept
+    {
+      auto id = std::this_thread::get_id ();
+      return std::any_of (workers.begin (), workers.end (), [id] (std::thread const & w) { return w.get_id () == id; });
+    }
+
+    struct task_queue
+    {
+      std::mutex              mutex ;
+      std::deque<std::size_t> tasks ;
+    };
+
+    bool next_task (std::size_t worker, std::size_t & task)
+    {
+      {
+        auto & q = queues[worker];
+        std::unique_lock<std::mutex> queue_lock (q.mutex);
+        if (!q.tasks.empty ())
+        {
+          task = q.tasks.front ();
+          q.tasks.pop_front ();
+          return true;
+        }
+      }
+
+      auto sz = queues.size ();
+      for (auto iter = 1U; iter < sz; ++iter)
+      {
+        auto & q = queues[(worker + iter) % sz];
+        std::unique_lock<std::mutex> queue_lock (q.mutex);
+        if (!q.tasks.empty ())
+        {
+          task = q.tasks.back ();
+          q.tasks.pop_back ();
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    void work (std::size_t worker)
+    {
+      auto seen = std::size_t ();
+
+      for (;;)
+      {
+        {
+          std::unique_lock<std::mutex> lock (mutex);
+          start_condition.wait (lock, [this, seen] () { return stopping || generation != seen; });
+
+          if (stopping)
+          {
+            return;
+          }
+
+          seen = generation;
+        }
+
+        // Tasks are only enqueued while all workers are idle, so once no task
+        //  can be found the current run is complete for this worker
+        auto task = std::size_t ();
+        while (next_task (worker, task))
+        {
+          if (failed)
+          {
+            continue;
+          }
+
+          try
+          {
+            function (worker, task);
+          }
+          catch (...)
+          {
+            std::unique_lock<std::mutex> lock (mutex);
+            if (!error)
+            {
+              error = std::current_exception ();
+            }
+            failed = true;
+          }
+        }
+
+        {
+          std::unique_lock<std::mutex> lock (mutex);
+          ++idle;
+          if (idle == workers.size ())
+          {
+            done_condition.notify_all ();
+          }
+        }
+      }
+    }
+
+    std::vector<task_queue>   queues          ;
+    std::vector<std::thread>  workers         ;
+
+    std::mutex                run_mutex       ;
+    std::mutex                mutex           ;
+    std::condition_variable   start_condition ;
+    std::condition_variable   done_condition  ;
+    task_function             function        ;
+    std::size_t               generation      ;
+    std::size_t               idle            ;
+    bool                      stopping        ;
+    // Set when a task of the current run has thrown, the first exception
+    //  is kept in error
+    std::atomic<bool>         failed          ;
+    std::exception_ptr        error           ;
+  };
+
+  namespace detail
+  {
+    struct input_range
+    {
+      char const *  begin ;
+      char const *  end   ;
+    };
+
+    // Splits on '\n', a trailing '\n' doesn't produce an empty last line
+    inline std::vector<input_range> split_lines (char const * begin, char const * end)
+    {
+      std::vector<input_range> lines;
+
+      auto current = begin;
+      while (current < end)
+      {
+        auto nl     = static_cast<char const *> (std::memchr (current, '\n', static_cast<std::size_t> (end - current)));
+        auto last   = nl ? nl : end;
+
+        lines.push_back (input_range { current, last });
+
+        current = nl ? nl + 1 : end;
+      }
+
+      return lines;
+    }
+
+    std::size_t const inputs_per_task = 256;
+
+    // Parses inputs in chunks on the pool, each worker reuses its own
+    //  parse_session for all inputs it parses
+    template<typename TValueType, typename TParserFunction>
+    auto parse_ranges (
+        work_stealing_pool &                        pool
+      , parser<TValueType, TParserFunction> const & p
+      , std::vector<input_range> const &            inputs
+      )
+    {
+      using result_type = parse_result<TValueType>;
+
+      auto count  = inputs.size ();
+      auto tasks  = (count + inputs_per_task - 1) / inputs_per_task;
+
+      std::vector<result_type> results (count, result_type (0, empty_opt, std::string ()));
+
+      std::unique_ptr<parse_session[]> sessions (new parse_session[pool.size ()]);
+
+      pool.run (tasks, [&] (std::size_t worker, std::size_t task)
+        {
+          auto & session  = sessions[worker];
+          auto from       = task * inputs_per_task;
+          auto to         = std::min (from + inputs_per_task, count);
+
+          for (auto iter = from; iter < to; ++iter)
+          {
+            auto & input  = inputs[iter];
+            results[iter] = session.parse (p, input.begin, input.end);
+          }
+        });
+
+      return results;
+    }
+  }
+
+  // Parses each line of buffer as an independent input, lines are parsed in
+  //  chunks on the pool. Results are returned in line order
+  template<typename TValueType, typename TParserFunction>
+  auto parse_lines (
+      work_stealing_pool &                        pool
+    , parser<TValueType, TParserFunction> const & p
+    , char const *                                begin
+    , char const *                                end
+    )
+  {
+    return detail::parse_ranges (pool, p, detail::split_lines (begin, end));
+  }
+
+  template<typename TValueType, typename TParserFunction>
+  auto parse_lines (
+      parser<TValueType, TParserFunction> const & p
+    , std::string const &                         buffer
+    , std::size_t                                 threads
+    )
+  {
+    work_stealing_pool pool (threads);
+
+    auto begin  = buffer.c_str ();
+    auto end    = begin + buffer.size ();
+
+    return parse_lines (pool, p, begin, end);
+  }
+
+  // Parses each input as an independent input, see parse_lines
+  template<typename TValueType, typename TParserFunction>
+  auto parse_batch (
+      work_stealing_pool &                        pool
+    , parser<TValueType, TParserFunction> const & p
+    , std::vector<std::string> const &            inputs
+    )
+  {
+    std::vector<detail::input_range> ranges;
+    ranges.reserve (inputs.size ());
+
+    for (auto && input : inputs)
+    {
+      auto begin = input.c_str ();
+      ranges.push_back (detail::input_range { begin, begin + input.size () });
+    }
+
+    return detail::parse_ranges (pool, p, ranges);
+  }
+
+  template<typename TValueType, typename TParserFunction>
+  auto parse_batch (
+      parser<TValueType, TParserFunction> const & p
+    , std::vector<std::string> const &            inputs
+    , std::size_t                                 threads
+    )
+  {
+    work_stealing_pool pool (threads);
+
+    return parse_batch (pool, p, inputs);
+  }
+}
+// ----------------------------------------------------------------------------
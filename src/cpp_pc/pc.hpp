@@ -16,7 +16,11 @@
 #pragma once
 // ----------------------------------------------------------------------------
 #include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <limits>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -39,7 +43,13 @@ namespace cpp_pc
   {
     CPP_PC__CTOR_COPY_MOVE (sub_string);
 
-    CPP_PC__INLINE sub_string (char const * begin, char const * end)
+    CPP_PC__PRELUDE sub_string ()
+      : begin   (nullptr)
+      , end     (nullptr)
+    {
+    }
+
+    CPP_PC__PRELUDE sub_string (char const * begin, char const * end)
       : begin   (begin)
       , end     (end)
     {
@@ -51,7 +61,7 @@ namespace cpp_pc
       return std::string (begin, end);
     }
 
-    CPP_PC__INLINE std::size_t size () const
+    CPP_PC__PRELUDE std::size_t size () const
     {
       return static_cast<std::size_t> (end - begin);
     }
@@ -120,16 +130,27 @@ namespace cpp_pc
 
   namespace detail
   {
-    auto make_expected (std::string e)
+    CPP_PC__INLINE auto make_expected (std::string e)
     {
       return std::make_shared<expected_error> (std::move (e));
     }
 
-    auto make_unexpected (std::string ue)
+    CPP_PC__INLINE auto make_unexpected (std::string ue)
     {
       return std::make_shared<unexpected_error> (std::move (ue));
     }
 
+    CPP_PC__INLINE std::string char_to_string (char ch)
+    {
+      char s[] = {'\'', ch, '\'', 0};
+      return s;
+    }
+
+    CPP_PC__INLINE base_error::ptr char_to_expected (char ch)
+    {
+      return detail::make_expected (detail::char_to_string (ch));
+    }
+
 
     struct collect_error_visitor : error_visitor
     {
@@ -148,92 +169,277 @@ namespace cpp_pc
     };
   }
 
-  auto satisfy_digit = [] (std::size_t, char ch)
+  namespace detail
+  {
+    struct satisfy_digit_function
     {
-      return ch >= '0' && ch <= '9';
+      CPP_PC__PRELUDE bool operator () (std::size_t, char ch) const noexcept
+      {
+        return ch >= '0' && ch <= '9';
+      }
     };
 
-  auto satisfy_whitespace = [] (std::size_t, char ch)
+    struct satisfy_whitespace_function
     {
-      switch (ch)
+      CPP_PC__PRELUDE bool operator () (std::size_t, char ch) const noexcept
       {
-      case ' ':
-      case '\b':
-      case '\f':
-      case '\n':
-      case '\r':
-      case '\t':
-        return true;
-      default:
-        return false;
+        switch (ch)
+        {
+        case ' ':
+        case '\b':
+        case '\f':
+        case '\n':
+        case '\r':
+        case '\t':
+          return true;
+        default:
+          return false;
+        }
       }
     };
+  }
 
-  struct state
+  // Function objects rather than lambdas so that they can be used in
+  //  constant expressions, see compile_time.hpp
+  CPP_PC__PRELUDE detail::satisfy_digit_function      satisfy_digit       {};
+  CPP_PC__PRELUDE detail::satisfy_whitespace_function satisfy_whitespace  {};
+
+  namespace detail
   {
-    CPP_PC__NO_COPY_MOVE (state);
+    struct none_of_function
+    {
+      char first  ;
+      char second ;
 
-    state ()                              = delete ;
+      CPP_PC__PRELUDE bool operator () (std::size_t, char ch) const noexcept
+      {
+        return ch != first && ch != second;
+      }
+    };
 
-    state (std::size_t error_position, char const * begin, char const * end) noexcept
-      : error_position(error_position)
-      , begin         (std::min (begin, end))
-      , end           (std::max (begin, end))
+    // Finds the first character in [begin, end) that doesn't satisfy
+    //  satisfy_function
+    template<typename TSatisfyFunction>
+    CPP_PC__INLINE char const * scan (char const * begin, char const * end, TSatisfyFunction const & satisfy_function)
     {
-      CPP_PC__ASSERT (begin <= end);
-    }
+      auto current = begin;
 
-    CPP_PC__INLINE int peek (std::size_t position) const noexcept
-    {
-      auto current = begin + position;
-      CPP_PC__ASSERT (current <= end);
-      return
-          current < end
-        ? *current
-        : EOS
+      for (
+        ; current < end && satisfy_function (static_cast<std::size_t> (current - begin), *current)
+        ; ++current
+        )
         ;
-    }
 
-    CPP_PC__INLINE std::size_t remaining (std::size_t position) const noexcept
-    {
-      auto current = begin + position;
-      CPP_PC__ASSERT (current <= end);
-      return end - current;
+      return current;
     }
 
-    template<typename TSatisfyFunction>
-    CPP_PC__INLINE sub_string satisfy (
-        std::size_t position
-      , std::size_t at_most
-      , TSatisfyFunction && satisfy_function
-      ) const noexcept
+    // Searches for first or second 8 characters at a time (SWAR), a word
+    //  containing either is then searched character by character
+    CPP_PC__INLINE char const * scan (char const * begin, char const * end, none_of_function const & satisfy_function) noexcept
     {
-      auto current = begin + position;
-      CPP_PC__ASSERT (current <= end);
+      std::uint64_t const ones    = 0x0101010101010101ULL;
+      std::uint64_t const highs   = 0x8080808080808080ULL;
+      std::uint64_t const first   = ones * static_cast<unsigned char> (satisfy_function.first);
+      std::uint64_t const second  = ones * static_cast<unsigned char> (satisfy_function.second);
 
-      auto rem = remaining (position);
+      auto current = begin;
 
-      auto start  = current;
-      auto last   = start + std::min (rem, at_most);
+      for (; end - current >= 8; current += 8)
+      {
+        std::uint64_t word;
+        std::memcpy (&word, current, sizeof (word));
+
+        // A byte of x is zero where word has first, likewise y and second
+        auto x = word ^ first;
+        auto y = word ^ second;
+        if ((((x - ones) & ~x) | ((y - ones) & ~y)) & highs)
+        {
+          break;
+        }
+      }
 
       for (
-        ; current < last && satisfy_function (static_cast<std::size_t> (current - start), *current)
+        ; current < end && satisfy_function (0, *current)
         ; ++current
         )
         ;
 
-      return sub_string (start, current);
+      return current;
     }
+  }
 
-    CPP_PC__INLINE void append_error (std::size_t position, base_error::ptr const & error) const
+  // Satisfied by any character but first and second. Scanning for the
+  //  characters that end a run, like the quote and backslash of a string,
+  //  is done several characters at a time
+  CPP_PC__PRELUDE auto none_of (char first, char second)
+  {
+    return detail::none_of_function { first, second };
+  }
+
+  namespace detail
+  {
+    // Counts the newlines in [begin, end) 8 characters at a time
+    CPP_PC__INLINE std::size_t count_newlines (char const * begin, char const * end) noexcept
     {
-      if (position == error_position && error)
+      std::uint64_t const lows    = 0x7F7F7F7F7F7F7F7FULL;
+      std::uint64_t const newline = 0x0A0A0A0A0A0A0A0AULL;
+
+      auto count    = std::size_t ();
+      auto current  = begin;
+
+      for (; end - current >= 8; current += 8)
       {
-        errors.push_back (error);
+        std::uint64_t word;
+        std::memcpy (&word, current, sizeof (word));
+
+        // Sets the high bit of exactly the bytes that are zero in x, unlike
+        //  the test in scan there are no false positives
+        auto x      = word ^ newline;
+        auto zeros  = ~(((x & lows) + lows) | x | lows);
+
+        count += std::bitset<64> (zeros).count ();
       }
+
+      for (; current < end; ++current)
+      {
+        count += *current == '\n' ? 1 : 0;
+      }
+
+      return count;
     }
+  }
 
-    std::string error_description () const
+  // Line and column are 1-based
+  struct line_column
+  {
+    std::size_t line    ;
+    std::size_t column  ;
+  };
+
+  // Maps offsets in the input to lines and columns. The index is built on
+  //  first use and holds the number of newlines before each block of the
+  //  input. A lookup is a binary search over the blocks followed by a scan
+  //  of at most two blocks. The input must outlive the index
+  struct line_index
+  {
+    CPP_PC__NO_COPY_MOVE (line_index);
+
+    line_index ()                         = delete ;
+
+    line_index (char const * begin, char const * end) noexcept
+      : begin (begin)
+      , end   (end)
+    {
+      CPP_PC__ASSERT (begin <= end);
+    }
+
+    line_column locate (std::size_t offset) const
+    {
+      build ();
+
+      offset = std::min (offset, size ());
+
+      auto block  = offset / block_size;
+      auto before = counts[block] + detail::count_newlines (begin + block * block_size, begin + offset);
+
+      return line_column { before + 1, offset - line_begin (before) + 1 };
+    }
+
+    // The offset of the first character of the line following the given
+    //  number of newlines
+    std::size_t line_begin (std::size_t newlines) const
+    {
+      build ();
+
+      if (newlines == 0)
+      {
+        return 0;
+      }
+
+      // The last block with fewer newlines before it holds the newline
+      auto find = std::lower_bound (counts.begin (), counts.end (), newlines);
+      CPP_PC__ASSERT (find != counts.begin ());
+
+      auto block    = static_cast<std::size_t> (find - counts.begin ()) - 1;
+      auto remains  = newlines - counts[block];
+      auto current  = begin + block * block_size;
+
+      for (; current < end; ++current)
+      {
+        if (*current == '\n' && --remains == 0)
+        {
+          return static_cast<std::size_t> (current - begin) + 1;
+        }
+      }
+
+      return size ();
+    }
+
+  private:
+    enum
+    {
+      block_size = 4096,
+    };
+
+    CPP_PC__INLINE std::size_t size () const noexcept
+    {
+      return static_cast<std::size_t> (end - begin);
+    }
+
+    CPP_PC__INLINE void build () const
+    {
+      if (!counts.empty ())
+      {
+        return;
+      }
+
+      // counts[b] is the number of newlines before block b, the extra
+      //  entry holds the total
+      auto blocks = size () / block_size + 1;
+      counts.reserve (blocks + 1);
+      counts.push_back (0);
+
+      for (auto block = std::size_t (); block < blocks; ++block)
+      {
+        auto first  = begin + block * block_size;
+        auto last   = begin + std::min (size (), (block + 1) * block_size);
+        counts.push_back (counts.back () + detail::count_newlines (first, last));
+      }
+    }
+
+    char const *                      begin   ;
+    char const *                      end     ;
+    std::vector<std::size_t> mutable counts   ;
+  };
+
+  // A parse failure, the position and the sorted and unique descriptions
+  //  of what was expected and unexpected there. describe formats the
+  //  message, this is only done when a message is requested
+  struct parse_error
+  {
+    CPP_PC__COPY_MOVE (parse_error);
+
+    parse_error () noexcept
+      : position  (0)
+    {
+    }
+
+    parse_error (std::size_t position, std::vector<std::string> expected, std::vector<std::string> unexpected)
+      : position  (position)
+      , expected  (std::move (expected))
+      , unexpected(std::move (unexpected))
+    {
+      normalize (this->expected);
+      normalize (this->unexpected);
+    }
+
+    CPP_PC__INLINE line_column locate (line_index const & index) const
+    {
+      return index.locate (position);
+    }
+
+    // The message, with a window of the input [begin, end) around position
+    std::string describe (char const * begin, char const * end) const
     {
       CPP_PC__ASSERT (begin <= end);
 
@@ -242,7 +448,7 @@ namespace cpp_pc
       auto input_sz         = static_cast<std::size_t> (end - begin);
       auto wsize            = std::min (input_sz, 80U - prelude.size ());
       auto hwsize           = wsize / 2;
-      auto desired_err_pos  = std::min (error_position, input_sz);
+      auto desired_err_pos  = std::min (position, input_sz);
       auto err_pos          = static_cast<std::size_t> (0);
 
       std::string input;
@@ -284,145 +490,252 @@ namespace cpp_pc
         << desired_err_pos
         ;
 
-      detail::collect_error_visitor visitor;
-      for (auto && error : errors)
-      {
-        error->apply (visitor);
-      }
-
-      if (!visitor.expected.empty ())
-      {
-        auto & vs = visitor.expected;
-        std::sort (vs.begin (), vs.end ());
-        vs.erase (std::unique (vs.begin (), vs.end ()), vs.end ());
+      list (o, "  Expected", " or ", expected);
+      list (o, "  Unexpected", " nor ", unexpected);
 
-        o
-          << std::endl
-          << "  Expected"
-          ;
+      return o.str ();
+    }
 
-        auto sz = vs.size ();
-        for (auto iter = 0U; iter < sz; ++iter)
-        {
-          auto & e = vs[iter];
+    std::size_t               position  ;
+    std::vector<std::string>  expected  ;
+    std::vector<std::string>  unexpected;
 
-          if (iter == 0)
-          {
-            o << ' ';
-          }
-          else if (iter + 1 == sz && sz > 1)
-          {
-            o << " or ";
-          }
-          else
-          {
-            o << ", ";
-          }
+  private:
+    static void normalize (std::vector<std::string> & vs)
+    {
+      std::sort (vs.begin (), vs.end ());
+      vs.erase (std::unique (vs.begin (), vs.end ()), vs.end ());
+    }
 
-          o << e;
-        }
+    static void list (std::ostream & o, char const * heading, char const * last_separator, std::vector<std::string> const & vs)
+    {
+      if (vs.empty ())
+      {
+        return;
       }
 
-      if (!visitor.unexpected.empty ())
-      {
-        auto & vs = visitor.expected;
-        std::sort (vs.begin (), vs.end ());
-        vs.erase (std::unique (vs.begin (), vs.end ()), vs.end ());
+      o
+        << std::endl
+        << heading
+        ;
 
-        o
-          << std::endl
-          << "  Unexpected"
-          ;
+      auto sz = vs.size ();
+      for (auto iter = 0U; iter < sz; ++iter)
+      {
+        auto & v = vs[iter];
 
-        auto sz = vs.size ();
-        for (auto iter = 0U; iter < sz; ++iter)
+        if (iter == 0)
         {
-          auto & ue = vs[iter];
-
-          if (iter == 0)
-          {
-            o << ' ';
-          }
-          else if (iter + 1 == sz && sz > 1)
-          {
-            o << " nor ";
-          }
-          else
-          {
-            o << ", ";
-          }
-
-          o << ue;
+          o << ' ';
+        }
+        else if (iter + 1 == sz && sz > 1)
+        {
+          o << last_separator;
+        }
+        else
+        {
+          o << ", ";
         }
-      }
 
-      return o.str ();
+        o << v;
+      }
     }
-
-
-    std::size_t const   error_position;
-    char const * const  begin         ;
-    char const * const  end           ;
-
-    base_errors mutable errors        ;
   };
 
-  template<typename TValue>
-  struct result
+  struct state
   {
-    using value_type = detail::strip_type_t<TValue> ;
-
-    CPP_PC__COPY_MOVE (result);
+    CPP_PC__NO_COPY_MOVE (state);
 
-    result ()                             = delete ;
+    state ()                              = delete ;
 
-    CPP_PC__PRELUDE explicit result (std::size_t position)
-      : position  (position)
+    state (std::size_t error_position, char const * begin, char const * end) noexcept
+      : error_position(error_position)
+      , begin         (std::min (begin, end))
+      , end           (std::max (begin, end))
+      , committed     (false)
     {
+      CPP_PC__ASSERT (begin <= end);
+      CPP_PC__ASSERT (fits (begin, end));
     }
 
-    CPP_PC__PRELUDE explicit result (std::size_t position, value_type const & o)
-      : position  (position)
-      , value     (o)
+    // Retargets the state to new input, keeps the capacity of errors
+    //  so that a state can be reused for many parses
+    CPP_PC__INLINE void reset (std::size_t error_position, char const * begin, char const * end) noexcept
     {
-    }
+      CPP_PC__ASSERT (begin <= end);
+      CPP_PC__ASSERT (fits (begin, end));
 
-    CPP_PC__PRELUDE explicit result (std::size_t position, value_type && o)
-      : position  (position)
-      , value     (std::move (o))
-    {
+      this->error_position  = error_position;
+      this->begin           = std::min (begin, end);
+      this->end             = std::max (begin, end);
+      this->committed       = false;
+
+      errors.clear ();
     }
 
-    CPP_PC__PRELUDE bool operator == (result const & o) const
+    CPP_PC__INLINE int peek (std::size_t position) const noexcept
     {
+      auto current = begin + position;
+      CPP_PC__ASSERT (current <= end);
       return
-            position  == o.position
-        &&  value     == o.value
+          current < end
+        ? *current
+        : EOS
         ;
     }
 
-    CPP_PC__INLINE result<value_type> & reposition (std::size_t p)
+    CPP_PC__INLINE std::size_t remaining (std::size_t position) const noexcept
     {
-      position = p;
-      return *this;
+      auto current = begin + position;
+      CPP_PC__ASSERT (current <= end);
+      return end - current;
     }
 
-    CPP_PC__PRELUDE static auto success (std::size_t pos, value_type && v)
+    template<typename TSatisfyFunction>
+    CPP_PC__INLINE sub_string satisfy (
+        std::size_t position
+      , std::size_t at_most
+      , TSatisfyFunction && satisfy_function
+      ) const noexcept
     {
-      return result<value_type> (pos, std::move (v));
-    }
+      auto current = begin + position;
+      CPP_PC__ASSERT (current <= end);
 
-    CPP_PC__PRELUDE static auto success (std::size_t pos, value_type const & v)
-    {
-      return result<value_type> (pos, v);
-    }
+      auto rem = remaining (position);
 
-    CPP_PC__PRELUDE static auto failure (std::size_t pos)
+      auto start  = current;
+      auto last   = start + std::min (rem, at_most);
+
+      return sub_string (start, detail::scan (start, last, satisfy_function));
+    }
+
+    // Like satisfy but only returns the number of characters that satisfied
+    //  satisfy_function, used when the characters themselves are skipped
+    template<typename TSatisfyFunction>
+    CPP_PC__INLINE std::size_t skip_satisfy (
+        std::size_t position
+      , std::size_t at_most
+      , TSatisfyFunction && satisfy_function
+      ) const noexcept
+    {
+      return satisfy (position, at_most, std::forward<TSatisfyFunction> (satisfy_function)).size ();
+    }
+
+    CPP_PC__INLINE void append_error (std::size_t position, base_error::ptr const & error) const
+    {
+      if (position == error_position && error)
+      {
+        errors.push_back (error);
+      }
+    }
+
+    // Collects the errors appended at error_position, no message is
+    //  formatted until parse_error::describe is called
+    parse_error error () const
+    {
+      detail::collect_error_visitor visitor;
+      for (auto && error : errors)
+      {
+        error->apply (visitor);
+      }
+
+      return parse_error (error_position, std::move (visitor.expected), std::move (visitor.unexpected));
+    }
+
+    std::string error_description () const
+    {
+      CPP_PC__ASSERT (begin <= end);
+
+      return error ().describe (begin, end);
+    }
+
+    // True if positions in [begin, end] fit in position_type
+    static CPP_PC__INLINE bool fits (char const * begin, char const * end) noexcept
+    {
+      return static_cast<std::size_t> (std::max (begin, end) - std::min (begin, end)) <= std::numeric_limits<position_type>::max ();
+    }
+
+
+    std::size_t         error_position;
+    char const *        begin         ;
+    char const *        end           ;
+
+    base_errors mutable errors        ;
+    // Set when a parser wrapped in pcut failed, see pcut
+    bool mutable        committed     ;
+  };
+
+  template<typename TValue>
+  struct result
+  {
+    using value_type = detail::strip_type_t<TValue> ;
+
+    CPP_PC__COPY_MOVE (result);
+
+    result ()                             = delete ;
+
+    CPP_PC__PRELUDE explicit result (std::size_t position)
+      : position  (static_cast<position_type> (position))
+    {
+    }
+
+    CPP_PC__PRELUDE explicit result (std::size_t position, value_type const & o)
+      : position  (static_cast<position_type> (position))
+      , value     (o)
+    {
+    }
+
+    CPP_PC__PRELUDE explicit result (std::size_t position, value_type && o)
+      : position  (static_cast<position_type> (position))
+      , value     (std::move (o))
+    {
+    }
+
+    template<typename ...TArgs>
+    CPP_PC__PRELUDE explicit result (std::size_t position, in_place_type, TArgs && ...args)
+      : position  (static_cast<position_type> (position))
+      , value     (in_place, std::forward<TArgs> (args)...)
+    {
+    }
+
+    CPP_PC__PRELUDE bool operator == (result const & o) const
+    {
+      return
+            position  == o.position
+        &&  value     == o.value
+        ;
+    }
+
+    CPP_PC__INLINE result<value_type> & reposition (std::size_t p)
+    {
+      position = static_cast<position_type> (p);
+      return *this;
+    }
+
+    CPP_PC__PRELUDE static auto success (std::size_t pos, value_type && v)
+    {
+      return result<value_type> (pos, std::move (v));
+    }
+
+    CPP_PC__PRELUDE static auto success (std::size_t pos, value_type const & v)
+    {
+      return result<value_type> (pos, v);
+    }
+
+    // Constructs the value in place from args
+    template<typename ...TArgs>
+    CPP_PC__PRELUDE static auto success (std::size_t pos, in_place_type, TArgs && ...args)
+    {
+      return result<value_type> (pos, in_place, std::forward<TArgs> (args)...);
+    }
+
+    CPP_PC__PRELUDE static auto failure (std::size_t pos)
     {
       return result<value_type> (pos);
     }
 
-    std::size_t     position  ;
+    // See CPP_PC__POSITION_TYPE
+    position_type   position  ;
     opt<value_type> value     ;
   };
 
@@ -441,12 +754,16 @@ namespace cpp_pc
     struct is_parser;
   }
 
-  template<typename TValue, typename TParserFunction>
+  // TState is the state the parser is intended for. Combinators are generic
+  //  over the state so a parser may be invoked with any state providing the
+  //  members the parser uses (peek, satisfy, append_error, ...)
+  template<typename TValue, typename TParserFunction, typename TState = state>
   struct parser
   {
     using parser_function_type  = TParserFunction;
+    using state_type            = TState;
     using value_type            = detail::strip_type_t<TValue>;
-    using result_type           = detail::strip_type_t<std::result_of_t<parser_function_type (state const &, std::size_t)>>;
+    using result_type           = detail::strip_type_t<std::result_of_t<parser_function_type (state_type const &, std::size_t)>>;
 
     parser_function_type parser_function;
 
@@ -489,14 +806,14 @@ namespace cpp_pc
 
   namespace detail
   {
-    template<typename TParserFunction>
+    template<typename TState = state, typename TParserFunction>
     CPP_PC__PRELUDE auto adapt_parser_function (TParserFunction && parser_function)
     {
-      using parser_function_type  = strip_type_t<TParserFunction>                                                     ;
-      using parser_result_type    = strip_type_t<std::result_of_t<parser_function_type (state const &, std::size_t)>> ;
-      using value_type            = typename parser_result_type::value_type                                           ;
+      using parser_function_type  = strip_type_t<TParserFunction>                                                       ;
+      using parser_result_type    = strip_type_t<std::result_of_t<parser_function_type (TState const &, std::size_t)>>  ;
+      using value_type            = typename parser_result_type::value_type                                             ;
 
-      return parser<value_type, parser_function_type> (std::forward<TParserFunction> (parser_function));
+      return parser<value_type, parser_function_type, TState> (std::forward<TParserFunction> (parser_function));
     }
 
     template<typename T>
@@ -508,8 +825,8 @@ namespace cpp_pc
       };
     };
 
-    template<typename TValue, typename TParserFunction>
-    struct is_parser_impl<parser<TValue, TParserFunction>>
+    template<typename TValue, typename TParserFunction, typename TState>
+    struct is_parser_impl<parser<TValue, TParserFunction, TState>>
     {
       enum
       {
@@ -529,8 +846,8 @@ namespace cpp_pc
     template<typename T>
     struct parser_value_type_impl;
 
-    template<typename TValue, typename TParserFunction>
-    struct parser_value_type_impl<parser<TValue, TParserFunction>>
+    template<typename TValue, typename TParserFunction, typename TState>
+    struct parser_value_type_impl<parser<TValue, TParserFunction, TState>>
     {
       using type = TValue ;
     };
@@ -544,6 +861,31 @@ namespace cpp_pc
     template<typename T>
     using parser_value_type_t = typename parser_value_type<T>::type;
 
+    template<typename T>
+    using parser_state_type_t = typename strip_type_t<T>::state_type;
+
+    // The state of a composed parser is the first state of the parts that
+    //  isn't the default character state
+    template<typename ...TParsers>
+    struct common_state_type;
+
+    template<>
+    struct common_state_type<>
+    {
+      using type = state;
+    };
+
+    template<typename THead, typename ...TTail>
+    struct common_state_type<THead, TTail...>
+    {
+      using head_type = parser_state_type_t<THead>;
+      using tail_type = typename common_state_type<TTail...>::type;
+
+      using type = std::conditional_t<std::is_same<head_type, state>::value, tail_type, head_type>;
+    };
+
+    template<typename ...TParsers>
+    using common_state_type_t = typename common_state_type<TParsers...>::type;
   }
 
   template<typename TValueType, typename TParserFunction>
@@ -567,22 +909,41 @@ namespace cpp_pc
       : consumed(consumed)
       , value   (std::move (value))
       , message (std::move (message))
+    {
+      error.position = consumed;
+    }
+
+    parse_result (std::size_t consumed, opt<value_type> value, std::string message, parse_error error)
+      : consumed(consumed)
+      , value   (std::move (value))
+      , message (std::move (message))
+      , error   (std::move (error))
     {
     }
 
     std::size_t     consumed;
     opt<value_type> value   ;
     std::string     message ;
+    // On failure, the error the message was formatted from
+    parse_error     error   ;
   };
 
-  template<typename TValueType, typename TParserFunction>
-  CPP_PC__INLINE auto parse (parser<TValueType, TParserFunction> const & p, std::string const & i)
+  namespace detail
   {
-    auto begin  = i.c_str ();
-    auto end    = begin + i.size ();
-
+    // s and es are reset before use, this allows callers to reuse states
+    //  (and the capacity of their error buffers) between parses
+    // message is only formatted if describe is true
+    template<typename TValueType, typename TParserFunction>
+    CPP_PC__INLINE auto parse_using (
+        parser<TValueType, TParserFunction> const & p
+      , state &                                     s
+      , state &                                     es
+      , char const *                                begin
+      , char const *                                end
+      , bool                                        describe = true
+      )
     {
-      state s (SIZE_MAX, begin, end);
+      s.reset (SIZE_MAX, begin, end);
       auto v = p.parser_function (s, 0);
       if (v.value)
       {
@@ -590,24 +951,112 @@ namespace cpp_pc
       }
       else
       {
-        state es (v.position, begin, end);
+        es.reset (v.position, begin, end);
         auto ev = p.parser_function (es, 0);
 
         CPP_PC__ASSERT (v.position == ev.position);
         CPP_PC__ASSERT (!ev.value);
 
-        return parse_result<TValueType> (ev.position, empty_opt, es.error_description ());
+        auto error    = es.error ();
+        auto message  = describe ? error.describe (begin, end) : std::string ();
+        return parse_result<TValueType> (ev.position, empty_opt, std::move (message), std::move (error));
       }
     }
   }
 
+  // A parse_session owns the states used while parsing and reuses them (and
+  //  the capacity of their error buffers) between parses
+  //  A session must only be used by one thread at a time. Parsers hold no
+  //  mutable state so a single grammar object may be used concurrently by
+  //  any number of sessions on different threads
+  struct parse_session
+  {
+    CPP_PC__NO_COPY_MOVE (parse_session);
+
+    parse_session () noexcept
+      : s   (SIZE_MAX, nullptr, nullptr)
+      , es  (SIZE_MAX, nullptr, nullptr)
+    {
+    }
+
+    template<typename TValueType, typename TParserFunction>
+    CPP_PC__INLINE auto parse (parser<TValueType, TParserFunction> const & p, char const * begin, char const * end)
+    {
+      return detail::parse_using (p, s, es, begin, end);
+    }
+
+    template<typename TValueType, typename TParserFunction>
+    CPP_PC__INLINE auto parse (parser<TValueType, TParserFunction> const & p, std::string const & i)
+    {
+      auto begin  = i.c_str ();
+      auto end    = begin + i.size ();
+
+      return parse (p, begin, end);
+    }
+
+  private:
+    state s ;
+    state es;
+  };
+
+  // Returns a session private to the calling thread. Parsers must not call
+  //  parse on this session recursively
+  CPP_PC__INLINE parse_session & this_thread_session ()
+  {
+    thread_local parse_session session;
+    return session;
+  }
+
+  template<typename TValueType, typename TParserFunction>
+  CPP_PC__INLINE auto parse (parser<TValueType, TParserFunction> const & p, char const * begin, char const * end)
+  {
+    state s   (SIZE_MAX, begin, end);
+    state es  (SIZE_MAX, begin, end);
+    return detail::parse_using (p, s, es, begin, end);
+  }
+
+  template<typename TValueType, typename TParserFunction>
+  CPP_PC__INLINE auto parse (parser<TValueType, TParserFunction> const & p, std::string const & i)
+  {
+    auto begin  = i.c_str ();
+    auto end    = begin + i.size ();
+
+    return parse (p, begin, end);
+  }
+
+  // Like parse but message is left empty, on failure error describes the
+  //  failure and formats a message on demand. Line and column are found with
+  //  a line_index over the input:
+  //    auto r = try_parse (p, begin, end);
+  //    if (!r.value)
+  //    {
+  //      line_index index (begin, end);
+  //      auto lc = r.error.locate (index);
+  //    }
+  template<typename TValueType, typename TParserFunction>
+  CPP_PC__INLINE auto try_parse (parser<TValueType, TParserFunction> const & p, char const * begin, char const * end)
+  {
+    state s   (SIZE_MAX, begin, end);
+    state es  (SIZE_MAX, begin, end);
+    return detail::parse_using (p, s, es, begin, end, false);
+  }
+
+  template<typename TValueType, typename TParserFunction>
+  CPP_PC__INLINE auto try_parse (parser<TValueType, TParserFunction> const & p, std::string const & i)
+  {
+    auto begin  = i.c_str ();
+    auto end    = begin + i.size ();
+
+    return try_parse (p, begin, end);
+  }
+
   // parser<'T> = state -> result<'T>
 
   template<typename TValue>
   CPP_PC__PRELUDE auto preturn (TValue && v)
   {
     return detail::adapt_parser_function (
-      [v = std::forward<TValue> (v)] (state const &, std::size_t position)
+      [v = std::forward<TValue> (v)] (auto const &, std::size_t position)
       {
         using result_type = result<detail::strip_type_t<decltype (v)>>;
 
@@ -617,7 +1066,7 @@ namespace cpp_pc
 
   auto const punit =
     detail::adapt_parser_function (
-      [] (state const &, std::size_t position)
+      [] (auto const &, std::size_t position)
       {
         using result_type = result<unit_type>;
 
@@ -629,8 +1078,8 @@ namespace cpp_pc
   {
     CPP_PC__CHECK_PARSER (t);
 
-    return detail::adapt_parser_function (
-      [t = std::forward<TParser> (t), fu = std::forward<TParserGenerator> (fu)] (state const & s, std::size_t position)
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser>> (
+      [t = std::forward<TParser> (t), fu = std::forward<TParserGenerator> (fu)] (auto const & s, std::size_t position)
       {
         auto tv = t.parser_function (s, position);
 
@@ -647,16 +1096,219 @@ namespace cpp_pc
       });
   }
 
-  template<typename TParser, typename TOtherParser>
-  CPP_PC__PRELUDE auto pleft (TParser && t, TOtherParser && u)
+  namespace detail
   {
-    CPP_PC__CHECK_PARSER (t);
-    CPP_PC__CHECK_PARSER (u);
+    // The skip and character class parsers are named function objects
+    //  rather than lambdas so that pchoice can recognize them and rewrite
+    //  choices at compile time:
+    //    pchoice (pchoice (a, b), c)               => pchoice (a, b, c)
+    //    pchoice (pany_of ("+-"), pany_of ("*/"))  => pany_of ("+-*/")
+    //  The rewritten parsers produce the same results and errors
+
+    struct skip_char_step
+    {
+      char            ch    ;
+      base_error::ptr error ;
 
-    return detail::adapt_parser_function (
-      [t = std::forward<TParser> (t), u = std::forward<TOtherParser> (u)] (state const & s, std::size_t position)
+      template<typename TState>
+      CPP_PC__INLINE bool apply (TState const & s, std::size_t & position) const
       {
-        using result_type = detail::strip_type_t<decltype (t.parser_function (s, 0))>;
+        s.append_error (position, error);
+
+        if (s.peek (position) == ch)
+        {
+          ++position;
+          return true;
+        }
+        else
+        {
+          return false;
+        }
+      }
+    };
+
+    struct skip_whitespace_step
+    {
+      base_error::ptr error ;
+
+      template<typename TState>
+      CPP_PC__INLINE bool apply (TState const & s, std::size_t & position) const
+      {
+        position += s.skip_satisfy (position, SIZE_MAX, satisfy_whitespace);
+
+        s.append_error (position, error);
+
+        return true;
+      }
+    };
+
+    template<typename TStep>
+    struct skip_function
+    {
+      TStep step;
+
+      template<typename TState>
+      CPP_PC__INLINE result<unit_type> operator () (TState const & s, std::size_t position) const
+      {
+        using result_type = result<unit_type>;
+
+        if (step.apply (s, position))
+        {
+          return result_type::success (position, unit);
+        }
+        else
+        {
+          return result_type::failure (position);
+        }
+      }
+    };
+
+    CPP_PC__INLINE char char_class_value (char ch, char)
+    {
+      return ch;
+    }
+
+    CPP_PC__INLINE unit_type char_class_value (char, unit_type)
+    {
+      return unit;
+    }
+
+    // Matches any character in a set, produces the character (pany_of) or
+    //  unit (merged pskip_char alternatives)
+    template<typename TValue>
+    struct any_of_function
+    {
+      CPP_PC__COPY_MOVE (any_of_function);
+
+      any_of_function () noexcept
+        : chars {}
+      {
+      }
+
+      explicit any_of_function (std::string const & expected)
+        : chars {}
+      {
+        for (auto ch : expected)
+        {
+          add (ch, char_to_expected (ch));
+        }
+      }
+
+      void add (char ch, base_error::ptr error)
+      {
+        auto uch = static_cast<unsigned char> (ch);
+        chars[uch / 64] |= 1ULL << (uch % 64);
+        errors.push_back (std::move (error));
+      }
+
+      void merge (any_of_function const & o)
+      {
+        for (auto iter = 0U; iter < 4U; ++iter)
+        {
+          chars[iter] |= o.chars[iter];
+        }
+        errors.insert (errors.end (), o.errors.begin (), o.errors.end ());
+      }
+
+      CPP_PC__INLINE bool contains (int peek) const noexcept
+      {
+        if (peek < -128 || peek > 255)
+        {
+          return false;
+        }
+
+        auto uch = static_cast<unsigned char> (peek);
+        return (chars[uch / 64] & (1ULL << (uch % 64))) != 0;
+      }
+
+      CPP_PC__INLINE bool satisfied (char ch) const noexcept
+      {
+        return contains (ch);
+      }
+
+      template<typename TState>
+      CPP_PC__INLINE void append_errors (TState const & s, std::size_t position) const
+      {
+        if (position == s.error_position)
+        {
+          for (auto && error : errors)
+          {
+            s.append_error (position, error);
+          }
+        }
+      }
+
+      template<typename TState>
+      CPP_PC__INLINE result<TValue> operator () (TState const & s, std::size_t position) const
+      {
+        using result_type = result<TValue>  ;
+
+        append_errors (s, position);
+
+        auto peek = s.peek (position);
+        if (!contains (peek))
+        {
+          return result_type::failure (position);
+        }
+
+        return result_type::success (position + 1, char_class_value (static_cast<char> (peek), TValue ()));
+      }
+
+      std::uint64_t chars [4] ;
+      base_errors   errors    ;
+    };
+
+    template<typename TSatisfyFunction>
+    struct satisfy_char_function
+    {
+      base_error::ptr   error             ;
+      TSatisfyFunction  satisfy_function  ;
+
+      CPP_PC__INLINE bool satisfied (char ch) const
+      {
+        return satisfy_function (0, ch);
+      }
+
+      template<typename TState>
+      CPP_PC__INLINE void append_errors (TState const & s, std::size_t position) const
+      {
+        s.append_error (position, error);
+      }
+
+      template<typename TState>
+      CPP_PC__INLINE result<char> operator () (TState const & s, std::size_t position) const
+      {
+        using result_type = result<char>  ;
+
+        append_errors (s, position);
+
+        auto peek = s.peek (position);
+        if (peek == EOS)
+        {
+          return result_type::failure (position);
+        }
+
+        auto result = static_cast<char> (peek);
+
+        if (!satisfied (result))
+        {
+          return result_type::failure (position);
+        }
+
+        return result_type::success (position + 1, result);
+      }
+    };
+
+    template<typename TParser, typename TOtherParser>
+    struct pleft_function
+    {
+      TParser       t;
+      TOtherParser  u;
+
+      template<typename TState>
+      CPP_PC__INLINE auto operator () (TState const & s, std::size_t position) const
+      {
+        using result_type = strip_type_t<decltype (t.parser_function (s, 0))>;
 
         auto tv = t.parser_function (s, position);
         if (tv.value)
@@ -664,9 +1316,9 @@ namespace cpp_pc
           auto uv = u.parser_function (s, tv.position);
           if (uv.value)
           {
-            return tv
-              .reposition (uv.position)
-              ;
+            // reposition returns a reference, returning it would copy the value
+            tv.reposition (uv.position);
+            return tv;
           }
           else
           {
@@ -677,19 +1329,19 @@ namespace cpp_pc
         {
           return tv;
         }
-      });
-  }
+      }
+    };
 
-  template<typename TParser, typename TOtherParser>
-  CPP_PC__PRELUDE auto pright (TParser && t, TOtherParser && u)
-  {
-    CPP_PC__CHECK_PARSER (t);
-    CPP_PC__CHECK_PARSER (u);
+    template<typename TParser, typename TOtherParser>
+    struct pright_function
+    {
+      TParser       t;
+      TOtherParser  u;
 
-    return detail::adapt_parser_function (
-      [t = std::forward<TParser> (t), u = std::forward<TOtherParser> (u)] (state const & s, std::size_t position)
+      template<typename TState>
+      CPP_PC__INLINE auto operator () (TState const & s, std::size_t position) const
       {
-        using result_type = detail::strip_type_t<decltype (u.parser_function (s, 0))>;
+        using result_type = strip_type_t<decltype (u.parser_function (s, 0))>;
 
         auto tv = t.parser_function (s, position);
         if (tv.value)
@@ -700,7 +1352,30 @@ namespace cpp_pc
         {
           return result_type::failure (tv.position);
         }
-      });
+      }
+    };
+  }
+
+  template<typename TParser, typename TOtherParser>
+  CPP_PC__PRELUDE auto pleft (TParser && t, TOtherParser && u)
+  {
+    CPP_PC__CHECK_PARSER (t);
+    CPP_PC__CHECK_PARSER (u);
+
+    using function_type = detail::pleft_function<detail::strip_type_t<TParser>, detail::strip_type_t<TOtherParser>>;
+
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser, TOtherParser>> (function_type { std::forward<TParser> (t), std::forward<TOtherParser> (u) });
+  }
+
+  template<typename TParser, typename TOtherParser>
+  CPP_PC__PRELUDE auto pright (TParser && t, TOtherParser && u)
+  {
+    CPP_PC__CHECK_PARSER (t);
+    CPP_PC__CHECK_PARSER (u);
+
+    using function_type = detail::pright_function<detail::strip_type_t<TParser>, detail::strip_type_t<TOtherParser>>;
+
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser, TOtherParser>> (function_type { std::forward<TParser> (t), std::forward<TOtherParser> (u) });
   }
 
   template<typename TParser, typename TMapper>
@@ -708,8 +1383,8 @@ namespace cpp_pc
   {
     CPP_PC__CHECK_PARSER (t);
 
-    return detail::adapt_parser_function (
-      [t = std::forward<TParser> (t), m = std::forward<TMapper> (m)] (state const & s, std::size_t position)
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser>> (
+      [t = std::forward<TParser> (t), m = std::forward<TMapper> (m)] (auto const & s, std::size_t position)
       {
         auto tv = t.parser_function (s, position);
 
@@ -722,33 +1397,62 @@ namespace cpp_pc
         }
         else
         {
-          return result_type::failure (tv.position);
+          return result_type::failure (tv.position);
+        }
+      });
+  }
+
+  template<typename TParser>
+  CPP_PC__PRELUDE auto popt (TParser && t)
+  {
+    CPP_PC__CHECK_PARSER (t);
+
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser>> (
+      [t = std::forward<TParser> (t)] (auto const & s, std::size_t position)
+      {
+        using tresult_type= detail::strip_type_t<decltype (t.parser_function (s, 0))> ;
+        using tvalue_type = typename tresult_type::value_type                         ;
+        using result_type = result<opt<tvalue_type>>                                  ;
+
+        auto tv = t.parser_function (s, position);
+
+        if (tv.value)
+        {
+          return result_type::success (tv.position, std::move (tv.value));
+        }
+        else if (s.committed)
+        {
+          return result_type::failure (tv.position);
+        }
+        else
+        {
+          return result_type::success (position, empty_opt);
         }
       });
   }
 
+  // Commits to t, when t fails the enclosing parsers fail as well instead of
+  //  backtracking, ie pchoice doesn't try the remaining alternatives and
+  //  popt and pmany don't succeed with what was parsed before. The error is
+  //  reported where t failed rather than where an alternative got furthest
+  //  Applied after the prefix that identifies an alternative, like
+  //  pskip_char ('{') < pcut (pmembers)
   template<typename TParser>
-  CPP_PC__PRELUDE auto popt (TParser && t)
+  CPP_PC__PRELUDE auto pcut (TParser && t)
   {
     CPP_PC__CHECK_PARSER (t);
 
-    return detail::adapt_parser_function (
-      [t = std::forward<TParser> (t)] (state const & s, std::size_t position)
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser>> (
+      [t = std::forward<TParser> (t)] (auto const & s, std::size_t position)
       {
-        using tresult_type= detail::strip_type_t<decltype (t.parser_function (s, 0))> ;
-        using tvalue_type = typename tresult_type::value_type                         ;
-        using result_type = result<opt<tvalue_type>>                                  ;
-
         auto tv = t.parser_function (s, position);
 
-        if (tv.value)
-        {
-          return result_type::success (tv.position, std::move (tv.value));
-        }
-        else
+        if (!tv.value)
         {
-          return result_type::success (position, empty_opt);
+          s.committed = true;
         }
+
+        return tv;
       });
   }
 
@@ -757,8 +1461,8 @@ namespace cpp_pc
   {
     CPP_PC__CHECK_PARSER (t);
 
-    return detail::adapt_parser_function (
-      [at_least, at_most, t = std::forward<TParser> (t)] (state const & s, std::size_t position)
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser>> (
+      [at_least, at_most, t = std::forward<TParser> (t)] (auto const & s, std::size_t position)
       {
         using tresult_type = detail::strip_type_t<decltype (t.parser_function (s, 0))>;
         using tvalue_type  = typename tresult_type::value_type                        ;
@@ -782,6 +1486,11 @@ namespace cpp_pc
           auto tv = t.parser_function (s, current);
           if (!tv.value)
           {
+            if (s.committed)
+            {
+              return result_type::failure (tv.position);
+            }
+
             cont = false;
             continue;
           }
@@ -826,8 +1535,8 @@ namespace cpp_pc
     CPP_PC__CHECK_PARSER (t);
     CPP_PC__CHECK_PARSER (sep_parser);
 
-    return detail::adapt_parser_function (
-      [at_least, at_most, allow_trailing_sep, t = std::forward<TParser> (t), sep_parser = std::forward<TSepParser> (sep_parser)] (state const & s, std::size_t position)
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser, TSepParser>> (
+      [at_least, at_most, allow_trailing_sep, t = std::forward<TParser> (t), sep_parser = std::forward<TSepParser> (sep_parser)] (auto const & s, std::size_t position)
       {
         using tresult_type = detail::strip_type_t<decltype (t.parser_function (s, 0))>          ;
         using tvalue_type  = typename tresult_type::value_type                                  ;
@@ -851,6 +1560,11 @@ namespace cpp_pc
           auto tv = t.parser_function (s, current);
           if (!tv.value)
           {
+            if (s.committed)
+            {
+              return result_type::failure (tv.position);
+            }
+
             return result_type::success (current, std::move (values));
           }
 
@@ -872,6 +1586,11 @@ namespace cpp_pc
           auto sv = sep_parser.parser_function (s, current);
           if (!sv.value)
           {
+            if (s.committed)
+            {
+              return result_type::failure (sv.position);
+            }
+
             cont = false;
             continue;
           }
@@ -881,7 +1600,7 @@ namespace cpp_pc
           auto tv = t.parser_function (s, current);
           if (!tv.value)
           {
-            if (allow_trailing_sep)
+            if (allow_trailing_sep && !s.committed)
             {
               cont = false;
               continue;
@@ -946,55 +1665,250 @@ namespace cpp_pc
     return pmany_sepby (1, SIZE_MAX, false, std::forward<TParser> (t), std::forward<TSepParser> (sep_parser));
   }
 
+  // Like pmany but the values of t are discarded rather than collected,
+  //  doesn't allocate
   template<typename TParser>
-  CPP_PC__PRELUDE auto pmany_char (std::size_t at_least, std::size_t at_most, TParser && t)
+  CPP_PC__PRELUDE auto pskip_many (std::size_t at_least, std::size_t at_most, TParser && t)
   {
     CPP_PC__CHECK_PARSER (t);
 
-    return detail::adapt_parser_function (
-      [at_least, at_most, t = std::forward<TParser> (t)] (state const & s, std::size_t position)
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser>> (
+      [at_least, at_most, t = std::forward<TParser> (t)] (auto const & s, std::size_t position)
       {
-        using tresult_type  = detail::strip_type_t<decltype (t.parser_function (s, 0))> ;
-        using tvalue_type   = typename tresult_type::value_type                         ;
-        using result_type   = result<std::string>                                       ;
+        using result_type = result<unit_type>;
 
-        static_assert (std::is_same<char, tvalue_type>::value, "Parser passed to pmany_chars must return value of type char");
+        auto count    = std::size_t ();
+        auto current  = position;
 
-        std::string values;
-        values.reserve (at_least);
+        while (count < at_most)
+        {
+          auto tv = t.parser_function (s, current);
+          if (!tv.value)
+          {
+            if (s.committed)
+            {
+              return result_type::failure (tv.position);
+            }
 
-        auto current = position;
+            break;
+          }
 
-        auto cont = true;
+          ++count;
 
-        while (cont)
+          current = tv.position;
+        }
+
+        if (count >= at_least)
         {
-          if (values.size () >= at_most)
+          return result_type::success (current, unit);
+        }
+        else
+        {
+          return result_type::failure (current);
+        }
+      });
+  }
+
+  template<typename TParser>
+  CPP_PC__PRELUDE auto pskip_many (TParser && t)
+  {
+    return pskip_many (0, SIZE_MAX, std::forward<TParser> (t));
+  }
+
+  // Like pmany_sepby but the values of t are discarded rather than
+  //  collected, doesn't allocate
+  template<typename TParser, typename TSepParser>
+  CPP_PC__PRELUDE auto pskip_many_sepby (
+      TParser &&    t
+    , TSepParser && sep_parser
+    )
+  {
+    CPP_PC__CHECK_PARSER (t);
+    CPP_PC__CHECK_PARSER (sep_parser);
+
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser, TSepParser>> (
+      [t = std::forward<TParser> (t), sep_parser = std::forward<TSepParser> (sep_parser)] (auto const & s, std::size_t position)
+      {
+        using result_type = result<unit_type>;
+
+        auto tv = t.parser_function (s, position);
+        if (!tv.value)
+        {
+          if (s.committed)
           {
-            cont = false;
-            continue;
+            return result_type::failure (tv.position);
           }
 
-          auto tv = t.parser_function (s, current);
-          if (!tv.value)
+          return result_type::success (position, unit);
+        }
+
+        auto current = tv.position;
+
+        while (true)
+        {
+          auto sv = sep_parser.parser_function (s, current);
+          if (!sv.value)
           {
-            cont = false;
-            continue;
+            if (s.committed)
+            {
+              return result_type::failure (sv.position);
+            }
+
+            break;
           }
 
-          values.push_back (std::move (tv.value.get ()));
+          auto nv = t.parser_function (s, sv.position);
+          if (!nv.value)
+          {
+            return result_type::failure (nv.position);
+          }
 
-          current = tv.position;
+          current = nv.position;
         }
 
-        if (values.size () >= at_least)
+        return result_type::success (current, unit);
+      });
+  }
+
+  namespace detail
+  {
+    // Parsers that consume one character if it satisfies a predicate,
+    //  pmany_char consumes runs of those with state::satisfy
+    template<typename TParser>
+    struct is_char_predicate
+    {
+      enum
+      {
+        value = false,
+      };
+    };
+
+    template<typename TState>
+    struct is_char_predicate<parser<char, any_of_function<char>, TState>>
+    {
+      enum
+      {
+        value = true,
+      };
+    };
+
+    template<typename TSatisfyFunction, typename TState>
+    struct is_char_predicate<parser<char, satisfy_char_function<TSatisfyFunction>, TState>>
+    {
+      enum
+      {
+        value = true,
+      };
+    };
+
+    template<typename TParser, typename TState>
+    CPP_PC__INLINE result<std::string> many_char (
+        TState const &  s
+      , std::size_t     position
+      , std::size_t     at_least
+      , std::size_t     at_most
+      , TParser const & t
+      , std::false_type
+      )
+    {
+      using tresult_type  = strip_type_t<decltype (t.parser_function (s, 0))> ;
+      using tvalue_type   = typename tresult_type::value_type                 ;
+      using result_type   = result<std::string>                               ;
+
+      static_assert (std::is_same<char, tvalue_type>::value, "Parser passed to pmany_chars must return value of type char");
+
+      std::string values;
+      values.reserve (at_least);
+
+      auto current = position;
+
+      auto cont = true;
+
+      while (cont)
+      {
+        if (values.size () >= at_most)
         {
-          return result_type::success (current, std::move (values));
+          cont = false;
+          continue;
         }
-        else
+
+        auto tv = t.parser_function (s, current);
+        if (!tv.value)
         {
-          return result_type::failure (current);
+          if (s.committed)
+          {
+            return result_type::failure (tv.position);
+          }
+
+          cont = false;
+          continue;
         }
+
+        values.push_back (std::move (tv.value.get ()));
+
+        current = tv.position;
+      }
+
+      if (values.size () >= at_least)
+      {
+        return result_type::success (current, std::move (values));
+      }
+      else
+      {
+        return result_type::failure (current);
+      }
+    }
+
+    // The run is consumed and appended in one go, the errors are the ones
+    //  t would have appended if invoked for each character
+    template<typename TParser, typename TState>
+    CPP_PC__INLINE result<std::string> many_char (
+        TState const &  s
+      , std::size_t     position
+      , std::size_t     at_least
+      , std::size_t     at_most
+      , TParser const & t
+      , std::true_type
+      )
+    {
+      using result_type = result<std::string>;
+
+      auto & f    = t.parser_function;
+      auto run    = s.satisfy (position, at_most, [&f] (std::size_t, char ch) { return f.satisfied (ch); });
+      auto count  = run.size ();
+
+      // t is invoked for the character that ended the run as well unless
+      //  at_most ended it
+      auto invoked = count < at_most ? count + 1 : count;
+      if (s.error_position - position < invoked)
+      {
+        f.append_errors (s, s.error_position);
+      }
+
+      if (count >= at_least)
+      {
+        return result_type::success (position + count, in_place, run.begin, run.end);
+      }
+      else
+      {
+        return result_type::failure (position + count);
+      }
+    }
+  }
+
+  // For parsers that consume a character satisfying a predicate (psatisfy_char
+  //  and pany_of) pmany_char consumes the whole run with state::satisfy
+  template<typename TParser>
+  CPP_PC__PRELUDE auto pmany_char (std::size_t at_least, std::size_t at_most, TParser && t)
+  {
+    CPP_PC__CHECK_PARSER (t);
+
+    using is_predicate = std::integral_constant<bool, detail::is_char_predicate<detail::strip_type_t<TParser>>::value>;
+
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser>> (
+      [at_least, at_most, t = std::forward<TParser> (t)] (auto const & s, std::size_t position)
+      {
+        return detail::many_char (s, position, at_least, at_most, t, is_predicate ());
       });
   }
 
@@ -1012,11 +1926,11 @@ namespace cpp_pc
 
   namespace detail
   {
-    template<typename TValue>
+    template<typename TValue, typename TState>
     struct ptrampoline_payload
     {
       using ptr           = std::shared_ptr<ptrampoline_payload>;
-      using trampoline_f  = std::function<result<TValue> (state const & s, std::size_t position)>;
+      using trampoline_f  = std::function<result<TValue> (TState const & s, std::size_t position)>;
 
       CPP_PC__PRELUDE ptrampoline_payload () = default;
 
@@ -1027,19 +1941,19 @@ namespace cpp_pc
   }
 
 
-  template<typename TValue>
+  template<typename TValue, typename TState = state>
   CPP_PC__INLINE auto create_trampoline ()
   {
-    return std::make_shared<detail::ptrampoline_payload<TValue>> ();
+    return std::make_shared<detail::ptrampoline_payload<TValue, TState>> ();
   }
 
-  template<typename TValue>
-  CPP_PC__INLINE auto ptrampoline (typename detail::ptrampoline_payload<TValue>::ptr payload)
+  template<typename TValue, typename TState = state>
+  CPP_PC__INLINE auto ptrampoline (typename detail::ptrampoline_payload<TValue, TState>::ptr payload)
   {
     CPP_PC__ASSERT ("empty payload" && payload);
 
-    return detail::adapt_parser_function (
-      [payload = std::move (payload)] (state const & s, std::size_t position)
+    return detail::adapt_parser_function<TState> (
+      [payload = std::move (payload)] (TState const & s, std::size_t position)
       {
         CPP_PC__ASSERT ("empty trampoline" && payload->trampoline);
         if (payload->trampoline)
@@ -1058,116 +1972,246 @@ namespace cpp_pc
   {
     CPP_PC__CHECK_PARSER (t);
 
-    return detail::adapt_parser_function (
-      [t = std::forward<TParser> (t)] (state const & s, std::size_t position)
-      {
-//        CPP_PC__ASSERT ("pbreakpoint" && false);
-        auto tv = t (s, position);
-        return tv;
-      });
-  }
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser>> (
+      [t = std::forward<TParser> (t)] (auto const & s, std::size_t position)
+      {
+//        CPP_PC__ASSERT ("pbreakpoint" && false);
+        auto tv = t (s, position);
+        return tv;
+      });
+  }
+
+  namespace detail
+  {
+    template<typename TValue, typename ...TParsers>
+    struct pchoice_function
+    {
+      std::tuple<TParsers...> parsers;
+
+      template<typename TState>
+      CPP_PC__INLINE result<TValue> operator () (TState const & s, std::size_t position) const
+      {
+        std::size_t right_most = 0;
+        auto cv = parse (s, position, right_most, std::integral_constant<std::size_t, 0> ());
+
+        if (!cv.value && !s.committed)
+        {
+          // This is in order to report the error on the furthest position on the right
+          cv.reposition (right_most);
+        }
+
+        return cv;
+      }
+
+    private:
+      template<typename TState>
+      CPP_PC__INLINE result<TValue> parse (TState const & s, std::size_t position, std::size_t & right_most, std::integral_constant<std::size_t, sizeof... (TParsers) - 1>) const
+      {
+        auto hv = std::get<sizeof... (TParsers) - 1> (parsers).parser_function (s, position);
+        right_most = std::max<std::size_t> (hv.position, right_most);
+
+        return hv;
+      }
+
+      template<typename TState, std::size_t I>
+      CPP_PC__INLINE result<TValue> parse (TState const & s, std::size_t position, std::size_t & right_most, std::integral_constant<std::size_t, I>) const
+      {
+        auto hv = std::get<I> (parsers).parser_function (s, position);
+        right_most = std::max<std::size_t> (hv.position, right_most);
+
+        if (hv.value)
+        {
+          if (s.error_position == position)
+          {
+            // In order to collect error info, a pcut failing in the remaining
+            //  alternatives mustn't affect the rest of the parse
+            parse (s, position, right_most, std::integral_constant<std::size_t, I + 1> ());
+            s.committed = false;
+          }
+          return hv;
+        }
+        else if (s.committed)
+        {
+          // The alternative is committed, the remaining ones aren't tried
+          return hv;
+        }
+        else
+        {
+          return parse (s, position, right_most, std::integral_constant<std::size_t, I + 1> ());
+        }
+      }
+    };
+
+    // Nested pchoice are flattened into their alternatives
+    template<typename TParser>
+    struct choice_alternatives
+    {
+      template<typename T>
+      static CPP_PC__INLINE auto get (T && p)
+      {
+        return std::make_tuple (std::forward<T> (p));
+      }
+    };
+
+    template<typename TValue, typename ...TParsers, typename TState>
+    struct choice_alternatives<parser<TValue, pchoice_function<TValue, TParsers...>, TState>>
+    {
+      template<typename T>
+      static CPP_PC__INLINE auto get (T && p)
+      {
+        return p.parser_function.parsers;
+      }
+    };
+
+    template<typename TParser>
+    struct is_char_class
+    {
+      using value_type = void;
+
+      enum
+      {
+        value = false,
+      };
+    };
+
+    template<typename TValue, typename TState>
+    struct is_char_class<parser<TValue, any_of_function<TValue>, TState>>
+    {
+      using value_type = TValue;
+
+      enum
+      {
+        value = true,
+      };
+    };
+
+    template<typename TState>
+    struct is_char_class<parser<unit_type, skip_function<skip_char_step>, TState>>
+    {
+      using value_type = unit_type;
+
+      enum
+      {
+        value = true,
+      };
+    };
+
+    template<typename TValue, typename TState>
+    CPP_PC__INLINE auto to_char_class (parser<TValue, any_of_function<TValue>, TState> const & p)
+    {
+      return p.parser_function;
+    }
+
+    template<typename TState>
+    CPP_PC__INLINE auto to_char_class (parser<unit_type, skip_function<skip_char_step>, TState> const & p)
+    {
+      auto & step = p.parser_function.step;
 
-  namespace detail
-  {
-    template<typename TValue, typename ...TParsers>
-    struct pchoice_impl;
+      any_of_function<unit_type> result;
+      result.add (step.ch, step.error);
+      return result;
+    }
 
-    template<typename TValue, typename THead>
-    struct pchoice_impl<TValue, THead>
+    template<typename THead, typename ...TTail, std::size_t ...Indices>
+    CPP_PC__INLINE auto tuple_tail (std::tuple<THead, TTail...> const & t, std::index_sequence<Indices...>)
     {
-      using head_type   = strip_type_t<THead>               ;
-      using value_type  = detail::parser_value_type_t<THead>;
+      return std::make_tuple (std::get<Indices + 1> (t)...);
+    }
+
+    template<typename THead, typename ...TTail>
+    CPP_PC__INLINE auto tuple_tail (std::tuple<THead, TTail...> const & t)
+    {
+      return tuple_tail (t, std::index_sequence_for<TTail...> ());
+    }
 
-      static_assert (std::is_same<TValue, value_type>::value, "All pchoice parsers must produce values of the same value_type");
+    template<typename TTuple>
+    struct first_alternative
+    {
+      using type = void;
+    };
 
-      CPP_PC__CTOR_COPY_MOVE (pchoice_impl);
+    template<typename THead, typename ...TTail>
+    struct first_alternative<std::tuple<THead, TTail...>>
+    {
+      using type = THead;
+    };
 
-      template<typename TH>
-      CPP_PC__PRELUDE pchoice_impl (TH && head)
-        : head (std::forward<TH> (head))
+    // Adjacent character class alternatives (pany_of, pskip_char) that
+    //  produce the same value type are merged into one character class
+    template<typename THead, typename TFirst, typename TEnable = void>
+    struct merge_alternative
+    {
+      template<typename TTail>
+      static CPP_PC__INLINE auto prepend (THead const & head, TTail const & tail)
       {
-        CPP_PC__CHECK_PARSER (head);
+        return std::tuple_cat (std::make_tuple (head), tail);
       }
+    };
 
-      CPP_PC__INLINE result<TValue> parse (state const & s, std::size_t position, std::size_t & right_most) const
+    template<typename THead, typename TFirst>
+    struct merge_alternative<
+        THead
+      , TFirst
+      , std::enable_if_t<is_char_class<THead>::value && is_char_class<TFirst>::value && std::is_same<typename is_char_class<THead>::value_type, typename is_char_class<TFirst>::value_type>::value>
+      >
+    {
+      template<typename TTail>
+      static CPP_PC__INLINE auto prepend (THead const & head, TTail const & tail)
       {
-        auto hv = head.parser_function (s, position);
-        right_most = std::max (hv.position, right_most);
+        auto char_class = to_char_class (head);
+        char_class.merge (to_char_class (std::get<0> (tail)));
 
-        return hv;
+        return std::tuple_cat (std::make_tuple (adapt_parser_function (std::move (char_class))), tuple_tail (tail));
       }
-
-      head_type head;
     };
 
-    template<typename TValue, typename THead, typename ...TTail>
-    struct pchoice_impl<TValue, THead, TTail...> : pchoice_impl<TValue, TTail...>
+    CPP_PC__INLINE auto merge_alternatives (std::tuple<> const & alternatives)
     {
-      using base_type   = pchoice_impl<TValue, TTail...>    ;
-      using head_type   = strip_type_t<THead>               ;
-      using value_type  = detail::parser_value_type_t<THead>;
+      return alternatives;
+    }
 
-      static_assert (std::is_same<TValue, value_type>::value, "All pchoice parsers must produce values of the same value_type");
+    template<typename THead, typename ...TTail>
+    CPP_PC__INLINE auto merge_alternatives (std::tuple<THead, TTail...> const & alternatives)
+    {
+      auto tail = merge_alternatives (tuple_tail (alternatives));
 
-      CPP_PC__CTOR_COPY_MOVE (pchoice_impl);
+      using first_type = typename first_alternative<decltype (tail)>::type;
 
-      template<typename TH, typename ...TT>
-      CPP_PC__PRELUDE pchoice_impl (TH && head, TT && ...tail)
-        : base_type (std::forward<TT> (tail)...)
-        , head (std::forward<TH> (head))
-      {
-        CPP_PC__CHECK_PARSER (head);
-      }
+      return merge_alternative<THead, first_type>::prepend (std::get<0> (alternatives), tail);
+    }
 
-      CPP_PC__INLINE result<TValue> parse (state const & s, std::size_t position, std::size_t & right_most) const
-      {
-        auto hv = head.parser_function (s, position);
-        right_most = std::max (hv.position, right_most);
+    template<typename TParser>
+    CPP_PC__INLINE auto make_choice (std::tuple<TParser> const & alternatives)
+    {
+      return std::get<0> (alternatives);
+    }
 
-        if (hv.value)
-        {
-          if (s.error_position == position)
-          {
-            // In order to collect error info
-            base_type::parse (s, position, right_most);
-          }
-          return hv;
-        }
-        else
-        {
-          return base_type::parse (s, position, right_most);
-        }
-      }
+    template<typename TParser, typename ...TParsers>
+    CPP_PC__INLINE auto make_choice (std::tuple<TParser, TParsers...> const & alternatives)
+    {
+      using value_type    = parser_value_type_t<TParser>;
+      using function_type = pchoice_function<value_type, TParser, TParsers...>;
 
-      head_type head;
-    };
+      static_assert (
+          std::is_same<std::tuple<value_type, parser_value_type_t<TParsers>...>, std::tuple<value_type, std::conditional_t<true, value_type, TParsers>...>>::value
+        , "All pchoice parsers must produce values of the same value_type"
+        );
 
+      return adapt_parser_function<common_state_type_t<TParser, TParsers...>> (function_type { alternatives });
+    }
   }
 
   template<typename TParser, typename ...TParsers>
   CPP_PC__INLINE auto pchoice (TParser && parser, TParsers && ...parsers)
   {
-    using value_type = detail::parser_value_type_t<TParser>;
+    CPP_PC__CHECK_PARSER (parser);
 
-    detail::pchoice_impl<value_type, TParser, TParsers...> impl (
-        std::forward<TParser> (parser)
-      , std::forward<TParsers> (parsers)...
+    auto alternatives = std::tuple_cat (
+        detail::choice_alternatives<detail::strip_type_t<TParser>>::get (std::forward<TParser> (parser))
+      , detail::choice_alternatives<detail::strip_type_t<TParsers>>::get (std::forward<TParsers> (parsers))...
       );
 
-    return detail::adapt_parser_function (
-      [impl = std::move (impl)] (state const & s, std::size_t position)
-      {
-        std::size_t right_most = 0;
-        auto cv = impl.parse (s, position, right_most);
-
-        if (!cv.value)
-        {
-          // This is in order to report the error on the furthest position on the right
-          cv.reposition (right_most);
-        }
-
-        return cv;
-      });
+    return detail::make_choice (detail::merge_alternatives (alternatives));
   }
 
   namespace detail
@@ -1188,11 +2232,11 @@ namespace cpp_pc
         return result<std::tuple<TTypes...>>::failure (position);
       }
 
-      template<typename ...TTypes>
-      CPP_PC__PRELUDE auto parse (state const &, std::size_t position, TTypes const & ...values) const
+      template<typename ...TTypes, typename TState>
+      CPP_PC__PRELUDE auto parse (TState const &, std::size_t position, TTypes const & ...values) const
       {
         // TODO: Perfect forward
-        return result<decltype(std::make_tuple (values...))>::success (position, std::make_tuple (values...));
+        return result<decltype(std::make_tuple (values...))>::success (position, in_place, values...);
       }
 
     };
@@ -1220,8 +2264,8 @@ namespace cpp_pc
         return base_type::template fail<TTypes..., value_type> (position);
       }
 
-      template<typename ...TTypes>
-      CPP_PC__INLINE auto parse (state const & s, std::size_t position, TTypes const & ...values) const
+      template<typename ...TTypes, typename TState>
+      CPP_PC__INLINE auto parse (TState const & s, std::size_t position, TTypes const & ...values) const
       {
         auto hv = head.parser_function (s, position);
         if (hv.value)
@@ -1231,7 +2275,8 @@ namespace cpp_pc
         }
         else
         {
-          return fail<TTypes...> (position);
+          // A committed failure is reported where it happened, see pcut
+          return fail<TTypes...> (s.committed ? hv.position : position);
         }
       }
 
@@ -1247,8 +2292,8 @@ namespace cpp_pc
         std::forward<TParsers> (parsers)...
       );
 
-    return detail::adapt_parser_function (
-      [impl = std::move (impl)] (state const & s, std::size_t position)
+    return detail::adapt_parser_function<detail::common_state_type_t<TParsers...>> (
+      [impl = std::move (impl)] (auto const & s, std::size_t position)
       {
         return impl.parse (s, position);
       });
@@ -1261,12 +2306,12 @@ namespace cpp_pc
     , TEndParser    && end_parser
     )
   {
-    return detail::adapt_parser_function (
+    return detail::adapt_parser_function<detail::common_state_type_t<TBeginParser, TParser, TEndParser>> (
       [
           begin_parser  = std::forward<TBeginParser> (begin_parser)
         , parser        = std::forward<TParser> (parser)
         , end_parser    = std::forward<TEndParser> (end_parser)
-      ] (state const & s, std::size_t position)
+      ] (auto const & s, std::size_t position)
       {
         using tvalue_type = detail::parser_value_type_t<TParser>;
         using result_type = result<tvalue_type>                 ;
@@ -1289,9 +2334,8 @@ namespace cpp_pc
           return result_type::failure (ev.position);
         }
 
-        return v
-          .reposition (ev.position)
-          ;
+        v.reposition (ev.position);
+        return v;
       });
   }
 
@@ -1302,12 +2346,12 @@ namespace cpp_pc
     , TCombiner     && combiner
     )
   {
-    return detail::adapt_parser_function (
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser, TSepParser>> (
       [
           parser      = std::forward<TParser> (parser)
         , sep_parser  = std::forward<TSepParser> (sep_parser)
         , combiner    = std::forward<TCombiner> (combiner)
-      ] (state const & s, std::size_t position)
+      ] (auto const & s, std::size_t position)
       {
         auto v = parser.parser_function (s, position);
 
@@ -1323,6 +2367,11 @@ namespace cpp_pc
           auto sv = sep_parser.parser_function (s, v.position);
           if (!sv.value)
           {
+            if (s.committed)
+            {
+              return decltype (v)::failure (sv.position);
+            }
+
             cont = false;
             continue;
           }
@@ -1343,136 +2392,323 @@ namespace cpp_pc
       });
   }
 
-  template<typename TSatisfyFunction>
-  CPP_PC__INLINE auto psatisfy (std::string expected, std::size_t at_least, std::size_t at_most, TSatisfyFunction && satisfy_function)
+  enum class fixity
   {
-    return detail::adapt_parser_function (
-      [error = detail::make_expected (std::move (expected)), at_least, at_most, satisfy_function = std::forward<TSatisfyFunction> (satisfy_function)] (state const & s, std::size_t position)
-      {
-        using result_type = result<sub_string>  ;
+    prefix  ,
+    infix   ,
+    postfix ,
+  };
 
-        auto result = s.satisfy (position, at_most, satisfy_function);
-        auto consumed = result.size ();
+  enum class associativity
+  {
+    left  ,
+    right ,
+  };
 
-        s.append_error (position + consumed, error);
+  // Describes the operators of pexpression, a higher precedence binds tighter
+  template<typename TOperator>
+  struct operator_table
+  {
+    struct entry
+    {
+      TOperator   op          ;
+      fixity      fix         ;
+      std::size_t left_power  ;
+      std::size_t right_power ;
+    };
 
-        if (consumed < at_least)
+    operator_table ()
+      : has_prefix (false)
+    {
+    }
+
+    operator_table & prefix (TOperator op, std::size_t precedence)
+    {
+      has_prefix = true;
+      entries.push_back (entry { std::move (op), fixity::prefix, 0, 2*precedence + 1 });
+      return *this;
+    }
+
+    operator_table & infix (TOperator op, std::size_t precedence, associativity assoc = associativity::left)
+    {
+      auto left_power   = 2*precedence + (assoc == associativity::left ? 0 : 1);
+      auto right_power  = 2*precedence + (assoc == associativity::left ? 1 : 0);
+      entries.push_back (entry { std::move (op), fixity::infix, left_power, right_power });
+      return *this;
+    }
+
+    operator_table & postfix (TOperator op, std::size_t precedence)
+    {
+      entries.push_back (entry { std::move (op), fixity::postfix, 2*precedence, 0 });
+      return *this;
+    }
+
+    CPP_PC__INLINE entry const * find (TOperator const & op, bool prefix) const noexcept
+    {
+      for (auto && e : entries)
+      {
+        if ((e.fix == fixity::prefix) == prefix && e.op == op)
         {
-          return result_type::failure (position + consumed);
+          return &e;
         }
+      }
 
-        return result_type::success (position + consumed, std::move (result));
-      });
-  }
+      return nullptr;
+    }
 
-  template<typename TSatisfyFunction>
-  CPP_PC__INLINE auto psatisfy_char (std::string expected, TSatisfyFunction && satisfy_function)
+    std::vector<entry>  entries     ;
+    bool                has_prefix  ;
+  };
+
+  namespace detail
   {
-    return detail::adapt_parser_function (
-      [error = detail::make_expected (std::move (expected)), satisfy_function = std::forward<TSatisfyFunction> (satisfy_function)] (state const & s, std::size_t position)
+    template<typename TParser, typename TOperatorParser, typename TBinary, typename TPrefix, typename TPostfix>
+    struct pexpression_function
+    {
+      using value_type    = parser_value_type_t<TParser>          ;
+      using operator_type = parser_value_type_t<TOperatorParser>  ;
+      using table_type    = operator_table<operator_type>         ;
+      using result_type   = result<value_type>                    ;
+
+      TParser         parser          ;
+      TOperatorParser operator_parser ;
+      table_type      table           ;
+      TBinary         binary          ;
+      TPrefix         prefix          ;
+      TPostfix        postfix         ;
+
+      template<typename TState>
+      CPP_PC__INLINE result_type operator () (TState const & s, std::size_t position) const
       {
-        using result_type = result<char>  ;
+        return parse (s, position, 0);
+      }
 
-        s.append_error (position, error);
+    private:
+      // Pratt parsing, each operator binds to its left while its left power
+      //  is at least min_power. The recursion depth follows the nesting of
+      //  the input rather than the number of precedence levels
+      template<typename TState>
+      result_type parse (TState const & s, std::size_t position, std::size_t min_power) const
+      {
+        auto v = parse_prefix (s, position);
 
-        auto peek = s.peek (position);
-        if (peek == EOS)
+        if (!v.value)
         {
-          return result_type::failure (position);
+          return v;
         }
 
-        auto result = static_cast<char> (peek);
+        for (;;)
+        {
+          auto ov = operator_parser.parser_function (s, v.position);
+          if (!ov.value)
+          {
+            if (s.committed)
+            {
+              return result_type::failure (ov.position);
+            }
+
+            return v;
+          }
+
+          auto e = table.find (ov.value.get (), false);
+          if (!e || e->left_power < min_power)
+          {
+            return v;
+          }
+
+          if (e->fix == fixity::postfix)
+          {
+            v.reposition (ov.position);
+            v.value = make_opt (postfix (std::move (v.value.get ()), std::move (ov.value.get ())));
+            continue;
+          }
+
+          auto rv = parse (s, ov.position, e->right_power);
+          if (!rv.value)
+          {
+            return rv;
+          }
+
+          v.reposition (rv.position);
+          v.value = make_opt (binary (std::move (v.value.get ()), std::move (ov.value.get ()), std::move (rv.value.get ())));
+        }
+      }
 
-        if (!satisfy_function (0, result))
+      template<typename TState>
+      result_type parse_prefix (TState const & s, std::size_t position) const
+      {
+        if (!table.has_prefix)
         {
-          return result_type::failure (position);
+          return parser.parser_function (s, position);
         }
 
-        return result_type::success (position + 1, result);
-      });
-  }
+        auto ov = operator_parser.parser_function (s, position);
+        if (ov.value)
+        {
+          auto e = table.find (ov.value.get (), true);
+          if (e)
+          {
+            auto v = parse (s, ov.position, e->right_power);
+            if (v.value)
+            {
+              v.value = make_opt (prefix (std::move (ov.value.get ()), std::move (v.value.get ())));
+            }
+            return v;
+          }
+        }
+        else if (s.committed)
+        {
+          return result_type::failure (ov.position);
+        }
 
-  namespace detail
-  {
-    std::string char_to_string (char ch)
+        return parser.parser_function (s, position);
+      }
+    };
+
+    struct pexpression_no_unary
     {
-      char s[] = {'\'', ch, '\'', 0};
-      return s;
-    }
+      template<typename TLeft, typename TRight>
+      CPP_PC__INLINE TRight operator () (TLeft &&, TRight && v) const
+      {
+        CPP_PC__ASSERT (false);
+        return std::forward<TRight> (v);
+      }
+    };
 
-    base_error::ptr char_to_expected (char ch)
+    struct pexpression_no_postfix
     {
-      return detail::make_expected (detail::char_to_string (ch));
-    }
+      template<typename TLeft, typename TRight>
+      CPP_PC__INLINE TLeft operator () (TLeft && v, TRight &&) const
+      {
+        CPP_PC__ASSERT (false);
+        return std::forward<TLeft> (v);
+      }
+    };
   }
 
-  CPP_PC__INLINE auto pany_of (std::string expected)
+  // Parses operands separated by operators, precedence, associativity and
+  //  fixity come from the operator table. Produces
+  //    binary (l, op, r) for infix operators
+  //    prefix (op, v) for prefix operators
+  //    postfix (v, op) for postfix operators
+  //  Handles any number of precedence levels in a single loop, unlike psep
+  //  which needs one nested psep per level
+  template<typename TParser, typename TOperatorParser, typename TBinary, typename TPrefix, typename TPostfix>
+  CPP_PC__INLINE auto pexpression (
+      TParser                                                                     && parser
+    , TOperatorParser                                                             && operator_parser
+    , operator_table<detail::parser_value_type_t<TOperatorParser>>                table
+    , TBinary                                                                     && binary
+    , TPrefix                                                                     && prefix
+    , TPostfix                                                                    && postfix
+    )
   {
-    base_errors errors;
-    for (auto ch : expected)
-    {
-      errors.push_back (detail::char_to_expected (ch));
-    }
+    CPP_PC__CHECK_PARSER (parser);
+    CPP_PC__CHECK_PARSER (operator_parser);
+
+    using function_type = detail::pexpression_function<
+        detail::strip_type_t<TParser>
+      , detail::strip_type_t<TOperatorParser>
+      , detail::strip_type_t<TBinary>
+      , detail::strip_type_t<TPrefix>
+      , detail::strip_type_t<TPostfix>
+      >;
+
+    return detail::adapt_parser_function<detail::common_state_type_t<TParser, TOperatorParser>> (
+      function_type
+      {
+          std::forward<TParser> (parser)
+        , std::forward<TOperatorParser> (operator_parser)
+        , std::move (table)
+        , std::forward<TBinary> (binary)
+        , std::forward<TPrefix> (prefix)
+        , std::forward<TPostfix> (postfix)
+      });
+  }
+
+  // pexpression for tables with infix operators only
+  template<typename TParser, typename TOperatorParser, typename TBinary>
+  CPP_PC__INLINE auto pexpression (
+      TParser                                                                     && parser
+    , TOperatorParser                                                             && operator_parser
+    , operator_table<detail::parser_value_type_t<TOperatorParser>>                table
+    , TBinary                                                                     && binary
+    )
+  {
+    return pexpression (
+        std::forward<TParser> (parser)
+      , std::forward<TOperatorParser> (operator_parser)
+      , std::move (table)
+      , std::forward<TBinary> (binary)
+      , detail::pexpression_no_unary ()
+      , detail::pexpression_no_postfix ()
+      );
+  }
 
+  template<typename TSatisfyFunction>
+  CPP_PC__INLINE auto psatisfy (std::string expected, std::size_t at_least, std::size_t at_most, TSatisfyFunction && satisfy_function)
+  {
     return detail::adapt_parser_function (
-      [expected = std::move (expected), errors = std::move (errors)] (state const & s, std::size_t position)
+      [error = detail::make_expected (std::move (expected)), at_least, at_most, satisfy_function = std::forward<TSatisfyFunction> (satisfy_function)] (auto const & s, std::size_t position)
       {
-        using result_type = result<char>  ;
+        using result_type = result<sub_string>  ;
 
-        if (position == s.error_position)
-        {
-          for (auto && error : errors)
-          {
-            s.append_error (position, error);
-          }
-        }
+        auto result = s.satisfy (position, at_most, satisfy_function);
+        auto consumed = result.size ();
 
-        auto peek = s.peek (position);
-        if (peek == EOS)
-        {
-          return result_type::failure (position);
-        }
+        s.append_error (position + consumed, error);
 
-        auto find = expected.find (static_cast<char> (peek));
-        if (find == std::string::npos)
+        if (consumed < at_least)
         {
-          return result_type::failure (position);
+          return result_type::failure (position + consumed);
         }
 
-        return result_type::success (position + 1, static_cast<char> (peek));
+        return result_type::success (position + consumed, std::move (result));
       });
   }
 
   template<typename TSatisfyFunction>
-  CPP_PC__INLINE auto pskip_satisfy (std::string expected, std::size_t at_least, std::size_t at_most, TSatisfyFunction && satisfy_function)
+  CPP_PC__INLINE auto psatisfy_char (std::string expected, TSatisfyFunction && satisfy_function)
   {
-    return
-          psatisfy (std::move (expected), at_least, at_most, std::forward<TSatisfyFunction> (satisfy_function))
-      <   punit
-      ;
+    using function_type = detail::satisfy_char_function<detail::strip_type_t<TSatisfyFunction>>;
+
+    return detail::adapt_parser_function (
+      function_type { detail::make_expected (std::move (expected)), std::forward<TSatisfyFunction> (satisfy_function) });
   }
 
-  CPP_PC__INLINE auto pskip_char (char ch)
+  CPP_PC__INLINE auto pany_of (std::string expected)
+  {
+    return detail::adapt_parser_function (detail::any_of_function<char> (expected));
+  }
+
+  template<typename TSatisfyFunction>
+  CPP_PC__INLINE auto pskip_satisfy (std::string expected, std::size_t at_least, std::size_t at_most, TSatisfyFunction && satisfy_function)
   {
     return detail::adapt_parser_function (
-      [ch, error = detail::char_to_expected (ch)] (state const & s, std::size_t position)
+      [error = detail::make_expected (std::move (expected)), at_least, at_most, satisfy_function = std::forward<TSatisfyFunction> (satisfy_function)] (auto const & s, std::size_t position)
       {
-        using result_type = result<unit_type> ;
+        using result_type = result<unit_type>  ;
 
-        s.append_error (position, error);
+        auto consumed = s.skip_satisfy (position, at_most, satisfy_function);
 
-        auto peek = s.peek (position);
-        if (peek == ch)
-        {
-          return result_type::success (position + 1, unit);
-        }
-        else
+        s.append_error (position + consumed, error);
+
+        if (consumed < at_least)
         {
-          return result_type::failure (position);
+          return result_type::failure (position + consumed);
         }
+
+        return result_type::success (position + consumed, unit);
       });
   }
 
+  CPP_PC__INLINE auto pskip_char (char ch)
+  {
+    using function_type = detail::skip_function<detail::skip_char_step>;
+
+    return detail::adapt_parser_function (function_type { detail::skip_char_step { ch, detail::char_to_expected (ch) } });
+  }
+
   CPP_PC__INLINE auto pskip_string (std::string str)
   {
     // TODO: Fix error position by doing full implementation
@@ -1486,7 +2722,10 @@ namespace cpp_pc
     return pskip_satisfy (std::move (expected), sz, sz, std::move (satisfy));
   }
 
-  auto const pskip_ws = pskip_satisfy ("whitespace", 0U, SIZE_MAX, satisfy_whitespace);
+  auto const pskip_ws =
+    detail::adapt_parser_function (
+      detail::skip_function<detail::skip_whitespace_step> { detail::skip_whitespace_step { detail::make_expected ("whitespace") } }
+      );
 
   namespace detail
   {
@@ -1495,7 +2734,7 @@ namespace cpp_pc
 
   auto const peos =
     detail::adapt_parser_function (
-      [] (state const & s, std::size_t position)
+      [] (auto const & s, std::size_t position)
       {
         using result_type = result<unit_type> ;
 
@@ -1521,7 +2760,7 @@ namespace cpp_pc
 
   auto const praw_uint64 =
     detail::adapt_parser_function (
-      [] (state const & s, std::size_t position)
+      [] (auto const & s, std::size_t position)
       {
         using result_type = result<std::tuple<std::uint64_t, std::size_t>>;
 
@@ -1541,12 +2780,12 @@ namespace cpp_pc
           i = 10*i + static_cast<std::uint64_t> (*iter - '0');
         }
 
-        return result_type::success (position + consumed, std::make_tuple (i, consumed));
+        return result_type::success (position + consumed, in_place, i, consumed);
       });
 
   auto const pint64 =
     detail::adapt_parser_function (
-      [] (state const & s, std::size_t position)
+      [] (auto const & s, std::size_t position)
       {
         using result_type = result<std::int64_t>;
 
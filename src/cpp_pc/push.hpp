@@ -0,0 +1,161 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#pragma once
+// ----------------------------------------------------------------------------
+#include <memory>
+#include <string>
+// ----------------------------------------------------------------------------
+#include "common.hpp"
+#include "pc.hpp"
+#include "incremental.hpp"
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+// Push parsing: input is fed in chunks as it arrives. Each chunk is appended
+//  to an incremental_document, appending only invalidates the memoized
+//  results that examined the end of the input so completed rules (ie values
+//  wrapped in pmemo) aren't parsed again when the next chunk arrives
+//
+// This isn't a resumable parser: every attempt parses from position 0 and
+//  positions are offsets into the whole input, so the input and the memo
+//  entries are kept until the parse completes. Memory grows with the
+//  message (the input plus one memo entry per value), and sequences are
+//  walked again on each attempt. Parsing a message chunk by chunk costs
+//  about twice a parse of the buffered message; what it buys is that a
+//  malformed message is rejected before all of it has arrived
+// ----------------------------------------------------------------------------
+namespace cpp_pc
+{
+  enum class push_status
+  {
+    need_more ,
+    done      ,
+    failed    ,
+  };
+
+  template<typename TValueType, typename TParserFunction, typename TState>
+  struct push_parser
+  {
+    using parser_type = parser<TValueType, TParserFunction, TState>;
+    using result_type = parse_result<TValueType>                   ;
+
+    CPP_PC__NO_COPY_MOVE (push_parser);
+
+    explicit push_parser (parser_type p)
+      : document      (std::move (p), std::string ())
+      , status        (push_status::need_more)
+      , r             (0, empty_opt, std::string ())
+      , next_attempt  (0)
+    {
+    }
+
+    // Appends [begin, end) to the input and parses as far as possible.
+    //  Returns need_more while the outcome depends on input not yet seen,
+    //  failed when the input can't be valid whatever follows
+    //  Memoized results are reused but sequences (ie pmany_sepby) are walked
+    //  from their start on each parse, so parsing is attempted only once the
+    //  input grew by an eighth since the last attempt. This keeps the total
+    //  work linear, an error is detected at most an eighth of the input late
+    push_status feed (char const * begin, char const * end)
+    {
+      if (status != push_status::need_more)
+      {
+        return status;
+      }
+
+      auto size = document.str ().size ();
+      document.edit (size, 0, begin, end);
+
+      size = document.str ().size ();
+      if (size < next_attempt)
+      {
+        return status;
+      }
+
+      next_attempt = size + size / 8;
+
+      auto v = document.parse_memoized ();
+      if (document.examined () > size)
+      {
+        // The parser examined the end of the input
+        return status;
+      }
+
+      return complete (std::move (v));
+    }
+
+    push_status feed (std::string const & chunk)
+    {
+      auto begin  = chunk.c_str ();
+      auto end    = begin + chunk.size ();
+
+      return feed (begin, end);
+    }
+
+    // Marks the end of the input
+    push_status finish ()
+    {
+      if (status != push_status::need_more)
+      {
+        return status;
+      }
+
+      return complete (document.parse_memoized ());
+    }
+
+    // The input fed so far
+    CPP_PC__INLINE std::string const & str () const noexcept
+    {
+      return document.str ();
+    }
+
+    // The result, valid once feed or finish returned done or failed
+    CPP_PC__INLINE result_type const & result () const noexcept
+    {
+      return r;
+    }
+
+  private:
+    push_status complete (cpp_pc::result<TValueType> && v)
+    {
+      if (v.value)
+      {
+        r       = result_type (v.position, std::move (v.value), std::string ());
+        status  = push_status::done;
+      }
+      else
+      {
+        // Collects the error message
+        r       = document.parse ();
+        status  = push_status::failed;
+      }
+
+      return status;
+    }
+
+    incremental_document<TValueType, TParserFunction, TState>   document      ;
+    push_status                                                 status        ;
+    result_type                                                 r             ;
+    std::size_t                                                 next_attempt  ;
+  };
+
+  template<typename TValueType, typename TParserFunction, typename TState>
+  CPP_PC__INLINE auto make_push_parser (parser<TValueType, TParserFunction, TState> const & p)
+  {
+    return std::make_unique<push_parser<TValueType, TParserFunction, TState>> (p);
+  }
+}
+// ----------------------------------------------------------------------------
@@ -0,0 +1,359 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#pragma once
+// ----------------------------------------------------------------------------
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+// ----------------------------------------------------------------------------
+#include "common.hpp"
+#include "pc.hpp"
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+// Segmented input: a state over a list of non-contiguous buffers, such as
+//  I/O vectors or pages, that doesn't require copying them into one buffer.
+//  Positions are offsets into the concatenation of the segments
+// ----------------------------------------------------------------------------
+namespace cpp_pc
+{
+  struct segment
+  {
+    char const *  begin ;
+    char const *  end   ;
+  };
+
+  using segments = std::vector<segment>;
+
+  // Buffers for results that span segments, keyed by position and size.
+  //  Moving the storage keeps the buffers at their addresses
+  using segmented_storage = std::map<std::pair<std::size_t, std::size_t>, std::string>;
+
+  struct segmented_state
+  {
+    CPP_PC__NO_COPY_MOVE (segmented_state);
+
+    segmented_state ()                    = delete ;
+
+    segmented_state (std::size_t error_position, segments const & ss)
+      : error_position(error_position)
+      , committed     (false)
+      , size          (0)
+      , current       (0)
+      , window_begin  (nullptr)
+      , window_offset (0)
+      , window_size   (0)
+    {
+      parts.reserve (ss.size ());
+      for (auto && s : ss)
+      {
+        CPP_PC__ASSERT (s.begin <= s.end);
+
+        // Empty segments are dropped so that every position maps to a
+        //  character in exactly one part
+        if (s.begin < s.end)
+        {
+          parts.push_back (part { s.begin, s.end, size });
+          size += static_cast<std::size_t> (s.end - s.begin);
+        }
+      }
+
+      if (!parts.empty ())
+      {
+        select (0);
+      }
+    }
+
+    CPP_PC__INLINE int peek (std::size_t position) const noexcept
+    {
+      CPP_PC__ASSERT (position <= size);
+
+      // Fast path, position is in the part of the last lookup
+      auto offset = position - window_offset;
+      if (offset < window_size)
+      {
+        return window_begin[offset];
+      }
+
+      if (position < size)
+      {
+        auto & p = locate (position);
+        return p.begin[position - p.offset];
+      }
+      else
+      {
+        return EOS;
+      }
+    }
+
+    CPP_PC__INLINE std::size_t remaining (std::size_t position) const noexcept
+    {
+      CPP_PC__ASSERT (position <= size);
+      return size - position;
+    }
+
+    // A result within one segment refers to the segment. A result that
+    //  spans segments is measured first and copied once, into storage owned
+    //  by the state until release_storage hands it over
+    template<typename TSatisfyFunction>
+    CPP_PC__INLINE sub_string satisfy (
+        std::size_t position
+      , std::size_t at_most
+      , TSatisfyFunction && satisfy_function
+      ) const
+    {
+      CPP_PC__ASSERT (position <= size);
+
+      auto limit = std::min (remaining (position), at_most);
+      if (limit == 0)
+      {
+        return sub_string (nullptr, nullptr);
+      }
+
+      auto & p      = locate (position);
+      auto start    = p.begin + (position - p.offset);
+      auto last     = start + std::min (limit, static_cast<std::size_t> (p.end - start));
+      auto current  = detail::scan (start, last, satisfy_function);
+
+      auto count = static_cast<std::size_t> (current - start);
+      if (current == p.end && count < limit)
+      {
+        count += skip_satisfy (
+            position + count
+          , limit - count
+          , [offset = count, &satisfy_function] (std::size_t index, char ch) { return satisfy_function (offset + index, ch); }
+          );
+      }
+
+      if (count == static_cast<std::size_t> (current - start))
+      {
+        // Fast path, the result lies within one segment
+        return sub_string (start, current);
+      }
+
+      return materialize (position, count);
+    }
+
+    template<typename TSatisfyFunction>
+    CPP_PC__INLINE std::size_t skip_satisfy (
+        std::size_t position
+      , std::size_t at_most
+      , TSatisfyFunction && satisfy_function
+      ) const noexcept
+    {
+      CPP_PC__ASSERT (position <= size);
+
+      auto limit = std::min (remaining (position), at_most);
+      auto count = std::size_t ();
+
+      while (count < limit)
+      {
+        auto & p      = locate (position + count);
+        auto start    = p.begin + (position + count - p.offset);
+        auto last     = start + std::min (limit - count, static_cast<std::size_t> (p.end - start));
+        auto current  = start;
+
+        for (
+          ; current < last && satisfy_function (count + static_cast<std::size_t> (current - start), *current)
+          ; ++current
+          )
+          ;
+
+        count += static_cast<std::size_t> (current - start);
+
+        if (current < last)
+        {
+          break;
+        }
+      }
+
+      return count;
+    }
+
+    // Hands over the buffers that results spanning segments refer to
+    segmented_storage release_storage () noexcept
+    {
+      return std::move (storage);
+    }
+
+    CPP_PC__INLINE void append_error (std::size_t position, base_error::ptr const & error) const
+    {
+      if (position == error_position && error)
+      {
+        errors.push_back (error);
+      }
+    }
+
+    // The segments are concatenated to describe the error
+    std::string error_description () const
+    {
+      std::string input;
+      input.reserve (size);
+      for (auto && p : parts)
+      {
+        input.append (p.begin, p.end);
+      }
+
+      auto begin  = input.c_str ();
+      auto end    = begin + input.size ();
+
+      state s (error_position, begin, end);
+      s.errors = errors;
+      return s.error_description ();
+    }
+
+    std::size_t const   error_position;
+
+    base_errors mutable errors        ;
+    bool mutable        committed     ;
+
+  private:
+    struct part
+    {
+      char const *  begin   ;
+      char const *  end     ;
+      std::size_t   offset  ;
+    };
+
+    CPP_PC__INLINE part const & locate (std::size_t position) const noexcept
+    {
+      CPP_PC__ASSERT (position < size);
+
+      // Parsing mostly moves forward so the part of the last lookup or the
+      //  one after it is the likely match
+      auto & c = parts[current];
+      if (position - c.offset < static_cast<std::size_t> (c.end - c.begin))
+      {
+        return c;
+      }
+
+      auto next = current + 1;
+      if (next < parts.size () && position - parts[next].offset < static_cast<std::size_t> (parts[next].end - parts[next].begin))
+      {
+        return select (next);
+      }
+
+      auto find = std::upper_bound (
+          parts.begin ()
+        , parts.end ()
+        , position
+        , [] (std::size_t pos, part const & p) { return pos < p.offset; }
+        );
+      CPP_PC__ASSERT (find != parts.begin ());
+
+      return select (static_cast<std::size_t> (find - parts.begin ()) - 1);
+    }
+
+    CPP_PC__INLINE part const & select (std::size_t index) const noexcept
+    {
+      auto & p = parts[index];
+
+      current       = index;
+      window_begin  = p.begin;
+      window_offset = p.offset;
+      window_size   = static_cast<std::size_t> (p.end - p.begin);
+
+      return p;
+    }
+
+    // Copies count characters at position into one buffer. A result that
+    //  is produced again after backtracking reuses its buffer
+    CPP_PC__INLINE sub_string materialize (std::size_t position, std::size_t count) const
+    {
+      auto & buffer = storage[std::make_pair (position, count)];
+      if (buffer.empty ())
+      {
+        buffer.reserve (count);
+        for (auto pos = position; buffer.size () < count; )
+        {
+          auto & p    = locate (pos);
+          auto start  = p.begin + (pos - p.offset);
+          auto n      = std::min (count - buffer.size (), static_cast<std::size_t> (p.end - start));
+          buffer.append (start, n);
+          pos += n;
+        }
+      }
+
+      auto begin = buffer.c_str ();
+      return sub_string (begin, begin + buffer.size ());
+    }
+
+    std::vector<part>               parts         ;
+    std::size_t                     size          ;
+    std::size_t mutable             current       ;
+    // The part of the last lookup, for the fast path of peek
+    char const mutable *            window_begin  ;
+    std::size_t mutable             window_offset ;
+    std::size_t mutable             window_size   ;
+    segmented_storage mutable       storage       ;
+  };
+
+  // The result of parse_segments. A value that spans segments refers to
+  //  storage, which moves along with the result but isn't copied, so the
+  //  result is move only
+  template<typename TValue>
+  struct segmented_parse_result : parse_result<TValue>
+  {
+    segmented_parse_result (parse_result<TValue> && result, segmented_storage storage)
+      : parse_result<TValue> (std::move (result))
+      , storage              (std::move (storage))
+    {
+    }
+
+    segmented_parse_result (segmented_parse_result const &)              = delete;
+    segmented_parse_result (segmented_parse_result &&)                   = default;
+    segmented_parse_result & operator= (segmented_parse_result const &)  = delete;
+    segmented_parse_result & operator= (segmented_parse_result &&)       = default;
+
+    segmented_storage storage;
+  };
+
+  // Parses the concatenation of the segments without copying them
+  template<typename TValueType, typename TParserFunction, typename TState>
+  auto parse_segments (
+      parser<TValueType, TParserFunction, TState> const & p
+    , segments const &                                    ss
+    )
+  {
+    using result_type = segmented_parse_result<TValueType>;
+
+    segmented_state s (SIZE_MAX, ss);
+    auto v = p.parser_function (s, 0);
+    if (v.value)
+    {
+      return result_type (
+          parse_result<TValueType> (v.position, std::move (v.value), std::string ())
+        , s.release_storage ()
+        );
+    }
+    else
+    {
+      segmented_state es (v.position, ss);
+      auto ev = p.parser_function (es, 0);
+
+      CPP_PC__ASSERT (v.position == ev.position);
+      CPP_PC__ASSERT (!ev.value);
+
+      return result_type (
+          parse_result<TValueType> (ev.position, empty_opt, es.error_description ())
+        , segmented_storage ()
+        );
+    }
+  }
+}
+// ----------------------------------------------------------------------------
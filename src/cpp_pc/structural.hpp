@@ -0,0 +1,696 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#pragma once
+// ----------------------------------------------------------------------------
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+// ----------------------------------------------------------------------------
+#include "common.hpp"
+#include "parallel.hpp"
+#include "pc.hpp"
+// ----------------------------------------------------------------------------
+#if !defined(CPP_PC__NO_SSE2) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+# define CPP_PC__SSE2
+# include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+// Structural index: a pass over the input, 64 characters at a time, that
+//  finds the quotes, backslashes and brackets of JSON like input and which
+//  characters are inside strings (as in simdjson's stage 1). structural_state
+//  consults the index so that string runs and whitespace are skipped in one
+//  step rather than scanned
+// ----------------------------------------------------------------------------
+namespace cpp_pc
+{
+  // positions holds, in order, the positions of
+  //    unescaped quotes
+  //    backslashes that start an escape
+  //    '{', '}', '[', ']', ':' and ',' outside strings
+  //    the first character of runs of other characters outside strings
+  //  Bit i of in_string is set if the character at i follows an opening
+  //  quote, the opening quote included and the closing quote excluded
+  struct structural_index
+  {
+    std::vector<position_type>  positions ;
+    std::vector<std::uint64_t>  in_string ;
+    std::size_t                 size      = 0;
+
+    CPP_PC__INLINE void clear () noexcept
+    {
+      positions.clear ();
+      in_string.clear ();
+      size = 0;
+    }
+
+    CPP_PC__INLINE bool is_in_string (std::size_t position) const noexcept
+    {
+      CPP_PC__ASSERT (position < size);
+      return (in_string[position / 64] >> (position % 64)) & 1;
+    }
+  };
+
+  namespace detail
+  {
+    CPP_PC__INLINE std::size_t trailing_zeros (std::uint64_t v) noexcept
+    {
+      CPP_PC__ASSERT (v != 0);
+#ifdef _MSC_VER
+      unsigned long index;
+      _BitScanForward64 (&index, v);
+      return index;
+#else
+      return static_cast<std::size_t> (__builtin_ctzll (v));
+#endif
+    }
+
+    CPP_PC__INLINE std::size_t population_count (std::uint64_t v) noexcept
+    {
+#ifdef _MSC_VER
+      return static_cast<std::size_t> (__popcnt64 (v));
+#else
+      return static_cast<std::size_t> (__builtin_popcountll (v));
+#endif
+    }
+
+    // Bit i is set if character i of the block is one of the class
+    struct structural_masks
+    {
+      std::uint64_t quote     ;
+      std::uint64_t backslash ;
+      std::uint64_t op        ;
+      std::uint64_t ws        ;
+    };
+
+    CPP_PC__INLINE structural_masks classify_block_scalar (char const * block) noexcept
+    {
+      structural_masks m { 0, 0, 0, 0 };
+
+      for (auto iter = 0U; iter < 64U; ++iter)
+      {
+        auto bit = std::uint64_t (1) << iter;
+        switch (block[iter])
+        {
+        case '"':
+          m.quote     |= bit;
+          break;
+        case '\\':
+          m.backslash |= bit;
+          break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+          m.op        |= bit;
+          break;
+        case ' ':
+        case '\b':
+        case '\f':
+        case '\n':
+        case '\r':
+        case '\t':
+          m.ws        |= bit;
+          break;
+        default:
+          break;
+        }
+      }
+
+      return m;
+    }
+
+#ifdef CPP_PC__SSE2
+    CPP_PC__INLINE structural_masks classify_block_sse2 (char const * block) noexcept
+    {
+      __m128i chunks[4];
+      for (auto iter = 0U; iter < 4U; ++iter)
+      {
+        chunks[iter] = _mm_loadu_si128 (reinterpret_cast<__m128i const *> (block + 16*iter));
+      }
+
+      auto mask = [&chunks] (auto && eq)
+        {
+          std::uint64_t result = 0;
+          for (auto iter = 0U; iter < 4U; ++iter)
+          {
+            auto bits = static_cast<std::uint16_t> (_mm_movemask_epi8 (eq (chunks[iter])));
+            result |= static_cast<std::uint64_t> (bits) << (16*iter);
+          }
+          return result;
+        };
+
+      auto quote      = _mm_set1_epi8 ('"');
+      auto backslash  = _mm_set1_epi8 ('\\');
+      // '[' and ']' differ from '{' and '}' by 0x20 only
+      auto case_bit   = _mm_set1_epi8 (0x20);
+      auto open       = _mm_set1_epi8 ('{');
+      auto close      = _mm_set1_epi8 ('}');
+      auto colon      = _mm_set1_epi8 (':');
+      auto comma      = _mm_set1_epi8 (',');
+      auto space      = _mm_set1_epi8 (' ');
+      // '\b', '\t', '\n', '\f' and '\r' are 8, 9, 10, 12 and 13
+      auto ws_low     = _mm_set1_epi8 ('\b' - 1);
+      auto ws_high    = _mm_set1_epi8 ('\r' + 1);
+      auto vt         = _mm_set1_epi8 ('\v');
+
+      structural_masks m;
+      m.quote     = mask ([&] (__m128i v) { return _mm_cmpeq_epi8 (v, quote); });
+      m.backslash = mask ([&] (__m128i v) { return _mm_cmpeq_epi8 (v, backslash); });
+      m.op        = mask ([&] (__m128i v)
+        {
+          auto folded = _mm_or_si128 (v, case_bit);
+          return _mm_or_si128 (
+              _mm_or_si128 (_mm_cmpeq_epi8 (folded, open), _mm_cmpeq_epi8 (folded, close))
+            , _mm_or_si128 (_mm_cmpeq_epi8 (v, colon), _mm_cmpeq_epi8 (v, comma))
+            );
+        });
+      m.ws        = mask ([&] (__m128i v)
+        {
+          // Signed compares, characters above 0x7F are negative
+          auto control = _mm_and_si128 (_mm_cmpgt_epi8 (v, ws_low), _mm_cmplt_epi8 (v, ws_high));
+          return _mm_or_si128 (
+              _mm_cmpeq_epi8 (v, space)
+            , _mm_andnot_si128 (_mm_cmpeq_epi8 (v, vt), control)
+            );
+        });
+
+      return m;
+    }
+#endif
+
+    CPP_PC__INLINE structural_masks classify_block (char const * block) noexcept
+    {
+#ifdef CPP_PC__SSE2
+      return classify_block_sse2 (block);
+#else
+      return classify_block_scalar (block);
+#endif
+    }
+
+    // The state carried from one block to the next
+    struct structural_carry
+    {
+      // 1 if the first character of the next block is escaped
+      std::uint64_t escaped   = 0;
+      // All ones if the next block starts inside a string
+      std::uint64_t in_string = 0;
+      // 1 if the last character of the block is part of a scalar run
+      std::uint64_t scalar    = 0;
+    };
+
+    // The characters escaped by a backslash, the ones that follow an odd
+    //  length run of backslashes
+    CPP_PC__INLINE std::uint64_t find_escaped (std::uint64_t backslash, std::uint64_t & prev_escaped) noexcept
+    {
+      std::uint64_t const even_bits = 0x5555555555555555ULL;
+
+      // An escaped backslash doesn't start a run
+      backslash &= ~prev_escaped;
+      auto follows  = (backslash << 1) | prev_escaped;
+
+      // Adding the runs that start on odd bits to the backslashes carries
+      //  past the end of them, this identifies runs of odd length
+      auto odd_starts = backslash & ~even_bits & ~follows;
+      auto sum        = odd_starts + backslash;
+      prev_escaped    = sum < odd_starts ? 1 : 0;
+
+      return (even_bits ^ (sum << 1)) & follows;
+    }
+
+    // Bit i of the result is the xor of bits 0 to i of v
+    CPP_PC__INLINE std::uint64_t prefix_xor (std::uint64_t v) noexcept
+    {
+      v ^= v << 1;
+      v ^= v << 2;
+      v ^= v << 4;
+      v ^= v << 8;
+      v ^= v << 16;
+      v ^= v << 32;
+      return v;
+    }
+
+    // Indexes the block at offset, returns its in_string bits
+    CPP_PC__INLINE std::uint64_t index_block (
+        char const *                  block
+      , std::size_t                   offset
+      , structural_carry &            carry
+      , std::vector<position_type> &  positions
+      )
+    {
+      auto m        = classify_block (block);
+
+      auto escaped  = find_escaped (m.backslash, carry.escaped);
+      auto quote    = m.quote & ~escaped;
+      auto escapes  = m.backslash & ~escaped;
+
+      auto in_string  = prefix_xor (quote) ^ carry.in_string;
+      carry.in_string = static_cast<std::uint64_t> (static_cast<std::int64_t> (in_string) >> 63);
+
+      auto outside  = ~in_string;
+      auto scalar   = outside & ~m.op & ~m.ws & ~quote;
+      auto starts   = scalar & ~((scalar << 1) | carry.scalar);
+      carry.scalar  = scalar >> 63;
+
+      auto entries  = quote | escapes | (m.op & outside) | starts;
+
+      auto first = positions.size ();
+      positions.resize (first + population_count (entries));
+      auto iter = positions.begin () + first;
+      for (; entries; entries &= entries - 1, ++iter)
+      {
+        *iter = static_cast<position_type> (offset + trailing_zeros (entries));
+      }
+
+      return in_string;
+    }
+
+    // Calls f (block, offset) for the blocks of [first, last), a partial
+    //  last block is padded with whitespace so it produces no entries
+    template<typename TFunction>
+    CPP_PC__INLINE void for_each_block (char const * begin, std::size_t first, std::size_t last, TFunction && f)
+    {
+      CPP_PC__ASSERT (first % 64 == 0);
+
+      auto offset = first;
+      for (; last - offset >= 64; offset += 64)
+      {
+        f (begin + offset, offset);
+      }
+
+      if (offset < last)
+      {
+        char block[64];
+        std::memset (block, ' ', sizeof (block));
+        std::memcpy (block, begin + offset, last - offset);
+        f (static_cast<char const *> (block), offset);
+      }
+    }
+
+    // Indexes [first, last) starting from carry, the in_string bits are
+    //  written to in_string[0], in_string[1], ...
+    CPP_PC__INLINE void index_range (
+        char const *                  begin
+      , std::size_t                   first
+      , std::size_t                   last
+      , structural_carry              carry
+      , std::vector<position_type> &  positions
+      , std::uint64_t *               in_string
+      )
+    {
+      for_each_block (begin, first, last, [&carry, &positions, &in_string] (char const * block, std::size_t offset)
+        {
+          *in_string++ = index_block (block, offset, carry, positions);
+        });
+    }
+
+    // The padding of the last block isn't part of any string
+    CPP_PC__INLINE void clear_padding (structural_index & index) noexcept
+    {
+      if (index.size % 64 != 0)
+      {
+        index.in_string.back () &= (std::uint64_t (1) << (index.size % 64)) - 1;
+      }
+    }
+  }
+
+  // Builds the index 64 characters at a time, with SSE2 when it's available
+  CPP_PC__INLINE void build_structural_index (char const * begin, char const * end, structural_index & index)
+  {
+    CPP_PC__ASSERT (begin <= end);
+    CPP_PC__ASSERT (state::fits (begin, end));
+
+    auto size = static_cast<std::size_t> (end - begin);
+
+    index.clear ();
+    index.size = size;
+    index.in_string.resize ((size + 63) / 64);
+
+    detail::index_range (begin, 0, size, detail::structural_carry (), index.positions, index.in_string.data ());
+    detail::clear_padding (index);
+  }
+
+  namespace detail
+  {
+    // True if the character at position follows an odd length run of
+    //  backslashes
+    CPP_PC__INLINE bool is_escaped (char const * begin, std::size_t position) noexcept
+    {
+      auto count = std::size_t ();
+      for (; count < position && begin[position - count - 1] == '\\'; ++count)
+        ;
+
+      return count % 2 == 1;
+    }
+
+    // 1 if [first, last) has an odd number of unescaped quotes
+    CPP_PC__INLINE std::uint64_t quote_parity (char const * begin, std::size_t first, std::size_t last) noexcept
+    {
+      auto prev_escaped = is_escaped (begin, first) ? std::uint64_t (1) : std::uint64_t (0);
+      auto parity       = std::size_t ();
+
+      for_each_block (begin, first, last, [&prev_escaped, &parity] (char const * block, std::size_t)
+        {
+          auto m = classify_block (block);
+          parity += population_count (m.quote & ~find_escaped (m.backslash, prev_escaped));
+        });
+
+      return parity % 2;
+    }
+
+    // The carry of the block at first, given if first is inside a string
+    CPP_PC__INLINE structural_carry carry_at (char const * begin, std::size_t first, bool in_string) noexcept
+    {
+      structural_carry carry;
+      carry.escaped   = is_escaped (begin, first) ? 1 : 0;
+      carry.in_string = in_string ? ~std::uint64_t (0) : 0;
+
+      if (first > 0 && !in_string)
+      {
+        auto ch     = begin[first - 1];
+        // Outside strings a quote is a closing quote unless it's escaped
+        auto quote  = ch == '"' && !is_escaped (begin, first - 1);
+        auto op     = ch == '{' || ch == '}' || ch == '[' || ch == ']' || ch == ':' || ch == ',';
+        carry.scalar = !quote && !op && !satisfy_whitespace (0, ch) ? 1 : 0;
+      }
+
+      return carry;
+    }
+  }
+
+  CPP_PC__PRELUDE std::size_t structural_chunk_size = 1U << 20;
+
+  // Builds the same index as build_structural_index on the pool, in chunks
+  //  of chunk_size characters. Whether a chunk starts inside a string depends
+  //  on the quotes before it, so the chunks are indexed in two passes:
+  //    1. The parity of the unescaped quotes of each chunk, an escape at the
+  //       start of a chunk is found by looking back at the backslashes
+  //    2. The index of each chunk, carrying in the xor of the parities of
+  //       the chunks before it
+  //  The positions of the chunks are then copied into index
+  CPP_PC__INLINE void build_structural_index (
+      work_stealing_pool &  pool
+    , char const *          begin
+    , char const *          end
+    , structural_index &    index
+    , std::size_t           chunk_size = structural_chunk_size
+    )
+  {
+    CPP_PC__ASSERT (begin <= end);
+    CPP_PC__ASSERT (state::fits (begin, end));
+
+    auto size = static_cast<std::size_t> (end - begin);
+
+    chunk_size  = std::max<std::size_t> (chunk_size / 64, 1U) * 64;
+    auto chunks = (size + chunk_size - 1) / chunk_size;
+
+    if (chunks < 2)
+    {
+      build_structural_index (begin, end, index);
+      return;
+    }
+
+    index.clear ();
+    index.size = size;
+    index.in_string.resize ((size + 63) / 64);
+
+    auto chunk_end = [size, chunk_size] (std::size_t chunk)
+      {
+        return std::min (size, (chunk + 1) * chunk_size);
+      };
+
+    std::vector<std::uint64_t> parities (chunks);
+    pool.run (chunks, [&] (std::size_t, std::size_t chunk)
+      {
+        parities[chunk] = detail::quote_parity (begin, chunk * chunk_size, chunk_end (chunk));
+      });
+
+    std::vector<detail::structural_carry> carries (chunks);
+    auto in_string = false;
+    for (auto chunk = std::size_t (); chunk < chunks; ++chunk)
+    {
+      carries[chunk] = detail::carry_at (begin, chunk * chunk_size, in_string);
+      in_string ^= parities[chunk] != 0;
+    }
+
+    std::vector<std::vector<position_type>> positions (chunks);
+    pool.run (chunks, [&] (std::size_t, std::size_t chunk)
+      {
+        auto first = chunk * chunk_size;
+        detail::index_range (begin, first, chunk_end (chunk), carries[chunk], positions[chunk], index.in_string.data () + first / 64);
+      });
+
+    std::vector<std::size_t> offsets (chunks + 1);
+    for (auto chunk = std::size_t (); chunk < chunks; ++chunk)
+    {
+      offsets[chunk + 1] = offsets[chunk] + positions[chunk].size ();
+    }
+
+    index.positions.resize (offsets.back ());
+    pool.run (chunks, [&] (std::size_t, std::size_t chunk)
+      {
+        std::copy (positions[chunk].begin (), positions[chunk].end (), index.positions.begin () + offsets[chunk]);
+      });
+
+    detail::clear_padding (index);
+  }
+
+  // The scalar fallback, builds the same index one character at a time
+  CPP_PC__INLINE void build_structural_index_scalar (char const * begin, char const * end, structural_index & index)
+  {
+    CPP_PC__ASSERT (begin <= end);
+    CPP_PC__ASSERT (state::fits (begin, end));
+
+    auto size = static_cast<std::size_t> (end - begin);
+
+    index.clear ();
+    index.size = size;
+    index.in_string.resize ((size + 63) / 64);
+
+    auto escaped      = false;
+    auto in_string    = false;
+    auto prev_scalar  = false;
+
+    for (auto position = std::size_t (); position < size; ++position)
+    {
+      auto ch = begin[position];
+
+      auto is_escape  = ch == '\\' && !escaped;
+      auto is_quote   = ch == '"' && !escaped;
+      escaped         = is_escape;
+
+      if (is_quote)
+      {
+        in_string = !in_string;
+      }
+
+      if (in_string)
+      {
+        index.in_string[position / 64] |= std::uint64_t (1) << (position % 64);
+      }
+
+      auto is_op      = !in_string && (ch == '{' || ch == '}' || ch == '[' || ch == ']' || ch == ':' || ch == ',');
+      auto is_scalar  = !in_string && !is_op && !is_quote && !satisfy_whitespace (0, ch);
+
+      if (is_quote || is_escape || is_op || (is_scalar && !prev_scalar))
+      {
+        index.positions.push_back (static_cast<position_type> (position));
+      }
+
+      prev_scalar = is_scalar;
+    }
+  }
+
+  // A state that skips string runs and whitespace using a structural index
+  //  of the input, the index must be built from the same input
+  struct structural_state : state
+  {
+    structural_state (std::size_t error_position, char const * begin, char const * end, structural_index const & index) noexcept
+      : state   (error_position, begin, end)
+      , index   (index)
+      , cursor  (0)
+    {
+      CPP_PC__ASSERT (index.size == static_cast<std::size_t> (end - begin));
+    }
+
+    template<typename TSatisfyFunction>
+    CPP_PC__INLINE sub_string satisfy (
+        std::size_t position
+      , std::size_t at_most
+      , TSatisfyFunction && satisfy_function
+      ) const noexcept
+    {
+      return indexed_satisfy (position, at_most, satisfy_function);
+    }
+
+    template<typename TSatisfyFunction>
+    CPP_PC__INLINE std::size_t skip_satisfy (
+        std::size_t position
+      , std::size_t at_most
+      , TSatisfyFunction && satisfy_function
+      ) const noexcept
+    {
+      return indexed_skip_satisfy (position, at_most, satisfy_function);
+    }
+
+  private:
+    template<typename TSatisfyFunction>
+    CPP_PC__INLINE sub_string indexed_satisfy (
+        std::size_t               position
+      , std::size_t               at_most
+      , TSatisfyFunction const &  satisfy_function
+      ) const noexcept
+    {
+      return state::satisfy (position, at_most, satisfy_function);
+    }
+
+    // Inside a string a run of characters other than quotes and backslashes
+    //  ends at the next entry of the index
+    CPP_PC__INLINE sub_string indexed_satisfy (
+        std::size_t                       position
+      , std::size_t                       at_most
+      , detail::none_of_function const &  satisfy_function
+      ) const noexcept
+    {
+      auto run = indexed_run (position, at_most, satisfy_function);
+      return sub_string (begin + position, begin + position + run);
+    }
+
+    template<typename TSatisfyFunction>
+    CPP_PC__INLINE std::size_t indexed_skip_satisfy (
+        std::size_t               position
+      , std::size_t               at_most
+      , TSatisfyFunction const &  satisfy_function
+      ) const noexcept
+    {
+      return state::skip_satisfy (position, at_most, satisfy_function);
+    }
+
+    CPP_PC__INLINE std::size_t indexed_skip_satisfy (
+        std::size_t                       position
+      , std::size_t                       at_most
+      , detail::none_of_function const &  satisfy_function
+      ) const noexcept
+    {
+      return indexed_run (position, at_most, satisfy_function);
+    }
+
+    // Outside strings whitespace ends at the next entry of the index, the
+    //  padding of the last block aside only whitespace lies between entries
+    CPP_PC__INLINE std::size_t indexed_skip_satisfy (
+        std::size_t                                 position
+      , std::size_t                                 at_most
+      , detail::satisfy_whitespace_function const & satisfy_function
+      ) const noexcept
+    {
+      auto limit = std::min (remaining (position), at_most);
+      if (limit == 0 || !satisfy_function (0, begin[position]) || index.is_in_string (position))
+      {
+        return state::skip_satisfy (position, at_most, satisfy_function);
+      }
+
+      return std::min (next_entry (position + 1), position + limit) - position;
+    }
+
+    CPP_PC__INLINE std::size_t indexed_run (
+        std::size_t                       position
+      , std::size_t                       at_most
+      , detail::none_of_function const &  satisfy_function
+      ) const noexcept
+    {
+      auto limit = std::min (remaining (position), at_most);
+      if (
+            limit == 0
+        ||  !is_string_run (satisfy_function)
+        ||  !satisfy_function (0, begin[position])
+        ||  !index.is_in_string (position)
+        )
+      {
+        return state::skip_satisfy (position, at_most, satisfy_function);
+      }
+
+      return std::min (next_entry (position + 1), position + limit) - position;
+    }
+
+    static CPP_PC__INLINE bool is_string_run (detail::none_of_function const & satisfy_function) noexcept
+    {
+      return
+            (satisfy_function.first == '"' && satisfy_function.second == '\\')
+        ||  (satisfy_function.first == '\\' && satisfy_function.second == '"')
+        ;
+    }
+
+    // The first entry at or after position, or the end of the input.
+    //  Parsing mostly moves forward so the search starts at the entry of
+    //  the last lookup
+    CPP_PC__INLINE std::size_t next_entry (std::size_t position) const noexcept
+    {
+      auto & positions  = index.positions;
+      auto size         = positions.size ();
+
+      if (cursor > 0 && positions[cursor - 1] >= position)
+      {
+        cursor = static_cast<std::size_t> (std::lower_bound (positions.begin (), positions.begin () + cursor, position) - positions.begin ());
+      }
+      else
+      {
+        for (; cursor < size && positions[cursor] < position; ++cursor)
+          ;
+      }
+
+      return cursor < size ? positions[cursor] : index.size;
+    }
+
+    structural_index const &  index   ;
+    std::size_t mutable       cursor  ;
+  };
+
+  // Parses [begin, end) with a structural_state, index must be built from
+  //  [begin, end)
+  template<typename TValueType, typename TParserFunction>
+  auto parse_indexed (
+      parser<TValueType, TParserFunction, structural_state> const & p
+    , char const *                                                  begin
+    , char const *                                                  end
+    , structural_index const &                                      index
+    )
+  {
+    structural_state s (SIZE_MAX, begin, end, index);
+    auto v = p.parser_function (s, 0);
+    if (v.value)
+    {
+      return parse_result<TValueType> (v.position, std::move (v.value), std::string ());
+    }
+    else
+    {
+      structural_state es (v.position, begin, end, index);
+      auto ev = p.parser_function (es, 0);
+
+      CPP_PC__ASSERT (v.position == ev.position);
+      CPP_PC__ASSERT (!ev.value);
+
+      return parse_result<TValueType> (ev.position, empty_opt, es.error_description ());
+    }
+  }
+}
+// ----------------------------------------------------------------------------
@@ -0,0 +1,271 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#pragma once
+// ----------------------------------------------------------------------------
+#include <string>
+#include <vector>
+// ----------------------------------------------------------------------------
+#include "common.hpp"
+#include "pc.hpp"
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+// Two-stage parsing: a lexer built from the character parsers produces an
+//  array of tokens, the grammar then runs on a token_state where a position
+//  is a token index and peek returns the token kind. As token kinds for
+//  punctuation are the characters themselves pskip_char, pchoice, pbetween,
+//  pmany_sepby and the other structural combinators work unchanged on tokens
+// ----------------------------------------------------------------------------
+namespace cpp_pc
+{
+  struct token
+  {
+    int           kind  ;
+    std::size_t   begin ;
+    std::size_t   end   ;
+  };
+
+  using tokens = std::vector<token>;
+
+  struct token_state
+  {
+    CPP_PC__NO_COPY_MOVE (token_state);
+
+    token_state ()                        = delete ;
+
+    token_state (
+        std::size_t   error_position
+      , token const * begin
+      , token const * end
+      , char const *  source_begin
+      , char const *  source_end
+      ) noexcept
+      : error_position(error_position)
+      , begin         (begin)
+      , end           (end)
+      , source_begin  (source_begin)
+      , source_end    (source_end)
+      , committed     (false)
+    {
+      CPP_PC__ASSERT (begin <= end);
+      CPP_PC__ASSERT (source_begin <= source_end);
+    }
+
+    CPP_PC__INLINE int peek (std::size_t position) const noexcept
+    {
+      auto current = begin + position;
+      CPP_PC__ASSERT (current <= end);
+      return
+          current < end
+        ? current->kind
+        : EOS
+        ;
+    }
+
+    CPP_PC__INLINE std::size_t remaining (std::size_t position) const noexcept
+    {
+      auto current = begin + position;
+      CPP_PC__ASSERT (current <= end);
+      return end - current;
+    }
+
+    CPP_PC__INLINE sub_string lexeme (std::size_t position) const noexcept
+    {
+      auto current = begin + position;
+      CPP_PC__ASSERT (current < end);
+      return sub_string (source_begin + current->begin, source_begin + current->end);
+    }
+
+    // Maps a token index to an offset in the source
+    CPP_PC__INLINE std::size_t source_position (std::size_t position) const noexcept
+    {
+      auto current = begin + position;
+      return
+          current < end
+        ? current->begin
+        : static_cast<std::size_t> (source_end - source_begin)
+        ;
+    }
+
+    CPP_PC__INLINE void append_error (std::size_t position, base_error::ptr const & error) const
+    {
+      if (position == error_position && error)
+      {
+        errors.push_back (error);
+      }
+    }
+
+    std::string error_description () const
+    {
+      state s (source_position (error_position), source_begin, source_end);
+      s.errors = errors;
+      return s.error_description ();
+    }
+
+    std::size_t const   error_position;
+    token const * const begin         ;
+    token const * const end           ;
+    char const * const  source_begin  ;
+    char const * const  source_end    ;
+
+    base_errors mutable errors        ;
+    bool mutable        committed     ;
+  };
+
+  // Produces a token of the given kind spanning the characters consumed by t
+  template<typename TParser>
+  CPP_PC__PRELUDE auto plexeme (int kind, TParser && t)
+  {
+    CPP_PC__CHECK_PARSER (t);
+
+    return detail::adapt_parser_function (
+      [kind, t = std::forward<TParser> (t)] (auto const & s, std::size_t position)
+      {
+        using result_type = result<token>;
+
+        auto tv = t.parser_function (s, position);
+        if (tv.value)
+        {
+          return result_type::success (tv.position, token { kind, position, tv.position });
+        }
+        else
+        {
+          return result_type::failure (tv.position);
+        }
+      });
+  }
+
+  // Produces the tokens of the whole input, pskip is applied before and
+  //  after each lexeme
+  template<typename TSkipParser, typename TLexemeParser>
+  CPP_PC__INLINE auto plexer (TSkipParser && skip_parser, TLexemeParser && lexeme_parser)
+  {
+    CPP_PC__CHECK_PARSER (skip_parser);
+    CPP_PC__CHECK_PARSER (lexeme_parser);
+
+    return skip_parser < pmany (lexeme_parser > skip_parser) > peos;
+  }
+
+  // Matches a token of the given kind and produces its lexeme
+  CPP_PC__INLINE auto ptoken (int kind, std::string expected)
+  {
+    return detail::adapt_parser_function<token_state> (
+      [kind, error = detail::make_expected (std::move (expected))] (token_state const & s, std::size_t position)
+      {
+        using result_type = result<sub_string> ;
+
+        s.append_error (position, error);
+
+        if (s.peek (position) == kind)
+        {
+          return result_type::success (position + 1, s.lexeme (position));
+        }
+        else
+        {
+          return result_type::failure (position);
+        }
+      });
+  }
+
+  // Runs a character parser on a lexeme, used to compute token values
+  //  Empty if p fails on the lexeme
+  template<typename TValueType, typename TParserFunction>
+  CPP_PC__INLINE opt<TValueType> parse_lexeme (parser<TValueType, TParserFunction> const & p, sub_string const & lexeme)
+  {
+    state s (SIZE_MAX, lexeme.begin, lexeme.end);
+    auto v = p.parser_function (s, 0);
+
+    return std::move (v.value);
+  }
+
+  // Matches a token of kind and computes its value with p from the lexeme,
+  //  fails at the token if p fails on the lexeme
+  template<typename TValueType, typename TParserFunction>
+  CPP_PC__INLINE auto plexeme (int kind, std::string expected, parser<TValueType, TParserFunction> const & p)
+  {
+    return detail::adapt_parser_function<token_state> (
+      [kind, p, error = detail::make_expected (std::move (expected))] (token_state const & s, std::size_t position)
+      {
+        using result_type = result<TValueType> ;
+
+        s.append_error (position, error);
+
+        if (s.peek (position) != kind)
+        {
+          return result_type::failure (position);
+        }
+
+        auto v = parse_lexeme (p, s.lexeme (position));
+        if (!v)
+        {
+          return result_type::failure (position);
+        }
+
+        return result_type::success (position + 1, std::move (v.get ()));
+      });
+  }
+
+  // Parses a token array, consumed and error positions are source offsets
+  template<typename TValueType, typename TParserFunction, typename TState>
+  auto parse_tokens (
+      parser<TValueType, TParserFunction, TState> const & p
+    , tokens const &                                      ts
+    , char const *                                        source_begin
+    , char const *                                        source_end
+    )
+  {
+    auto begin  = ts.data ();
+    auto end    = begin + ts.size ();
+
+    token_state s (SIZE_MAX, begin, end, source_begin, source_end);
+    auto v = p.parser_function (s, 0);
+    if (v.value)
+    {
+      return parse_result<TValueType> (s.source_position (v.position), std::move (v.value), std::string ());
+    }
+    else
+    {
+      token_state es (v.position, begin, end, source_begin, source_end);
+      auto ev = p.parser_function (es, 0);
+
+      CPP_PC__ASSERT (v.position == ev.position);
+      CPP_PC__ASSERT (!ev.value);
+
+      return parse_result<TValueType> (es.source_position (ev.position), empty_opt, es.error_description ());
+    }
+  }
+
+  // Tokenizes the input with lexer and then parses the tokens with p
+  template<typename TLexerFunction, typename TValueType, typename TParserFunction, typename TState>
+  auto parse_tokenized (
+      parser<tokens, TLexerFunction> const &              lexer
+    , parser<TValueType, TParserFunction, TState> const & p
+    , std::string const &                                 i
+    )
+  {
+    auto begin  = i.c_str ();
+    auto end    = begin + i.size ();
+
+    auto lv = parse (lexer, begin, end);
+    if (!lv.value)
+    {
+      return parse_result<TValueType> (lv.consumed, empty_opt, std::move (lv.message));
+    }
+
+    return parse_tokens (p, lv.value.get (), begin, end);
+  }
+}
+// ----------------------------------------------------------------------------
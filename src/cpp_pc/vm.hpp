@@ -0,0 +1,650 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#pragma once
+// ----------------------------------------------------------------------------
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+// ----------------------------------------------------------------------------
+#include "common.hpp"
+#include "opt.hpp"
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+// PEG virtual machine: grammars that are only known at runtime (loaded from
+//  configuration for example) are built from patterns, compiled to a program
+//  and executed by an interpreter with an explicit backtrack stack, in the
+//  manner of LPeg
+//
+//  Patterns don't produce values, matched ranges are reported as captures
+// ----------------------------------------------------------------------------
+namespace cpp_pc
+{
+  namespace vm
+  {
+    using char_set = std::bitset<256>;
+
+    enum class opcode : std::uint8_t
+    {
+      any           , // Matches any character
+      char_         , // Matches the character arg
+      set           , // Matches a character in sets[arg]
+      span          , // Skips the characters in sets[arg], never fails
+      literal       , // Matches literals[arg]
+      choice        , // Pushes a backtrack entry for the alternative at offset
+      commit        , // Pops the backtrack entry and jumps to offset
+      partial_commit, // Updates the backtrack entry to the current position and
+                      //  jumps to offset, closes loops
+      fail          , // Backtracks to the last backtrack entry
+      fail_twice    , // Pops the backtrack entry and fails, for pnot
+      jump          , // Jumps to offset
+      call          , // Calls the rule arg, calls[arg] before linking
+      return_       , // Returns from a rule
+      open_capture  , // Opens a capture with the id arg
+      close_capture , // Closes the last open capture
+      end           , // The match succeeded
+    };
+
+    // offset is relative to the instruction so that code can be
+    //  concatenated without relocation
+    struct instruction
+    {
+      opcode        op      ;
+      std::int32_t  offset  ;
+      std::uint32_t arg     ;
+    };
+
+    struct pattern
+    {
+      std::vector<instruction>  code      ;
+      std::vector<char_set>     sets      ;
+      std::vector<std::string>  literals  ;
+      // The names of the rules called
+      std::vector<std::string>  calls     ;
+    };
+
+    namespace detail
+    {
+      CPP_PC__INLINE instruction make_instruction (opcode op, std::int32_t offset = 0, std::uint32_t arg = 0)
+      {
+        return instruction { op, offset, arg };
+      }
+
+      CPP_PC__INLINE std::int32_t offset_of (std::size_t size)
+      {
+        return static_cast<std::int32_t> (size);
+      }
+
+      CPP_PC__INLINE std::uint32_t index_of (std::size_t size)
+      {
+        return static_cast<std::uint32_t> (size);
+      }
+
+      // Appends the code of from to to, indices into the pools are adjusted
+      CPP_PC__INLINE void append (pattern & to, pattern const & from)
+      {
+        auto sets     = index_of (to.sets.size ());
+        auto literals = index_of (to.literals.size ());
+        auto calls    = index_of (to.calls.size ());
+
+        for (auto i : from.code)
+        {
+          switch (i.op)
+          {
+          case opcode::set:
+          case opcode::span:
+            i.arg += sets;
+            break;
+          case opcode::literal:
+            i.arg += literals;
+            break;
+          case opcode::call:
+            i.arg += calls;
+            break;
+          default:
+            break;
+          }
+          to.code.push_back (i);
+        }
+
+        to.sets.insert (to.sets.end (), from.sets.begin (), from.sets.end ());
+        to.literals.insert (to.literals.end (), from.literals.begin (), from.literals.end ());
+        to.calls.insert (to.calls.end (), from.calls.begin (), from.calls.end ());
+      }
+
+      CPP_PC__INLINE pattern single (instruction i)
+      {
+        pattern p;
+        p.code.push_back (i);
+        return p;
+      }
+
+      CPP_PC__INLINE pattern set (char_set const & cs)
+      {
+        pattern p;
+        p.code.push_back (make_instruction (opcode::set, 0, 0));
+        p.sets.push_back (cs);
+        return p;
+      }
+
+      CPP_PC__INLINE void sequence (pattern &)
+      {
+      }
+
+      template<typename ...TPatterns>
+      CPP_PC__INLINE void sequence (pattern & to, pattern const & p, TPatterns const & ...ps)
+      {
+        append (to, p);
+        sequence (to, ps...);
+      }
+
+      // choice L1; p; commit L2; L1: q; L2:
+      CPP_PC__INLINE pattern choice (pattern const & p, pattern const & q)
+      {
+        pattern result;
+        result.code.push_back (make_instruction (opcode::choice, offset_of (p.code.size () + 2)));
+        append (result, p);
+        result.code.push_back (make_instruction (opcode::commit, offset_of (q.code.size () + 1)));
+        append (result, q);
+        return result;
+      }
+    }
+
+    CPP_PC__INLINE pattern pany ()
+    {
+      return detail::single (detail::make_instruction (opcode::any));
+    }
+
+    CPP_PC__INLINE pattern pchar (char ch)
+    {
+      return detail::single (detail::make_instruction (opcode::char_, 0, static_cast<unsigned char> (ch)));
+    }
+
+    // Matches one of the characters in chars
+    CPP_PC__INLINE pattern pany_of (std::string const & chars)
+    {
+      char_set cs;
+      for (auto ch : chars)
+      {
+        cs.set (static_cast<unsigned char> (ch));
+      }
+      return detail::set (cs);
+    }
+
+    // Matches a character in [first, last]
+    CPP_PC__INLINE pattern prange (char first, char last)
+    {
+      char_set cs;
+      for (auto ch = static_cast<unsigned char> (first); ch <= static_cast<unsigned char> (last); ++ch)
+      {
+        cs.set (ch);
+        if (ch == 0xFF)
+        {
+          break;
+        }
+      }
+      return detail::set (cs);
+    }
+
+    // Matches any character but the ones in chars
+    CPP_PC__INLINE pattern pnone_of (std::string const & chars)
+    {
+      char_set cs;
+      for (auto ch : chars)
+      {
+        cs.set (static_cast<unsigned char> (ch));
+      }
+      return detail::set (~cs);
+    }
+
+    CPP_PC__INLINE pattern pskip_string (std::string str)
+    {
+      if (str.size () == 1)
+      {
+        return pchar (str.front ());
+      }
+
+      pattern p;
+      p.code.push_back (detail::make_instruction (opcode::literal, 0, 0));
+      p.literals.push_back (std::move (str));
+      return p;
+    }
+
+    template<typename ...TPatterns>
+    CPP_PC__INLINE pattern psequence (pattern const & p, TPatterns const & ...ps)
+    {
+      pattern result;
+      detail::sequence (result, p, ps...);
+      return result;
+    }
+
+    CPP_PC__INLINE pattern pchoice (pattern const & p)
+    {
+      return p;
+    }
+
+    // Ordered choice, the first alternative that matches is taken
+    template<typename ...TPatterns>
+    CPP_PC__INLINE pattern pchoice (pattern const & p, pattern const & q, TPatterns const & ...ps)
+    {
+      return detail::choice (p, pchoice (q, ps...));
+    }
+
+    // choice L1; p; commit L1; L1:
+    CPP_PC__INLINE pattern popt (pattern const & p)
+    {
+      return detail::choice (p, pattern ());
+    }
+
+    // choice L2; L1: p; partial_commit L1; L2:
+    //  A repeated set is compiled to span. An iteration that doesn't consume
+    //  any input ends the loop
+    CPP_PC__INLINE pattern pmany (pattern const & p)
+    {
+      if (p.code.size () == 1 && p.code.front ().op == opcode::set)
+      {
+        auto result = p;
+        result.code.front ().op = opcode::span;
+        return result;
+      }
+
+      pattern result;
+      result.code.push_back (detail::make_instruction (opcode::choice, detail::offset_of (p.code.size () + 2)));
+      detail::append (result, p);
+      result.code.push_back (detail::make_instruction (opcode::partial_commit, -detail::offset_of (p.code.size ())));
+      return result;
+    }
+
+    CPP_PC__INLINE pattern pmany1 (pattern const & p)
+    {
+      return psequence (p, pmany (p));
+    }
+
+    // p (sep p)*, possibly empty
+    CPP_PC__INLINE pattern pmany_sepby (pattern const & p, pattern const & sep)
+    {
+      return popt (psequence (p, pmany (psequence (sep, p))));
+    }
+
+    // Succeeds without consuming input if p doesn't match
+    //  choice L1; p; fail_twice; L1:
+    CPP_PC__INLINE pattern pnot (pattern const & p)
+    {
+      pattern result;
+      result.code.push_back (detail::make_instruction (opcode::choice, detail::offset_of (p.code.size () + 2)));
+      detail::append (result, p);
+      result.code.push_back (detail::make_instruction (opcode::fail_twice));
+      return result;
+    }
+
+    CPP_PC__INLINE pattern peos ()
+    {
+      return pnot (pany ());
+    }
+
+    CPP_PC__INLINE pattern pskip_ws ()
+    {
+      return pmany (pany_of (" \b\f\n\r\t"));
+    }
+
+    // The range matched by p is reported as a capture with id
+    CPP_PC__INLINE pattern pcapture (std::uint32_t id, pattern const & p)
+    {
+      pattern result;
+      result.code.push_back (detail::make_instruction (opcode::open_capture, 0, id));
+      detail::append (result, p);
+      result.code.push_back (detail::make_instruction (opcode::close_capture));
+      return result;
+    }
+
+    // Calls the rule name of the grammar, rules may be recursive
+    CPP_PC__INLINE pattern pref (std::string name)
+    {
+      pattern p;
+      p.code.push_back (detail::make_instruction (opcode::call, 0, 0));
+      p.calls.push_back (std::move (name));
+      return p;
+    }
+
+    struct program
+    {
+      std::vector<instruction>  code      ;
+      std::vector<char_set>     sets      ;
+      std::vector<std::string>  literals  ;
+    };
+
+    struct grammar
+    {
+      // Redefining a rule replaces it
+      void define (std::string name, pattern p)
+      {
+        rules[std::move (name)] = std::move (p);
+      }
+
+      // The rules that are reachable from start but not defined
+      std::vector<std::string> undefined (std::string const & start) const
+      {
+        std::vector<std::string> result;
+        reachable (start, &result);
+        return result;
+      }
+
+      // Links the rules reachable from start into a program, empty if a rule
+      //  is undefined
+      //  call start; end; rule0; return; rule1; return; ...
+      opt<program> compile (std::string const & start) const
+      {
+        std::vector<std::string> missing;
+        auto names = reachable (start, &missing);
+        if (!missing.empty ())
+        {
+          return empty_opt;
+        }
+
+        std::map<std::string, std::uint32_t> addresses;
+        auto address = std::size_t (2);
+        for (auto && name : names)
+        {
+          addresses[name] = detail::index_of (address);
+          address += rules.at (name).code.size () + 1;
+        }
+
+        pattern linked;
+        linked.code.push_back (detail::make_instruction (opcode::call, 0, addresses[start]));
+        linked.code.push_back (detail::make_instruction (opcode::end));
+
+        for (auto && name : names)
+        {
+          auto & rule = rules.at (name);
+          for (auto i : rule.code)
+          {
+            switch (i.op)
+            {
+            case opcode::set:
+            case opcode::span:
+              i.arg += detail::index_of (linked.sets.size ());
+              break;
+            case opcode::literal:
+              i.arg += detail::index_of (linked.literals.size ());
+              break;
+            case opcode::call:
+              i.arg = addresses[rule.calls[i.arg]];
+              break;
+            default:
+              break;
+            }
+            linked.code.push_back (i);
+          }
+          linked.code.push_back (detail::make_instruction (opcode::return_));
+
+          linked.sets.insert (linked.sets.end (), rule.sets.begin (), rule.sets.end ());
+          linked.literals.insert (linked.literals.end (), rule.literals.begin (), rule.literals.end ());
+        }
+
+        return make_opt (program { std::move (linked.code), std::move (linked.sets), std::move (linked.literals) });
+      }
+
+    private:
+      std::vector<std::string> reachable (std::string const & start, std::vector<std::string> * missing) const
+      {
+        std::vector<std::string> names   { start };
+        std::vector<std::string> result  ;
+
+        while (!names.empty ())
+        {
+          auto name = std::move (names.back ());
+          names.pop_back ();
+
+          if (std::find (result.begin (), result.end (), name) != result.end ())
+          {
+            continue;
+          }
+
+          auto find = rules.find (name);
+          if (find == rules.end ())
+          {
+            if (std::find (missing->begin (), missing->end (), name) == missing->end ())
+            {
+              missing->push_back (name);
+            }
+            continue;
+          }
+
+          result.push_back (name);
+          names.insert (names.end (), find->second.calls.rbegin (), find->second.calls.rend ());
+        }
+
+        return result;
+      }
+
+      std::map<std::string, pattern> rules;
+    };
+
+    struct capture
+    {
+      std::uint32_t id    ;
+      std::size_t   begin ;
+      std::size_t   end   ;
+    };
+
+    using captures = std::vector<capture>;
+
+    struct match_result
+    {
+      bool        matched ;
+      // The end of the match, on failure the furthest position a character
+      //  test failed at
+      std::size_t consumed;
+      // In the order the captures were opened
+      vm::captures captures;
+    };
+
+    // Executes programs, the stack is kept between matches so that a
+    //  machine reused for many inputs doesn't allocate
+    struct machine
+    {
+      CPP_PC__NO_COPY_MOVE (machine);
+
+      machine ()  = default;
+
+      CPP_PC__INLINE void match (program const & p, char const * begin, char const * end, match_result & result)
+      {
+        CPP_PC__ASSERT (begin <= end);
+        CPP_PC__ASSERT (!p.code.empty ());
+
+        auto & cs = result.captures;
+
+        stack.clear ();
+        cs.clear ();
+
+        auto const code     = p.code.data ();
+        auto const sets     = p.sets.data ();
+        auto const literals = p.literals.data ();
+
+        auto pc       = std::size_t ();
+        auto current  = begin;
+        auto furthest = begin;
+
+        while (true)
+        {
+          auto & i = code[pc];
+
+          // Instructions that succeed continue the loop, the ones that fail
+          //  break out of the switch and backtrack
+          switch (i.op)
+          {
+          case opcode::any:
+            if (current < end)
+            {
+              ++current;
+              ++pc;
+              continue;
+            }
+            break;
+          case opcode::char_:
+            if (current < end && static_cast<unsigned char> (*current) == i.arg)
+            {
+              ++current;
+              ++pc;
+              continue;
+            }
+            break;
+          case opcode::set:
+            if (current < end && sets[i.arg][static_cast<unsigned char> (*current)])
+            {
+              ++current;
+              ++pc;
+              continue;
+            }
+            break;
+          case opcode::span:
+            {
+              auto & set = sets[i.arg];
+              for (; current < end && set[static_cast<unsigned char> (*current)]; ++current)
+                ;
+              ++pc;
+              continue;
+            }
+          case opcode::literal:
+            {
+              auto & literal = literals[i.arg];
+              auto size = literal.size ();
+              if (static_cast<std::size_t> (end - current) >= size && literal.compare (0, size, current, size) == 0)
+              {
+                current += size;
+                ++pc;
+                continue;
+              }
+            }
+            break;
+          case opcode::choice:
+            stack.push_back (entry { pc + static_cast<std::size_t> (i.offset), current, cs.size () });
+            ++pc;
+            continue;
+          case opcode::commit:
+            CPP_PC__ASSERT (!stack.empty () && stack.back ().position);
+            stack.pop_back ();
+            pc += static_cast<std::size_t> (i.offset);
+            continue;
+          case opcode::partial_commit:
+            {
+              CPP_PC__ASSERT (!stack.empty () && stack.back ().position);
+              auto & e = stack.back ();
+              if (e.position == current)
+              {
+                // The iteration didn't consume any input, leaves the loop
+                pc = e.address;
+                stack.pop_back ();
+                continue;
+              }
+              e.position  = current;
+              e.captures  = cs.size ();
+              pc += static_cast<std::size_t> (i.offset);
+              continue;
+            }
+          case opcode::fail:
+            break;
+          case opcode::fail_twice:
+            CPP_PC__ASSERT (!stack.empty ());
+            stack.pop_back ();
+            break;
+          case opcode::jump:
+            pc += static_cast<std::size_t> (i.offset);
+            continue;
+          case opcode::call:
+            stack.push_back (entry { pc + 1, nullptr, 0 });
+            pc = i.arg;
+            continue;
+          case opcode::return_:
+            CPP_PC__ASSERT (!stack.empty () && !stack.back ().position);
+            pc = stack.back ().address;
+            stack.pop_back ();
+            continue;
+          case opcode::open_capture:
+            cs.push_back (capture { i.arg, static_cast<std::size_t> (current - begin), SIZE_MAX });
+            ++pc;
+            continue;
+          case opcode::close_capture:
+            {
+              // Captures nested in this one are closed already
+              auto open = std::find_if (cs.rbegin (), cs.rend (), [] (capture const & c) { return c.end == SIZE_MAX; });
+              CPP_PC__ASSERT (open != cs.rend ());
+              open->end = static_cast<std::size_t> (current - begin);
+              ++pc;
+              continue;
+            }
+          case opcode::end:
+            result.matched  = true;
+            result.consumed = static_cast<std::size_t> (current - begin);
+            return;
+          }
+
+          furthest = std::max (furthest, current);
+
+          // Return entries of the rules being backtracked out of are dropped
+          while (!stack.empty () && !stack.back ().position)
+          {
+            stack.pop_back ();
+          }
+
+          if (stack.empty ())
+          {
+            result.matched  = false;
+            result.consumed = static_cast<std::size_t> (furthest - begin);
+            cs.clear ();
+            return;
+          }
+
+          auto & e = stack.back ();
+          pc      = e.address;
+          current = e.position;
+          cs.resize (e.captures);
+          stack.pop_back ();
+        }
+      }
+
+    private:
+      // A backtrack entry, or a return entry if position is null
+      struct entry
+      {
+        std::size_t   address   ;
+        char const *  position  ;
+        std::size_t   captures  ;
+      };
+
+      std::vector<entry> stack;
+    };
+
+    CPP_PC__INLINE match_result match (program const & p, char const * begin, char const * end)
+    {
+      machine m;
+      match_result result;
+      m.match (p, begin, end, result);
+      return result;
+    }
+
+    CPP_PC__INLINE match_result match (program const & p, std::string const & i)
+    {
+      auto begin = i.c_str ();
+      return match (p, begin, begin + i.size ());
+    }
+  }
+}
+// ----------------------------------------------------------------------------